@@ -58,6 +58,30 @@ std::string getNodeTypeName(ASTNodeType type) {
     return "UNKNOWN";
 }
 
+int builtinArgCount(const std::string& name) {
+    if (name == "sum" || name == "min" || name == "max") return 1;
+    if (name == "dot") return 2;
+    return 0;
+}
+
+ASTNode* findBareVar(ASTNode* node) {
+    while (node && node->type != ASTNodeType::VAR) {
+        switch (node->type) {
+            case ASTNodeType::EXPRESSION:
+            case ASTNodeType::SIMPLE_EXPRESSION:
+            case ASTNodeType::ADDITIVE_EXPR:
+            case ASTNodeType::TERM:
+            case ASTNodeType::FACTOR:
+                if (node->children->size() != 1) return nullptr;
+                node = node->children->at(0);
+                break;
+            default:
+                return nullptr;
+        }
+    }
+    return node && node->children->empty() ? node : nullptr;
+}
+
 // ASTNode implementation
 ASTNode::ASTNode(ASTNodeType t, Token* tok, bool thisIsFloat) {
     type = t;
@@ -79,6 +103,7 @@ ASTNode::ASTNode(ASTNodeType t, Token* tok, bool thisIsFloat) {
         isFloat = false;
     }
     
+    isBuiltin = false;
     children = new std::vector<ASTNode*>();
     dataType = getNodeTypeName(t);
 }
@@ -708,7 +733,8 @@ ASTNode* Parser::parseIOStmt() {
     return node;
 }
 
-// Rule 15: input-stmt := input ( STRING ) ;
+// Rule 15: input-stmt := input ( STRING ) ; | input ( ID ) ;
+// The ID form reads a whole array, so the ID must name an array declared with a size
 ASTNode* Parser::parseInputStmt() {
     Token inputToken = currentToken();
     ASTNode* node = new ASTNode(ASTNodeType::INPUT_STMT, &inputToken);
@@ -725,20 +751,31 @@ ASTNode* Parser::parseInputStmt() {
         syntaxError();
     }
     
-    // Match STRING
-    if (!match(TokenType::STRING)) {
-        std::cerr << "SYNTAX ERROR: Expected string literal in input statement in Rule 15" << std::endl;
-        syntaxError();
+    if (currentToken().token == TokenType::ID) {
+        // Whole array
+        ASTNode* varNode = parseVar();
+        Symbol* symbol = st.findSymbol(varNode->tokenValue);
+        if (!varNode->children->empty() || !symbol || symbol->arrSize <= 0) {
+            std::cerr << "SEMANTIC ERROR: input of '" << varNode->tokenValue << "' must name an array declared with a size in Rule 15" << std::endl;
+            syntaxError();
+        }
+        node->addChild(varNode);
+    } else {
+        // Match STRING
+        if (!match(TokenType::STRING)) {
+            std::cerr << "SYNTAX ERROR: Expected string literal or array in input statement in Rule 15" << std::endl;
+            syntaxError();
+        }
+        
+        // Save STRING token
+        Token stringToken = tokens.at(currentTokenIndex - 1);
+        ASTNode* stringNode = new ASTNode(ASTNodeType::FACTOR, &stringToken);
+        node->addChild(stringNode);
     }
     
-    // Save STRING token
-    Token stringToken = tokens.at(currentTokenIndex - 1);
-    ASTNode* stringNode = new ASTNode(ASTNodeType::FACTOR, &stringToken);
-    node->addChild(stringNode);
-    
     // Match ')'
     if (!match(TokenType::CPARENTHESES)) {
-        std::cerr << "SYNTAX ERROR: Expected ) after string in input statement in Rule 15" << std::endl;
+        std::cerr << "SYNTAX ERROR: Expected ) after string or array in input statement in Rule 15" << std::endl;
         syntaxError();
     }
     
@@ -746,6 +783,7 @@ ASTNode* Parser::parseInputStmt() {
 }
 
 // Rule 16: output-stmt := output ( STRING ) ; | output ( expression ) ;
+// An expression that is just the name of an array declared with a size prints the whole array
 ASTNode* Parser::parseOutputStmt() {
     Token outputToken = currentToken();
     ASTNode* node = new ASTNode(ASTNodeType::OUTPUT_STMT, &outputToken);
@@ -897,12 +935,27 @@ ASTNode* Parser::parseReturnStmt() {
     return node;
 }
 
+// Checks if an expression uses an array without an index, outside of indices and call arguments
+bool Parser::hasWholeArray(ASTNode* node) {
+    if (!node) return false;
+    if (node->type == ASTNodeType::VAR) {
+        Symbol* symbol = st.findSymbol(node->tokenValue);
+        return node->children->empty() && symbol && symbol->arrSize > 0;
+    }
+    if (node->type == ASTNodeType::CALL || node->type == ASTNodeType::INPUT_STMT) return false;
+    for (ASTNode* child : *node->children) {
+        if (hasWholeArray(child)) return true;
+    }
+    return false;
+}
+
 // Rule 21: expression := var = array-init-expression | var = simple-expression | simple-expression | var = array-operation
 ASTNode* Parser::parseExpression() {
     ASTNode* node = new ASTNode(ASTNodeType::EXPRESSION);
     
-    // Check if this is a variable assignment
-    if (currentToken().token == TokenType::ID) {
+    // Check if this is a variable assignment; an ID followed by ( is a call, which may be to a builtin with no symbol
+    bool isCall = currentTokenIndex + 1 < (int) tokens.size() && tokens.at(currentTokenIndex + 1).token == TokenType::OPARENTHESES;
+    if (currentToken().token == TokenType::ID && !isCall) {
         // Save current token index
         int savedIndex = currentTokenIndex;
         
@@ -948,47 +1001,19 @@ ASTNode* Parser::parseExpression() {
 
                 node->addChild(arrayInitNode);
             } 
-            // Check if this might be an array operation
-            else if (currentToken().token == TokenType::ID && 
-                     st.findSymbol(currentToken().getStrVal()) && 
-                     st.findSymbol(currentToken().getStrVal())->arrSize > 0) {
-                // This appears to be an array operation where the right side starts with an array
-                
-                // Create array operation node
-                ASTNode* arrayOpNode = new ASTNode(ASTNodeType::ARRAY_OPERATION);
-                
-                // Parse the right-hand array variable
-                ASTNode* rightVar = parseVar();
-                arrayOpNode->addChild(rightVar);
-                
-                // Check for operation
-                if (currentToken().token == TokenType::PLUS || 
-                    currentToken().token == TokenType::MINUS || 
-                    currentToken().token == TokenType::TIMES || 
-                    currentToken().token == TokenType::DIVIDE ||
-                    currentToken().token == TokenType::MOD) {
-                    
-                    // Parse array operator
-                    Token opToken = currentToken();
-                    match(currentToken().token); // Consume the operator token
-                    
-                    ASTNode* opNode = new ASTNode(ASTNodeType::ARRAY_OP, &opToken);
-                    arrayOpNode->addChild(opNode);
-                    
-                    // Parse the expression after the operator
-                    ASTNode* exprNode = parseSimpleExpression();
+            else {
+                // Regular assignment, or an array operation when a whole array is assigned an expression of whole arrays
+                ASTNode* exprNode = parseSimpleExpression();
+                Symbol* varSymbol = st.findSymbol(varNode->tokenValue);
+                bool wholeArray = varSymbol && varSymbol->arrSize > 0 && varNode->children->empty();
+                if (wholeArray && hasWholeArray(exprNode)) {
+                    ASTNode* arrayOpNode = new ASTNode(ASTNodeType::ARRAY_OPERATION);
                     arrayOpNode->addChild(exprNode);
-                    
                     node->addChild(arrayOpNode);
                 } else {
-                    // Just a simple variable assignment, no operation
-                    node->addChild(rightVar);
+                    node->addChild(exprNode);
                 }
             }
-            else {
-                // Regular assignment
-                node->addChild(parseSimpleExpression());
-            }
         } else {
             // Reset and handle as simple expression
             currentTokenIndex = savedIndex;
@@ -1175,7 +1200,8 @@ ASTNode* Parser::parseTerm() {
     
     // Handle the left recursion by iteration
     while (currentToken().token == TokenType::TIMES || 
-           currentToken().token == TokenType::DIVIDE) {
+           currentToken().token == TokenType::DIVIDE ||
+           currentToken().token == TokenType::MOD) {
         
         // Parse the multiplicative operator
         ASTNode* mulOpNode = parseMulOp();
@@ -1189,7 +1215,7 @@ ASTNode* Parser::parseTerm() {
     return node;
 }
 
-// Rule 28: mulop := * | /
+// Rule 28: mulop := * | / | %
 ASTNode* Parser::parseMulOp() {
     Token opToken = currentToken();
     ASTNode* node = new ASTNode(ASTNodeType::MULOP, &opToken);
@@ -1202,8 +1228,12 @@ ASTNode* Parser::parseMulOp() {
         node->tokenType = TokenType::DIVIDE;
         node->tokenValue = opToken.toString();
         return node;
+    } else if (match(TokenType::MOD)) {
+        node->tokenType = TokenType::MOD;
+        node->tokenValue = opToken.toString();
+        return node;
     } else {
-        std::cerr << "SYNTAX ERROR: Expected multiplicative operator (* or /) in Rule 28" << std::endl;
+        std::cerr << "SYNTAX ERROR: Expected multiplicative operator (*, / or %) in Rule 28" << std::endl;
         syntaxError();
         return nullptr; // Unreachable
     }
@@ -1266,7 +1296,12 @@ ASTNode* Parser::parseFactor() {
         
         case TokenType::INPUT: {
             // input-stmt
-            node->addChild(parseInputStmt());
+            ASTNode* inputNode = parseInputStmt();
+            if (inputNode->children->at(0)->type == ASTNodeType::VAR) {
+                std::cerr << "SEMANTIC ERROR: input of an array has no value and cannot be used in an expression in Rule 29" << std::endl;
+                syntaxError();
+            }
+            node->addChild(inputNode);
             break;
         }
         
@@ -1289,14 +1324,24 @@ ASTNode* Parser::parseCall() {
     // Save the function ID token
     Token idToken = tokens.at(currentTokenIndex - 1);
     
+    // Builtins have no symbol; a function the program has declared so far with the same name hides them
+    // The decision is kept on the CALL node so the code generator makes the same one
+    bool isBuiltin = builtinArgCount(idToken.getStrVal()) > 0;
+    for (const Symbol& symbol : st.symbols) {
+        if (symbol.name == idToken.getStrVal() && symbol.type == SymbolType::SYMBOL_FUNCTION) isBuiltin = false;
+    }
+
     // Check if the function exists in the symbol table
-    Symbol* funcSymbol = st.findSymbol(idToken.getStrVal());
-    if (!funcSymbol || funcSymbol->type != SymbolType::SYMBOL_FUNCTION) {
-        std::cerr << "SEMANTIC ERROR: Undeclared function '" << idToken.getStrVal() << "' in Rule 30" << std::endl;
-        syntaxError();
+    if (!isBuiltin) {
+        Symbol* funcSymbol = st.findSymbol(idToken.getStrVal());
+        if (!funcSymbol || funcSymbol->type != SymbolType::SYMBOL_FUNCTION) {
+            std::cerr << "SEMANTIC ERROR: Undeclared function '" << idToken.getStrVal() << "' in Rule 30" << std::endl;
+            syntaxError();
+        }
     }
     
     ASTNode* node = new ASTNode(ASTNodeType::CALL, &idToken);
+    node->isBuiltin = isBuiltin;
     
     // Match opening parenthesis
     if (!match(TokenType::OPARENTHESES)) {
@@ -1313,10 +1358,33 @@ ASTNode* Parser::parseCall() {
         std::cerr << "SYNTAX ERROR: Expected ) after arguments in function call in Rule 30" << std::endl;
         syntaxError();
     }
+
+    if (isBuiltin) {
+        checkBuiltinArgs(node);
+    }
     
     return node;
 }
 
+// Builtins work on whole arrays, so each argument is the name of an array declared with a size
+void Parser::checkBuiltinArgs(ASTNode* callNode) {
+    std::string name = callNode->tokenValue;
+    ASTNode* argsNode = callNode->children->at(0);
+    size_t numArgs = argsNode->children->empty() ? 0 : argsNode->children->at(0)->children->size();
+    if (numArgs != (size_t) builtinArgCount(name)) {
+        std::cerr << "SEMANTIC ERROR: Builtin '" << name << "' takes " << builtinArgCount(name) << " arguments but is called with " << numArgs << " in Rule 30" << std::endl;
+        syntaxError();
+    }
+    for (ASTNode* arg : *argsNode->children->at(0)->children) {
+        ASTNode* var = findBareVar(arg);
+        Symbol* symbol = var ? st.findSymbol(var->tokenValue) : nullptr;
+        if (!symbol || symbol->arrSize <= 0) {
+            std::cerr << "SEMANTIC ERROR: Argument of builtin '" << name << "' must be an array declared with a size in Rule 30" << std::endl;
+            syntaxError();
+        }
+    }
+}
+
 // Rule 31: args := arg-list | ε
 ASTNode* Parser::parseArgs() {
     ASTNode* node = new ASTNode(ASTNodeType::ARGS);
@@ -1388,20 +1456,13 @@ ASTNode* Parser::parseArrayElements() {
     return node;
 }
 
-// Rule 35: array-operation := var array-op expression
+// Rule 35: array-operation := simple-expression that uses whole arrays, as in x * y + 2
+// Each whole array stands for its elements, so the expression is worked out element by element
 ASTNode* Parser::parseArrayOperation() {
 
     ASTNode* node = new ASTNode(ASTNodeType::ARRAY_OPERATION);
     
-    // Parse left array
-    ASTNode* leftNode = parseVar();
-    node->addChild(leftNode);
-    
-    // Parse operator
-    ASTNode* opNode = parseArrayOp();
-    node->addChild(opNode);
-    
-    // Parse expression on right side
+    // Parse the elementwise expression
     ASTNode* exprNode = parseSimpleExpression();
     node->addChild(exprNode);
     
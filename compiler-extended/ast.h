@@ -60,6 +60,10 @@ class CodeGenerator;
 // Utility function to get AST node type name
 std::string getNodeTypeName(ASTNodeType type);
 
+// Returns the number of arguments of a builtin function (sum, min, max or dot), 0 if name is not one
+// A function the program declares with the same name hides the builtin from the calls that follow its declaration
+int builtinArgCount(const std::string& name);
+
 // AST Node Class
 class ASTNode {
     public:
@@ -72,6 +76,7 @@ class ASTNode {
         int tokenLine;
         int tokenIndex;
         bool isFloat;
+        bool isBuiltin; // CALL: whether the call is to a builtin rather than a function of the program, as the parser decided
         
         std::vector<ASTNode*> *children;
         std::string dataType;  // For type checking during semantic analysis
@@ -92,6 +97,9 @@ class ASTNode {
         void printToFile(std::ofstream& file, int indent);
 };
 
+// Returns the variable an expression consists of, nullptr if it is anything more than a variable
+ASTNode* findBareVar(ASTNode* node);
+
 // Symbol Tables
 enum SymbolType {
     SYMBOL_VARIABLE,
@@ -156,6 +164,12 @@ private:
     /* Throws syntax error*/
     void syntaxError();
 
+    /* Checks if an expression uses an array without an index, outside of indices and call arguments*/
+    bool hasWholeArray(ASTNode* node);
+
+    /* Checks the arguments of a call to a builtin: each must be an array, named without an index*/
+    void checkBuiltinArgs(ASTNode* callNode);
+
 public:
     // Symbol table (public for access in code generation)
     SymbolTable st;
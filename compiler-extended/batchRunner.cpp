@@ -0,0 +1,166 @@
+#include "batchRunner.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// Printed after a program that stops without END, the same as a single run of the stack machine,
+// so expected output files can be made with s.exe
+static const char COMPLETION_MESSAGE[] = "Program execution completed successfully.\n";
+
+/* Reads a whole file into text, returns false if it cannot be read */
+static bool readFile(const std::string& filename, std::string& text) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    text = contents.str();
+    return true;
+}
+
+bool readManifest(const std::string& filename, std::vector<BatchRun>& runs) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Could not read " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string program, input, expected, extra;
+        if (!(fields >> program) || program[0] == '#') {
+            continue;
+        }
+        if (!(fields >> input >> expected) || (fields >> extra)) {
+            std::cerr << "Error: " << filename << " line " << lineNumber << ": expected <program> <input file or -> <expected output or ->" << std::endl;
+            return false;
+        }
+        BatchRun run;
+        run.programFile = program;
+        run.inputFile = input == "-" ? "" : input;
+        run.expectedFile = expected == "-" ? "" : expected;
+        run.line = lineNumber;
+        run.completed = false;
+        run.status = RunStatus::FINISHED;
+        run.passed = false;
+        run.seconds = 0;
+        run.instructions = 0;
+        runs.push_back(run);
+    }
+    return true;
+}
+
+BatchRunner::BatchRunner(const BatchOptions& options) : options(options), threads(0) {}
+
+void BatchRunner::run(std::vector<BatchRun>& runs) {
+    // Loading every program up front, so workers only read the shared copies
+    for (const BatchRun& run : runs) {
+        if (programs.find(run.programFile) == programs.end()) {
+            programs[run.programFile] = Program::load(run.programFile);
+        }
+    }
+
+    threads = options.threads > 0 ? options.threads : (int) std::thread::hardware_concurrency();
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > (int) runs.size()) {
+        threads = runs.size() > 0 ? (int) runs.size() : 1;
+    }
+
+    // Dealing runs out round robin, so neighbouring manifest lines start on different workers
+    queues.clear();
+    for (int i = 0; i < threads; i++) {
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (size_t i = 0; i < runs.size(); i++) {
+        queues[i % threads]->runs.push_back(i);
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&BatchRunner::work, this, i, std::ref(runs));
+    }
+    work(0, runs); // The calling thread is worker 0
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+bool BatchRunner::nextRun(int worker, size_t& index) {
+    {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.runs.empty()) {
+            index = own.runs.front();
+            own.runs.pop_front();
+            return true;
+        }
+    }
+    for (int i = 1; i < threads; i++) {
+        WorkQueue& victim = *queues[(worker + i) % threads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.runs.empty()) {
+            index = victim.runs.back();
+            victim.runs.pop_back();
+            return true;
+        }
+    }
+    return false; // Nothing is ever added, so empty queues stay empty
+}
+
+void BatchRunner::work(int worker, std::vector<BatchRun>& runs) {
+    std::ostringstream output; // Declared first, since contexts write to it until they are destroyed
+    std::map<const Program*, std::unique_ptr<ExecutionContext>> contexts;
+    size_t index;
+    while (nextRun(worker, index)) {
+        BatchRun& run = runs[index];
+        const std::shared_ptr<const Program>& program = programs.find(run.programFile)->second;
+        if (program == nullptr) {
+            run.error = "Could not load " + run.programFile;
+            continue;
+        }
+
+        std::unique_ptr<ExecutionContext>& context = contexts[program.get()];
+        if (context == nullptr) {
+            context.reset(new ExecutionContext(program, options.initialSlots, options.maxSlots));
+            if (options.useJit) {
+                context->enableJit(options.jitThreshold);
+            }
+            context->setThreads(options.arrayThreads);
+            context->setOutput(output);
+        } else {
+            context->reset();
+        }
+        if (run.inputFile.empty()) {
+            context->setEmptyInput();
+        } else if (!context->setInputFile(run.inputFile)) {
+            run.error = "Could not read " + run.inputFile;
+            continue;
+        }
+        std::string expected;
+        if (!run.expectedFile.empty() && !readFile(run.expectedFile, expected)) {
+            run.error = "Could not read " + run.expectedFile;
+            continue;
+        }
+
+        output.str("");
+        auto start = std::chrono::steady_clock::now();
+        run.status = context->run();
+        auto end = std::chrono::steady_clock::now();
+        run.seconds = std::chrono::duration<double>(end - start).count();
+        run.instructions = context->getInstructionsExecuted();
+        run.completed = true;
+        run.error = context->getError();
+        run.output = output.str();
+        if (run.status == RunStatus::FINISHED) {
+            run.output += COMPLETION_MESSAGE;
+        }
+        run.passed = run.expectedFile.empty() || run.output == expected;
+    }
+}
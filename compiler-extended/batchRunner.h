@@ -0,0 +1,81 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stackMachine.h"
+
+/* One line of a batch manifest and the result of running it */
+struct BatchRun {
+    std::string programFile;
+    std::string inputFile; // Empty when the program gets no input
+    std::string expectedFile; // Empty when the output is not checked
+    int line; // Line of the manifest, for reports
+
+    // Filled in by BatchRunner::run()
+    bool completed; // False if the program, input or expected output could not be read
+    RunStatus status;
+    std::string error; // Why the run failed, empty if it did not
+    std::string output; // Everything the program printed
+    bool passed; // Whether output matched the expected output; true when there is none
+    double seconds; // Wall time of the run itself, without loading
+    long long instructions;
+};
+
+/* Reads a batch manifest: one run per line, the program, input and expected output files separated by spaces */
+/* Use - for no input or no expected output. Blank lines and lines starting with # are skipped */
+/* Prints an error and returns false if the manifest cannot be read or a line is malformed */
+bool readManifest(const std::string& filename, std::vector<BatchRun>& runs);
+
+/* Settings every VM instance of a batch is created with */
+struct BatchOptions {
+    int threads; // Worker threads; 0 uses one per hardware thread
+    int initialSlots;
+    int maxSlots;
+    bool useJit;
+    int jitThreshold;
+    int arrayThreads; // Threads each VM instance splits long array instructions across; see ExecutionContext::setThreads()
+};
+
+/* Runs batch entries on a pool of worker threads, each with its own VM instances */
+/* Every worker starts with an equal share of the runs and, once its own queue is empty, steals from the */
+/* back of the others', so a few long runs do not leave the remaining workers idle */
+/* Each program is loaded once and shared by all workers; a worker keeps one ExecutionContext per program */
+/* and resets it between runs */
+class BatchRunner {
+public:
+    explicit BatchRunner(const BatchOptions& options);
+
+    /* Runs every entry and fills in its results; returns once all have finished */
+    void run(std::vector<BatchRun>& runs);
+
+    /* Returns the number of worker threads the last run() used */
+    int getThreads() const {
+        return threads;
+    }
+
+private:
+    /* Runs not yet started that belong to one worker */
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> runs; // Indices into the batch; the owner takes from the front, thieves from the back
+    };
+
+    BatchOptions options;
+    int threads;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::map<std::string, std::shared_ptr<const Program>> programs; // nullptr for programs that failed to load
+
+    /* Takes the next run for worker, its own first, then one stolen from another worker */
+    /* Returns false once every queue is empty */
+    bool nextRun(int worker, size_t& index);
+
+    /* Worker thread: runs entries until none are left */
+    void work(int worker, std::vector<BatchRun>& runs);
+};
+
+#endif // BATCH_RUNNER_H
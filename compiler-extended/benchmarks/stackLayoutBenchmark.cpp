@@ -0,0 +1,169 @@
+/* Microbenchmark: operand stack layout of the stack machine */
+/* Runs the same LOAD/ADD/STORE loop against the old layout (three parallel arrays) */
+/* and the current one (one tagged Value per slot), and reports time and memory traffic */
+/* Build and run with: make bench */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+const int SLOTS = 1024;
+const int ITERATIONS = 20000000;
+
+/* Old layout: value, float value and type of a slot live in three separate arrays */
+struct ParallelStack {
+    int intStack[SLOTS];
+    float floatStack[SLOTS];
+    bool typeStack[SLOTS];
+    int stackTop;
+    int stackPointer;
+
+    // Slot traffic: every read or write of a slot touches all three arrays
+    static const int BYTES_PER_SLOT = sizeof(int) + sizeof(float) + sizeof(bool);
+
+    void push(int value) {
+        intStack[stackTop] = value;
+        floatStack[stackTop] = 0.0f;
+        typeStack[stackTop] = false;
+        stackTop++;
+    }
+
+    void load() {
+        int address = stackPointer + intStack[stackTop - 1];
+        intStack[stackTop - 1] = intStack[address];
+        floatStack[stackTop - 1] = floatStack[address];
+        typeStack[stackTop - 1] = typeStack[address];
+    }
+
+    void store() {
+        int address = stackPointer + intStack[stackTop - 1];
+        intStack[address] = intStack[stackTop - 2];
+        floatStack[address] = floatStack[stackTop - 2];
+        typeStack[address] = typeStack[stackTop - 2];
+        stackTop -= 2;
+    }
+
+    // Pops both operands and pushes the result, as the old handlers did
+    void add() {
+        bool bType = typeStack[--stackTop];
+        int bInt = intStack[stackTop];
+        float bFloat = floatStack[stackTop];
+        bool aType = typeStack[--stackTop];
+        int aInt = intStack[stackTop];
+        float aFloat = floatStack[stackTop];
+        if (aType || bType) {
+            float result = (aType ? aFloat : aInt) + (bType ? bFloat : bInt);
+            intStack[stackTop] = 0;
+            floatStack[stackTop] = result;
+            typeStack[stackTop] = true;
+        } else {
+            intStack[stackTop] = aInt + bInt;
+            floatStack[stackTop] = 0.0f;
+            typeStack[stackTop] = false;
+        }
+        stackTop++;
+    }
+
+    int result(int offset) { return intStack[stackPointer + offset]; }
+};
+
+/* Current layout: one 8-byte tagged value per slot */
+struct Value {
+    union {
+        int32_t i;
+        float f;
+    };
+    int32_t isFloat;
+};
+
+struct TaggedStack {
+    Value memory[SLOTS];
+    int stackTop;
+    int stackPointer;
+
+    static const int BYTES_PER_SLOT = sizeof(Value);
+
+    void push(int value) {
+        memory[stackTop].i = value;
+        memory[stackTop].isFloat = 0;
+        stackTop++;
+    }
+
+    void load() {
+        Value& top = memory[stackTop - 1];
+        top = memory[stackPointer + top.i];
+    }
+
+    void store() {
+        memory[stackPointer + memory[stackTop - 1].i] = memory[stackTop - 2];
+        stackTop -= 2;
+    }
+
+    // Writes the result over the first operand in place
+    void add() {
+        Value& a = memory[stackTop - 2];
+        const Value& b = memory[stackTop - 1];
+        stackTop -= 1;
+        if (a.isFloat | b.isFloat) {
+            a.f = (a.isFloat ? a.f : a.i) + (b.isFloat ? b.f : b.i);
+            a.isFloat = 1;
+        } else {
+            a.i = a.i + b.i;
+        }
+    }
+
+    int result(int offset) { return memory[stackPointer + offset].i; }
+};
+
+enum BenchOp { B_PUSH, B_LOAD, B_ADD, B_STORE, B_LOOP };
+
+/* Loop body as the compiler emits x = x + y: PUSH(0); LOAD; PUSH(1); LOAD; ADD; PUSH(0); STORE */
+/* Dispatched through a switch like the VM so the handlers are not merged into one expression */
+const int PROGRAM[][2] = {
+    {B_PUSH, 0}, {B_LOAD, 0}, {B_PUSH, 1}, {B_LOAD, 0}, {B_ADD, 0}, {B_PUSH, 0}, {B_STORE, 0}, {B_LOOP, 0}
+};
+
+/* Slot accesses per iteration: 3 pushes, 2 loads (read + write), ADD (2 reads, 1 write), STORE (2 reads, 1 write) */
+const long long SLOT_ACCESSES = 3 + 4 + 3 + 3;
+
+/* Array elements touched per slot access: the parallel layout writes three arrays, the tagged one a single slot */
+template <typename Stack>
+void runLoop(const char* name, Stack& stack, int arraysPerSlot) {
+    stack.stackTop = 0;
+    stack.stackPointer = 0;
+    stack.push(0); // x
+    stack.push(3); // y
+
+    int remaining = ITERATIONS;
+    auto start = std::chrono::steady_clock::now();
+    for (int pc = 0; ; pc++) {
+        switch (PROGRAM[pc][0]) {
+            case B_PUSH: stack.push(PROGRAM[pc][1]); break;
+            case B_LOAD: stack.load(); break;
+            case B_ADD: stack.add(); break;
+            case B_STORE: stack.store(); break;
+            case B_LOOP: pc = -1; break;
+        }
+        if (pc == -1 && --remaining == 0) {
+            break;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    long long bytes = SLOT_ACCESSES * Stack::BYTES_PER_SLOT * ITERATIONS;
+    std::cout << name << ": " << elapsed.count() << " s, "
+              << SLOT_ACCESSES * Stack::BYTES_PER_SLOT << " bytes and "
+              << SLOT_ACCESSES * arraysPerSlot << " array accesses per iteration, "
+              << bytes / (1024 * 1024) << " MiB touched"
+              << " (x = " << stack.result(0) << ")" << std::endl;
+}
+
+int main() {
+    static ParallelStack parallel;
+    static TaggedStack tagged;
+
+    std::cout << ITERATIONS << " iterations of x = x + y (LOAD/ADD/STORE)" << std::endl;
+    runLoop("three parallel arrays", parallel, 3);
+    runLoop("tagged values        ", tagged, 1);
+    return 0;
+}
@@ -0,0 +1,650 @@
+#include "bytecode.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+// Returns the opcode for an instruction name and parameter kind, NOP if the pair is invalid
+// char kind: 'n' for no parameter, 's' for string, 'i' for int, 'f' for float, 'p' for a pair of ints,
+// 'l' for a label and an int, 't' for a label and two ints, 'v' for an operand record: a list of more than two ints,
+// or two for the reductions, HALLOC and VPRINT
+static Op decodeOp(const std::string& f, char kind) {
+    if (kind == 'n') {
+        if (f == "CALL") return Op::CALL;
+        else if (f == "RET") return Op::RET;
+        else if (f == "RETV") return Op::RETV;
+        else if (f == "PUSH") return Op::PUSH;
+        else if (f == "POP") return Op::POP;
+        else if (f == "DUP") return Op::DUP;
+        else if (f == "LOAD") return Op::LOAD;
+        else if (f == "SAVE") return Op::SAVE;
+        else if (f == "STORE") return Op::STORE;
+        else if (f == "ADD") return Op::ADD;
+        else if (f == "SUB") return Op::SUB;
+        else if (f == "MUL") return Op::MUL;
+        else if (f == "DIV") return Op::DIV;
+        else if (f == "REM") return Op::REM;
+        else if (f == "EQ") return Op::EQ;
+        else if (f == "NE" || f == "NEQ") return Op::NE; // Code generator writes NE as NEQ
+        else if (f == "LE") return Op::LE;
+        else if (f == "GE") return Op::GE;
+        else if (f == "LT") return Op::LT;
+        else if (f == "GT") return Op::GT;
+        else if (f == "BRT") return Op::BRT;
+        else if (f == "BRZ") return Op::BRZ;
+        else if (f == "JUMP") return Op::JUMP;
+        else if (f == "PRINT") return Op::PRINT;
+        else if (f == "READ") return Op::READ;
+        else if (f == "READF") return Op::READF;
+        else if (f == "END") return Op::END;
+        else if (f == "INT") return Op::INT;
+        else if (f == "FLOAT") return Op::FLOAT;
+        else if (f == "IADD") return Op::IADD;
+        else if (f == "ISUB") return Op::ISUB;
+        else if (f == "IMUL") return Op::IMUL;
+        else if (f == "IDIV") return Op::IDIV;
+        else if (f == "FADD") return Op::FADD;
+        else if (f == "FSUB") return Op::FSUB;
+        else if (f == "FMUL") return Op::FMUL;
+        else if (f == "FDIV") return Op::FDIV;
+        else if (f == "IEQ") return Op::IEQ;
+        else if (f == "INE") return Op::INE;
+        else if (f == "ILE") return Op::ILE;
+        else if (f == "IGE") return Op::IGE;
+        else if (f == "ILT") return Op::ILT;
+        else if (f == "IGT") return Op::IGT;
+        else if (f == "FEQ") return Op::FEQ;
+        else if (f == "FNE") return Op::FNE;
+        else if (f == "FLE") return Op::FLE;
+        else if (f == "FGE") return Op::FGE;
+        else if (f == "FLT") return Op::FLT;
+        else if (f == "FGT") return Op::FGT;
+    } else if (kind == 's') {
+        if (f == "PRINT") return Op::PRINT_S;
+        else if (f == "BRT") return Op::BRT_I; // Label parameters are resolved to addresses in assemble()
+        else if (f == "BRZ") return Op::BRZ_I;
+        else if (f == "JUMP") return Op::JUMP_I;
+        else if (f == "CALL") return Op::CALL_I;
+    } else if (kind == 'i') {
+        if (f == "PUSH") return Op::PUSH_I;
+        else if (f == "BRT") return Op::BRT_I;
+        else if (f == "BRZ") return Op::BRZ_I;
+        else if (f == "JUMP") return Op::JUMP_I;
+        else if (f == "LOADL") return Op::LOADL;
+        else if (f == "STOREL") return Op::STOREL;
+        else if (f == "RET") return Op::RET_N;
+        else if (f == "RETV") return Op::RETV_N;
+        else if (f == "HFREE") return Op::HFREE;
+    } else if (kind == 'p') {
+        if (f == "ADDLL") return Op::ADDLL;
+    } else if (kind == 'l') {
+        if (f == "CALL") return Op::CALL_N;
+    } else if (kind == 't') {
+        if (f == "TAILCALL") return Op::TAILCALL;
+    } else if (kind == 'v') {
+        if (f == "VADDS") return Op::VADDS;
+        else if (f == "VSUBS") return Op::VSUBS;
+        else if (f == "VMULS") return Op::VMULS;
+        else if (f == "VDIVS") return Op::VDIVS;
+        else if (f == "VREMS") return Op::VREMS;
+        else if (f == "VADDV") return Op::VADDV;
+        else if (f == "VSUBV") return Op::VSUBV;
+        else if (f == "VMULV") return Op::VMULV;
+        else if (f == "VDIVV") return Op::VDIVV;
+        else if (f == "VREMV") return Op::VREMV;
+        else if (f == "VMAP") return Op::VMAP;
+        else if (f == "VSUM") return Op::VSUM;
+        else if (f == "VMIN") return Op::VMIN;
+        else if (f == "VMAX") return Op::VMAX;
+        else if (f == "VDOT") return Op::VDOT;
+        else if (f == "HALLOC") return Op::HALLOC;
+        else if (f == "HLOAD") return Op::HLOAD;
+        else if (f == "HSTORE") return Op::HSTORE;
+        else if (f == "VREAD") return Op::VREAD;
+        else if (f == "VPRINT") return Op::VPRINT;
+    } else if (kind == 'f') {
+        if (f == "PUSH") return Op::PUSH_F; // For all other instructions, type is inferred from stack
+    }
+    return Op::NOP;
+}
+
+// Returns the stack machine name of an opcode
+const char* getOpName(Op op) {
+    switch (op) {
+        case Op::NOP: return "NOP";
+        case Op::CALL: case Op::CALL_I: case Op::CALL_N: return "CALL";
+        case Op::RET: case Op::RET_N: return "RET";
+        case Op::RETV: case Op::RETV_N: return "RETV";
+        case Op::TAILCALL: return "TAILCALL";
+        case Op::PUSH: case Op::PUSH_I: case Op::PUSH_F: return "PUSH";
+        case Op::POP: return "POP";
+        case Op::DUP: return "DUP";
+        case Op::LOAD: return "LOAD";
+        case Op::SAVE: return "SAVE";
+        case Op::STORE: return "STORE";
+        case Op::ADD: return "ADD";
+        case Op::SUB: return "SUB";
+        case Op::MUL: return "MUL";
+        case Op::DIV: return "DIV";
+        case Op::REM: return "REM";
+        case Op::EQ: return "EQ";
+        case Op::NE: return "NE";
+        case Op::LE: return "LE";
+        case Op::GE: return "GE";
+        case Op::LT: return "LT";
+        case Op::GT: return "GT";
+        case Op::BRT: case Op::BRT_I: return "BRT";
+        case Op::BRZ: case Op::BRZ_I: return "BRZ";
+        case Op::JUMP: case Op::JUMP_I: return "JUMP";
+        case Op::PRINT: case Op::PRINT_S: return "PRINT";
+        case Op::READ: return "READ";
+        case Op::READF: return "READF";
+        case Op::END: return "END";
+        case Op::INT: return "INT";
+        case Op::FLOAT: return "FLOAT";
+        case Op::LOADL: return "LOADL";
+        case Op::STOREL: return "STOREL";
+        case Op::ADDLL: return "ADDLL";
+        case Op::IADD: return "IADD";
+        case Op::ISUB: return "ISUB";
+        case Op::IMUL: return "IMUL";
+        case Op::IDIV: return "IDIV";
+        case Op::FADD: return "FADD";
+        case Op::FSUB: return "FSUB";
+        case Op::FMUL: return "FMUL";
+        case Op::FDIV: return "FDIV";
+        case Op::IEQ: return "IEQ";
+        case Op::INE: return "INE";
+        case Op::ILE: return "ILE";
+        case Op::IGE: return "IGE";
+        case Op::ILT: return "ILT";
+        case Op::IGT: return "IGT";
+        case Op::FEQ: return "FEQ";
+        case Op::FNE: return "FNE";
+        case Op::FLE: return "FLE";
+        case Op::FGE: return "FGE";
+        case Op::FLT: return "FLT";
+        case Op::FGT: return "FGT";
+        case Op::VADDS: return "VADDS";
+        case Op::VSUBS: return "VSUBS";
+        case Op::VMULS: return "VMULS";
+        case Op::VDIVS: return "VDIVS";
+        case Op::VREMS: return "VREMS";
+        case Op::VADDV: return "VADDV";
+        case Op::VSUBV: return "VSUBV";
+        case Op::VMULV: return "VMULV";
+        case Op::VDIVV: return "VDIVV";
+        case Op::VREMV: return "VREMV";
+        case Op::VMAP: return "VMAP";
+        case Op::VSUM: return "VSUM";
+        case Op::VMIN: return "VMIN";
+        case Op::VMAX: return "VMAX";
+        case Op::VDOT: return "VDOT";
+        case Op::HALLOC: return "HALLOC";
+        case Op::HFREE: return "HFREE";
+        case Op::HLOAD: return "HLOAD";
+        case Op::HSTORE: return "HSTORE";
+        case Op::VREAD: return "VREAD";
+        case Op::VPRINT: return "VPRINT";
+        default: return "UNKNOWN"; // Should never run
+    }
+}
+
+// Returns name of the first label at address, nullptr if there is none
+const char* BytecodeView::labelAt(int32_t address) const {
+    for (uint32_t i = 0; i < labelCount; i++) {
+        if (labels[i].address == address) {
+            return string(labels[i].name);
+        }
+    }
+    return nullptr;
+}
+
+// Returns the instruction as stack machine text
+std::string BytecodeView::disassemble(uint32_t index) const {
+    const DecodedInstruction& instr = code[index];
+    std::ostringstream oss;
+
+    if (instr.op == Op::NOP) {
+        const char* label = labelAt((int32_t) index);
+        return label ? label : "";
+    }
+
+    oss << getOpName(instr.op) << "(";
+    switch (instr.op) {
+        case Op::PUSH_I: case Op::LOADL: case Op::STOREL: case Op::RET_N: case Op::RETV_N: case Op::HFREE:
+            oss << instr.iArg;
+            break;
+        case Op::ADDLL:
+            oss << addllFirst(instr.iArg) << "," << addllSecond(instr.iArg);
+            break;
+        case Op::PUSH_F: {
+            // Keeping a decimal point so the text decodes as a float again
+            std::ostringstream value;
+            value << instr.fArg;
+            std::string text = value.str();
+            if (text.find_first_of(".eEni") == std::string::npos) text += ".0";
+            oss << text;
+            break;
+        }
+        case Op::PRINT_S:
+            oss << "\"" << string(instr.iArg) << "\"";
+            break;
+        case Op::CALL_I: case Op::BRT_I: case Op::BRZ_I: case Op::JUMP_I: {
+            const char* label = labelAt(instr.iArg);
+            if (label) oss << "\"" << label << "\"";
+            else oss << instr.iArg;
+            break;
+        }
+        case Op::CALL_N: {
+            const char* label = labelAt(instr.iArg);
+            oss << "\"" << (label ? label : "?") << "\"," << instr.aux;
+            break;
+        }
+        case Op::TAILCALL: {
+            const char* label = labelAt(instr.iArg);
+            oss << "\"" << (label ? label : "?") << "\"," << tailCallParams(instr.aux) << "," << tailCallFrameParams(instr.aux);
+            break;
+        }
+        default:
+            if (isVectorOp(instr.op)) {
+                const int32_t* record = constants + instr.iArg;
+                oss << record[VECTOR_DST] << "," << record[VECTOR_SRC] << ",";
+                if (!isVectorScalarOp(instr.op)) oss << record[VECTOR_SRC2] << ",";
+                oss << record[VECTOR_LENGTH] << "," << record[VECTOR_FLAGS];
+            } else if (instr.op == Op::VMAP) {
+                const int32_t* record = constants + instr.iArg;
+                oss << record[VMAP_DST] << "," << record[VMAP_LENGTH] << "," << record[VMAP_FLAGS];
+                for (int32_t i = 0; i < 2 * record[VMAP_STEP_COUNT]; i++) oss << "," << record[VMAP_HEADER_SIZE + i];
+            } else if (isReduceOp(instr.op)) {
+                const int32_t* record = constants + instr.iArg;
+                oss << record[REDUCE_SRC] << ",";
+                if (instr.op == Op::VDOT) oss << record[REDUCE_SRC2] << ",";
+                oss << record[REDUCE_LENGTH];
+            } else if (instr.op == Op::HALLOC || instr.op == Op::HLOAD || instr.op == Op::HSTORE) {
+                const int32_t* record = constants + instr.iArg;
+                oss << record[HEAP_SLOT] << "," << record[HEAP_LENGTH];
+            } else if (instr.op == Op::VREAD || instr.op == Op::VPRINT) {
+                const int32_t* record = constants + instr.iArg;
+                oss << record[ARRAY_IO_ARRAY] << "," << record[ARRAY_IO_LENGTH];
+                if (instr.op == Op::VREAD) oss << "," << record[ARRAY_IO_FLAGS];
+            }
+            break;
+    }
+    oss << ");";
+    return oss.str();
+}
+
+// Bytecode constructor
+Bytecode::Bytecode() {
+    stringOffsets.push_back(0);
+}
+
+// Adds a string to the pool, returns its index
+uint32_t Bytecode::addString(const std::string& s) {
+    stringData.insert(stringData.end(), s.begin(), s.end());
+    stringData.push_back('\0');
+    stringOffsets.push_back((uint32_t) stringData.size());
+    return (uint32_t) stringOffsets.size() - 2;
+}
+
+// Checks a VMAP record: every step is valid and the steps leave exactly one value
+bool isValidVectorMap(const int32_t* record, uint32_t available) {
+    if (available < (uint32_t) VMAP_HEADER_SIZE) return false;
+    int32_t steps = record[VMAP_STEP_COUNT];
+    int32_t scalars = record[VMAP_SCALAR_COUNT];
+    if (steps < 1 || (uint32_t) steps > (available - VMAP_HEADER_SIZE) / 2) return false;
+    if (record[VMAP_LENGTH] < 0 || (record[VMAP_FLAGS] & ~VECTOR_FLAGS_MASK) != 0 || scalars < 0 || scalars > steps) return false;
+    int32_t depth = 0;
+    for (int32_t i = 0; i < steps; i++) {
+        int32_t kind = record[VMAP_HEADER_SIZE + 2 * i];
+        int32_t value = record[VMAP_HEADER_SIZE + 2 * i + 1];
+        if (kind == VMAP_ARRAY || kind == VMAP_SCALAR) {
+            if (kind == VMAP_SCALAR && (value < 0 || value >= scalars)) return false;
+            if (++depth > VMAP_MAX_DEPTH) return false;
+        } else if (kind == VMAP_OP) {
+            if (value < 0 || value > 4 || depth < 2) return false;
+            depth--;
+        } else {
+            return false;
+        }
+    }
+    return depth == 1;
+}
+
+// Adds the operand record of a vector instruction to the constant pool and points decoded at it
+bool Bytecode::addVectorRecord(const std::string& name, const std::vector<int32_t>& values, DecodedInstruction& decoded) {
+    if (name == "VMAP") { // dst,length,flags then the steps
+        if (values.size() < 5 || values.size() % 2 != 1) {
+            return false;
+        }
+        std::vector<int32_t> record = { values[0], values[1], values[2], (int32_t) (values.size() - 3) / 2, 0 };
+        for (size_t i = 3; i < values.size(); i += 2) {
+            record.push_back(values[i]);
+            record.push_back(values[i + 1]);
+            if (values[i] == VMAP_SCALAR) record[VMAP_SCALAR_COUNT]++;
+        }
+        if (!isValidVectorMap(record.data(), (uint32_t) record.size())) {
+            return false;
+        }
+        decoded.iArg = (int32_t) constants.size();
+        constants.insert(constants.end(), record.begin(), record.end());
+        return true;
+    }
+    if (name == "VSUM" || name == "VMIN" || name == "VMAX" || name == "VDOT") { // src, src2 for VDOT, then length
+        bool dot = name == "VDOT";
+        if (values.size() != (size_t) (dot ? REDUCE_RECORD_SIZE : REDUCE_RECORD_SIZE - 1)) {
+            return false;
+        }
+        int32_t record[REDUCE_RECORD_SIZE];
+        record[REDUCE_SRC] = values[0];
+        record[REDUCE_SRC2] = dot ? values[1] : 0;
+        record[REDUCE_LENGTH] = values[dot ? 2 : 1];
+        if (record[REDUCE_LENGTH] < 0) {
+            return false;
+        }
+        decoded.iArg = (int32_t) constants.size();
+        constants.insert(constants.end(), record, record + REDUCE_RECORD_SIZE);
+        return true;
+    }
+    if (name == "HALLOC" || name == "HLOAD" || name == "HSTORE") { // slot, length
+        if (values.size() != (size_t) HEAP_RECORD_SIZE || values[HEAP_SLOT] < 0 || values[HEAP_LENGTH] < 0) {
+            return false;
+        }
+        decoded.iArg = (int32_t) constants.size();
+        constants.insert(constants.end(), values.begin(), values.end());
+        return true;
+    }
+    if (name == "VREAD" || name == "VPRINT") { // array, length, then flags for VREAD
+        bool read = name == "VREAD";
+        if (values.size() != (size_t) (read ? ARRAY_IO_RECORD_SIZE : ARRAY_IO_RECORD_SIZE - 1)) {
+            return false;
+        }
+        int32_t record[ARRAY_IO_RECORD_SIZE];
+        record[ARRAY_IO_ARRAY] = values[0];
+        record[ARRAY_IO_LENGTH] = values[1];
+        record[ARRAY_IO_FLAGS] = read ? values[2] : 0;
+        if (record[ARRAY_IO_LENGTH] < 0 || (record[ARRAY_IO_FLAGS] & ~VECTOR_FLAGS_MASK) != 0) {
+            return false;
+        }
+        decoded.iArg = (int32_t) constants.size();
+        constants.insert(constants.end(), record, record + ARRAY_IO_RECORD_SIZE);
+        return true;
+    }
+    bool scalar = name.size() == 5 && name[0] == 'V' && name[4] == 'S'; // VADDS and the like take no second array
+    if (values.size() != (size_t) (scalar ? VECTOR_RECORD_SIZE - 1 : VECTOR_RECORD_SIZE)) {
+        return false;
+    }
+    int32_t record[VECTOR_RECORD_SIZE];
+    record[VECTOR_DST] = values[0];
+    record[VECTOR_SRC] = values[1];
+    record[VECTOR_SRC2] = scalar ? 0 : values[2];
+    record[VECTOR_LENGTH] = values[scalar ? 2 : 3];
+    record[VECTOR_FLAGS] = values[scalar ? 3 : 4];
+    if (record[VECTOR_LENGTH] < 0 || (record[VECTOR_FLAGS] & ~VECTOR_FLAGS_MASK) != 0) {
+        return false;
+    }
+    decoded.iArg = (int32_t) constants.size();
+    constants.insert(constants.end(), record, record + VECTOR_RECORD_SIZE);
+    return true;
+}
+
+// Parses one line into its decoded form
+bool Bytecode::parseLine(std::string instruction, int line, std::vector<std::pair<int, std::string>>& fixups) {
+    DecodedInstruction decoded;
+    decoded.op = Op::NOP;
+    decoded.aux = 0;
+    decoded.iArg = 0;
+
+    // Ignoring everything after a semicolon
+    size_t semicolonPos = instruction.find(';');
+    if (semicolonPos != std::string::npos) {
+        instruction = instruction.substr(0, semicolonPos);
+    }
+
+    // Removing whitespace outside of quotes
+    bool inQuotes = false;
+    std::string stripped;
+    for (size_t i = 0; i < instruction.size(); ++i) {
+        if (instruction[i] == '"') {
+            inQuotes = !inQuotes;
+        } else if (!inQuotes && std::isspace((unsigned char) instruction[i])) {
+            continue;
+        }
+        stripped += instruction[i];
+    }
+    instruction = stripped;
+
+    // Finding parantheses, potential parameter
+    size_t openParen = instruction.find('(');
+    size_t closeParen = instruction.rfind(')');
+    if (openParen == std::string::npos || closeParen == std::string::npos || closeParen < openParen) {
+        // This line is a label
+        if (!instruction.empty()) {
+            BytecodeLabel label;
+            label.name = addString(instruction);
+            label.address = line;
+            labels.push_back(label);
+        }
+        code.push_back(decoded);
+        return true;
+    }
+
+    std::string functionName = instruction.substr(0, openParen);
+    std::string params = instruction.substr(openParen + 1, closeParen - openParen - 1);
+
+    char kind = 'n';
+    std::string stringParam;
+    if (!params.empty()) {
+        size_t labelEnd = params.find("\",");
+        if (params[0] == '"' && labelEnd != std::string::npos && labelEnd > 0) { // Case: Label and numbers of parameters
+            kind = 'l';
+            stringParam = params.substr(1, labelEnd - 1);
+            try {
+                size_t used = 0;
+                std::string counts = params.substr(labelEnd + 2);
+                size_t comma = counts.find(',');
+                if (comma == std::string::npos) { // Callee's parameters
+                    int32_t numParams = std::stoi(counts, &used);
+                    if (used != counts.length() || numParams < 0 || numParams > CALL_MAX_PARAMS) {
+                        throw std::invalid_argument(params);
+                    }
+                    decoded.aux = (uint16_t) numParams;
+                } else { // Callee's parameters, then those of the frame it replaces
+                    kind = 't';
+                    size_t usedSecond = 0;
+                    int32_t numParams = std::stoi(counts.substr(0, comma), &used);
+                    int32_t frameParams = std::stoi(counts.substr(comma + 1), &usedSecond);
+                    if (used != comma || comma + 1 + usedSecond != counts.length() || numParams < 0 || numParams > TAILCALL_MAX_PARAMS
+                        || frameParams < 0 || frameParams > TAILCALL_MAX_PARAMS) {
+                        throw std::invalid_argument(params);
+                    }
+                    decoded.aux = (uint16_t) (numParams | (frameParams << 8));
+                }
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid parameter '" << params << "' on line " << line + 1 << std::endl;
+                return false;
+            }
+        } else if (params.length() >= 2 && params[0] == '"' && params[params.length() - 1] == '"') { // Case: String parameter
+            kind = 's';
+            stringParam = params.substr(1, params.length() - 2);
+        } else { // Case: Numeric parameter
+            try {
+                size_t used = 0;
+                size_t comma = params.find(',');
+                if (comma != std::string::npos && (params.find(',', comma + 1) != std::string::npos || decodeOp(functionName, 'v') != Op::NOP)) { // Operand record
+                    kind = 'v';
+                    std::vector<int32_t> values;
+                    size_t start = 0;
+                    while (start <= params.length()) {
+                        size_t end = params.find(',', start);
+                        if (end == std::string::npos) end = params.length();
+                        size_t usedValue = 0;
+                        values.push_back(std::stoi(params.substr(start, end - start), &usedValue));
+                        if (usedValue != end - start) throw std::invalid_argument(params);
+                        start = end + 1;
+                    }
+                    if (!addVectorRecord(functionName, values, decoded)) throw std::invalid_argument(params);
+                    used = params.length();
+                } else if (comma != std::string::npos) { // Pair of frame offsets
+                    kind = 'p';
+                    size_t usedSecond = 0;
+                    int32_t first = std::stoi(params.substr(0, comma), &used);
+                    int32_t second = std::stoi(params.substr(comma + 1), &usedSecond);
+                    if (used != comma || first < 0 || first > ADDLL_MAX_OFFSET || second < 0 || second > ADDLL_MAX_OFFSET) {
+                        throw std::invalid_argument(params);
+                    }
+                    decoded.iArg = (int32_t) ((uint32_t) first | ((uint32_t) second << 16));
+                    used = comma + 1 + usedSecond;
+                } else if (params.find('.') != std::string::npos) { // Float (contains a decimal point)
+                    kind = 'f';
+                    decoded.fArg = std::stof(params, &used);
+                } else { // Integer
+                    kind = 'i';
+                    decoded.iArg = std::stoi(params, &used);
+                }
+                if (used != params.length()) throw std::invalid_argument(params);
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid parameter '" << params << "' on line " << line + 1 << std::endl;
+                return false;
+            }
+        }
+    }
+
+    decoded.op = decodeOp(functionName, kind);
+    if (decoded.op == Op::NOP) {
+        std::cerr << "Error: Invalid instruction '" << instruction << "' on line " << line + 1 << std::endl;
+        return false;
+    }
+
+    if (decoded.op == Op::PRINT_S) {
+        decoded.iArg = (int32_t) addString(stringParam);
+    } else if (kind == 's' || kind == 'l' || kind == 't') {
+        // Label parameters are patched with their address once every label is known
+        fixups.push_back(std::make_pair(line, stringParam));
+        decoded.iArg = -1;
+    }
+    code.push_back(decoded);
+    return true;
+}
+
+// Decodes stack machine text, one instruction or label per line
+bool Bytecode::assemble(const std::vector<std::string>& lines) {
+    std::vector<std::pair<int, std::string>> fixups;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (!parseLine(lines[i], (int) i, fixups)) {
+            return false;
+        }
+    }
+
+    // Resolving label parameters once so branches and calls never search for them
+    // The first definition of a name wins
+    std::unordered_map<std::string, int32_t> addresses;
+    BytecodeView v = view();
+    for (const BytecodeLabel& label : labels) {
+        addresses.emplace(v.string(label.name), label.address);
+    }
+    for (const auto& fixup : fixups) {
+        auto it = addresses.find(fixup.second);
+        if (it == addresses.end()) {
+            std::cerr << "Error: Label '" << fixup.second << "' not found (line " << fixup.first + 1 << ")" << std::endl;
+            return false;
+        }
+        code[fixup.first].iArg = it->second;
+    }
+    return true;
+}
+
+// Forms superinstructions from PUSH(k);LOAD(), PUSH(k);STORE() and PUSH(k);LOAD();PUSH(j);LOAD();ADD()
+void Bytecode::formSuperinstructions() {
+    // Returns true if instruction i is PUSH(k) followed by op
+    auto pushThen = [&](size_t i, Op op) {
+        return i + 1 < code.size() && code[i].op == Op::PUSH_I && code[i + 1].op == op;
+    };
+    // Returns true if k fits an ADDLL operand
+    auto fitsAddll = [](int32_t k) {
+        return k >= 0 && k <= ADDLL_MAX_OFFSET;
+    };
+
+    for (size_t i = 0; i < code.size(); i++) {
+        DecodedInstruction& instr = code[i];
+        if (pushThen(i, Op::LOAD) && pushThen(i + 2, Op::LOAD) && i + 4 < code.size() && code[i + 4].op == Op::ADD
+            && fitsAddll(instr.iArg) && fitsAddll(code[i + 2].iArg)) {
+            instr.iArg = (int32_t) ((uint32_t) instr.iArg | ((uint32_t) code[i + 2].iArg << 16));
+            instr.op = Op::ADDLL;
+            instr.aux = 4;
+        } else if (pushThen(i, Op::LOAD)) {
+            instr.op = Op::LOADL;
+            instr.aux = 1;
+        } else if (pushThen(i, Op::STORE)) {
+            instr.op = Op::STOREL;
+            instr.aux = 1;
+        }
+    }
+}
+
+// Returns a view over this object's storage
+BytecodeView Bytecode::view() const {
+    BytecodeView v;
+    v.code = code.data();
+    v.codeCount = (uint32_t) code.size();
+    v.constants = constants.data();
+    v.constantCount = (uint32_t) constants.size();
+    v.stringOffsets = stringOffsets.data();
+    v.stringData = stringData.data();
+    v.stringCount = (uint32_t) stringOffsets.size() - 1;
+    v.labels = labels.data();
+    v.labelCount = (uint32_t) labels.size();
+    return v;
+}
+
+// Rounds a section offset up to the next multiple of 8
+static uint32_t alignSection(size_t offset) {
+    return (uint32_t) ((offset + 7) & ~(size_t) 7);
+}
+
+// Writes the program as a .vsmb file
+bool Bytecode::writeFile(const std::string& filename) const {
+    BytecodeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, VSMB_MAGIC, sizeof(header.magic));
+    header.version = VSMB_VERSION;
+
+    // Laying out sections after the header
+    size_t offset = sizeof(BytecodeHeader);
+    header.codeCount = (uint32_t) code.size();
+    header.codeOffset = alignSection(offset);
+    offset = header.codeOffset + code.size() * sizeof(DecodedInstruction);
+    header.constantCount = (uint32_t) constants.size();
+    header.constantOffset = alignSection(offset);
+    offset = header.constantOffset + constants.size() * sizeof(int32_t);
+    header.stringCount = (uint32_t) stringOffsets.size() - 1;
+    header.stringOffsetsOffset = alignSection(offset);
+    offset = header.stringOffsetsOffset + stringOffsets.size() * sizeof(uint32_t);
+    header.stringDataSize = (uint32_t) stringData.size();
+    header.stringDataOffset = alignSection(offset);
+    offset = header.stringDataOffset + stringData.size();
+    header.labelCount = (uint32_t) labels.size();
+    header.labelOffset = alignSection(offset);
+    offset = header.labelOffset + labels.size() * sizeof(BytecodeLabel);
+    header.fileSize = alignSection(offset);
+
+    std::vector<char> image(header.fileSize, 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    if (!code.empty()) std::memcpy(image.data() + header.codeOffset, code.data(), code.size() * sizeof(DecodedInstruction));
+    if (!constants.empty()) std::memcpy(image.data() + header.constantOffset, constants.data(), constants.size() * sizeof(int32_t));
+    std::memcpy(image.data() + header.stringOffsetsOffset, stringOffsets.data(), stringOffsets.size() * sizeof(uint32_t));
+    if (!stringData.empty()) std::memcpy(image.data() + header.stringDataOffset, stringData.data(), stringData.size());
+    if (!labels.empty()) std::memcpy(image.data() + header.labelOffset, labels.data(), labels.size() * sizeof(BytecodeLabel));
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing" << std::endl;
+        return false;
+    }
+    file.write(image.data(), image.size());
+    return file.good();
+}
@@ -0,0 +1,257 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Decoded stack machine opcodes */
+/* Overloads taking a parameter get their own opcode so no parameter checks are needed at run time */
+/* Values are stored in .vsmb files: only append new opcodes, and bump VSMB_VERSION if an existing one changes */
+enum class Op : uint16_t {
+    NOP, // Labels and blank lines
+    CALL, CALL_I, RET, RETV, // Call and return
+    PUSH, PUSH_I, PUSH_F, POP, // Add, remove from stack top
+    DUP, // Duplicate
+    LOAD, SAVE, STORE, // Memory access
+    ADD, SUB, MUL, DIV, REM, // Arithmetic
+    EQ, NE, LE, GE, LT, GT, // Comparisons
+    BRT, BRT_I, BRZ, BRZ_I, JUMP, JUMP_I, // Branching
+    PRINT, PRINT_S, READ, READF, // IO operations
+    END, // End program
+    INT, FLOAT, // Type conversion operations
+    LOADL, STOREL, ADDLL, // Superinstructions for frame access: PUSH(k);LOAD(), PUSH(k);STORE(), and two LOADLs and an ADD
+    IADD, ISUB, IMUL, IDIV, FADD, FSUB, FMUL, FDIV, // Arithmetic on operands the compiler knows are ints or floats
+    IEQ, INE, ILE, IGE, ILT, IGT, FEQ, FNE, FLE, FGE, FLT, FGT, // Comparisons on operands of a known type
+    CALL_N, RET_N, RETV_N, // Call and return with the callee's number of parameters in the instruction instead of on the stack
+    TAILCALL, // Call in tail position: the callee takes over the current frame and returns straight to its caller
+    VADDS, VSUBS, VMULS, VDIVS, VREMS, // Whole-array arithmetic with a scalar popped from the stack
+    VADDV, VSUBV, VMULV, VDIVV, VREMV, // Whole-array arithmetic on two arrays, element by element
+    VMAP, // Whole-array expression over any number of arrays and scalars, worked out in one pass
+    VSUM, VMIN, VMAX, VDOT, // Reductions of whole arrays to one value, pushed on the stack
+    HALLOC, HFREE, HLOAD, HSTORE, // Heap arrays: allocate, free, and LOAD and STORE with an element index
+    VREAD, VPRINT, // Input and output of whole arrays
+    OP_COUNT // Number of opcodes, not an instruction
+};
+
+/* Instruction after load-time decoding */
+/* Same layout in memory and in .vsmb files, so a mapped file is executed in place */
+struct DecodedInstruction {
+    Op op;
+    uint16_t aux; // Superinstructions formed by the loader: number of following instructions they cover; CALL_N and TAILCALL: numbers of parameters; 0 otherwise
+    union {
+        int32_t iArg; // Integer immediate, resolved label address, string pool index, or constant pool index of an operand record
+        float fArg; // Float immediate
+    };
+};
+static_assert(sizeof(DecodedInstruction) == 8, "DecodedInstruction is part of the .vsmb format");
+
+/* ADDLL packs both frame offsets into iArg, so each must fit in 16 bits */
+const int32_t ADDLL_MAX_OFFSET = 0xFFFF;
+
+/* Returns first frame offset of an ADDLL */
+inline int32_t addllFirst(int32_t iArg) { return iArg & 0xFFFF; }
+
+/* Returns second frame offset of an ADDLL */
+inline int32_t addllSecond(int32_t iArg) { return (int32_t) ((uint32_t) iArg >> 16); }
+
+/* CALL_N keeps the number of parameters in aux */
+const int32_t CALL_MAX_PARAMS = 0xFFFF;
+
+/* TAILCALL packs the callee's number of parameters and that of the function whose frame it takes over into aux */
+const int32_t TAILCALL_MAX_PARAMS = 0xFF;
+
+/* Returns the callee's number of parameters of a TAILCALL */
+inline int32_t tailCallParams(uint16_t aux) { return aux & 0xFF; }
+
+/* Returns number of parameters of the frame a TAILCALL replaces */
+inline int32_t tailCallFrameParams(uint16_t aux) { return aux >> 8; }
+
+/* Vector instructions keep their operands in a record of VECTOR_RECORD_SIZE constants; iArg is the index of the first */
+/* Array operands are frame offsets, like those of LOADL, or heapArrayOperand() of a heap array's handle slot. */
+/* The S forms have no second array and leave VECTOR_SRC2 at 0 */
+/* Text form: VMULS(dst,src,length,flags) and VMULV(dst,src,src2,length,flags) */
+const int32_t VECTOR_DST = 0;
+const int32_t VECTOR_SRC = 1;
+const int32_t VECTOR_SRC2 = 2;
+const int32_t VECTOR_LENGTH = 3; // Number of elements
+const int32_t VECTOR_FLAGS = 4;
+const int32_t VECTOR_RECORD_SIZE = 5;
+
+/* VECTOR_FLAGS bits */
+const int32_t VECTOR_FLOAT_RESULT = 1; // Results are stored as floats rather than ints
+const int32_t VECTOR_FLAGS_MASK = VECTOR_FLOAT_RESULT;
+
+/* Returns true for the instructions that take a vector operand record */
+inline bool isVectorOp(Op op) { return op >= Op::VADDS && op <= Op::VREMV; }
+
+/* Returns true for the vector instructions that take a scalar from the stack instead of a second array */
+inline bool isVectorScalarOp(Op op) { return op >= Op::VADDS && op <= Op::VREMS; }
+
+/* VMAP keeps its operands in a record of VMAP_HEADER_SIZE constants followed by its steps, two constants each */
+/* The steps are the expression in postfix order: an array element, a scalar or an operation on the two values */
+/* before it. Scalars are popped from the stack; scalar 0 is the one pushed first */
+/* Text form: VMAP(dst,length,flags,kind,value,kind,value,...) */
+const int32_t VMAP_DST = 0;
+const int32_t VMAP_LENGTH = 1; // Number of elements
+const int32_t VMAP_FLAGS = 2; // VECTOR_FLAGS bits
+const int32_t VMAP_STEP_COUNT = 3;
+const int32_t VMAP_SCALAR_COUNT = 4; // Number of scalar steps, the values popped
+const int32_t VMAP_HEADER_SIZE = 5;
+
+/* VMAP step kinds */
+const int32_t VMAP_ARRAY = 0; // value: array operand, as in a vector record
+const int32_t VMAP_SCALAR = 1; // value: which scalar
+const int32_t VMAP_OP = 2; // value: 0 ADD, 1 SUB, 2 MUL, 3 DIV or 4 REM, in the order of VADDS to VREMS
+
+/* Most values a VMAP expression holds at once, which bounds its working storage */
+const int32_t VMAP_MAX_DEPTH = 16;
+
+/* Returns true if record, with available constants from its start, is a VMAP record whose steps */
+/* form one expression within VMAP_MAX_DEPTH */
+bool isValidVectorMap(const int32_t* record, uint32_t available);
+
+/* Reductions keep their operands in a record of REDUCE_RECORD_SIZE constants. Only VDOT uses REDUCE_SRC2 */
+/* The result is an int when every element is an int and a float otherwise; an empty array gives int 0 */
+/* Float sums are added up in blocks of REDUCE_BLOCK elements, and the sums of the blocks are then added in order */
+/* Each block goes to REDUCE_LANES interleaved partial sums, element i of the block to lane i % REDUCE_LANES, */
+/* and the lanes are added pairwise, ((0+1)+(2+3))+((4+5)+(6+7)). Every back end keeps this order and */
+/* threads only ever split an array between blocks, so a float result does not depend on which back end */
+/* or how many threads ran the program */
+/* Text form: VSUM(src,length) and VDOT(src,src2,length) */
+const int32_t REDUCE_SRC = 0;
+const int32_t REDUCE_SRC2 = 1;
+const int32_t REDUCE_LENGTH = 2; // Number of elements
+const int32_t REDUCE_RECORD_SIZE = 3;
+const int32_t REDUCE_LANES = 8;
+const int32_t REDUCE_BLOCK = 4096;
+
+/* Returns true for the reductions */
+inline bool isReduceOp(Op op) { return op >= Op::VSUM && op <= Op::VDOT; }
+
+/* Arrays of HEAP_ARRAY_MIN_ELEMENTS or more live in the heap, a segment of memory apart from the stack. */
+/* The frame holds only a handle, the heap index of the first element, in the slot the array would start at */
+/* HALLOC(slot,length) allocates length elements on top of the heap and stores the handle in frame slot */
+/* slot; it does not clear them. HFREE(slot) frees the array whose handle is in frame slot, and every heap */
+/* array allocated after it. HLOAD(slot,length) and HSTORE(slot,length) are LOAD() and STORE() with an */
+/* element index into the heap array whose handle is in frame slot; an index outside 0 to length - 1 is an error */
+/* HALLOC, HLOAD and HSTORE keep their operands in a record of HEAP_RECORD_SIZE constants */
+const int32_t HEAP_ARRAY_MIN_ELEMENTS = 256;
+const int32_t HEAP_SLOT = 0;
+const int32_t HEAP_LENGTH = 1; // Number of elements
+const int32_t HEAP_RECORD_SIZE = 2;
+
+/* Returns the array operand of the heap array whose handle is in frame slot */
+inline int32_t heapArrayOperand(int32_t slot) { return -1 - slot; }
+
+/* Returns true if an array operand is a heap array */
+inline bool isHeapArrayOperand(int32_t operand) { return operand < 0; }
+
+/* Returns the frame slot holding the handle of a heap array operand */
+inline int32_t heapArraySlot(int32_t operand) { return -1 - operand; }
+
+/* VREAD and VPRINT keep their operands in a record of ARRAY_IO_RECORD_SIZE constants. VREAD reads */
+/* length numbers into an array, as READ does or as READF does when ARRAY_IO_FLAGS has VECTOR_FLOAT_RESULT; */
+/* VPRINT prints every element on a line of its own, as PRINT does, and leaves the stack as it is */
+/* Text form: VREAD(dst,length,flags) and VPRINT(src,length) */
+const int32_t ARRAY_IO_ARRAY = 0; // Array operand, as in a vector record
+const int32_t ARRAY_IO_LENGTH = 1; // Number of elements
+const int32_t ARRAY_IO_FLAGS = 2; // VECTOR_FLAGS bits; VPRINT leaves it at 0
+const int32_t ARRAY_IO_RECORD_SIZE = 3;
+
+/* Label table entry: string pool index of the name and the instruction it marks */
+struct BytecodeLabel {
+    uint32_t name;
+    int32_t address;
+};
+
+/* .vsmb file layout: header, then the sections at the offsets it records */
+/* All offsets are in bytes from the start of the file and are 8-byte aligned */
+const char VSMB_MAGIC[4] = {'V', 'S', 'M', 'B'};
+const uint32_t VSMB_VERSION = 1;
+
+struct BytecodeHeader {
+    char magic[4]; // VSMB_MAGIC
+    uint32_t version; // VSMB_VERSION
+    uint32_t fileSize; // Total size in bytes, checked when loading
+    uint32_t codeCount; // Number of DecodedInstruction entries
+    uint32_t codeOffset;
+    uint32_t constantCount; // Number of int32 constants
+    uint32_t constantOffset;
+    uint32_t stringCount; // Number of strings; stringCount + 1 uint32 offsets into the string data
+    uint32_t stringOffsetsOffset;
+    uint32_t stringDataSize; // Bytes of NUL-terminated string data
+    uint32_t stringDataOffset;
+    uint32_t labelCount; // Number of BytecodeLabel entries
+    uint32_t labelOffset;
+    uint32_t reserved[3];
+};
+static_assert(sizeof(BytecodeHeader) == 64, "BytecodeHeader is part of the .vsmb format");
+
+/* Read-only view of a program: points into a Bytecode object or into a mapped .vsmb file */
+struct BytecodeView {
+    const DecodedInstruction* code;
+    uint32_t codeCount;
+    const int32_t* constants; // Operand records for instructions with more than one immediate
+    uint32_t constantCount;
+    const uint32_t* stringOffsets; // String i is stringData + stringOffsets[i]
+    const char* stringData;
+    uint32_t stringCount;
+    const BytecodeLabel* labels;
+    uint32_t labelCount;
+
+    /* Returns string i from the string pool */
+    const char* string(uint32_t i) const { return stringData + stringOffsets[i]; }
+
+    /* Returns length of string i from the string pool */
+    uint32_t stringLength(uint32_t i) const { return stringOffsets[i + 1] - stringOffsets[i] - 1; }
+
+    /* Returns name of the first label at address, nullptr if there is none */
+    const char* labelAt(int32_t address) const;
+
+    /* Returns the instruction as stack machine text, e.g. PUSH(3); or CALL("gcd"); */
+    std::string disassemble(uint32_t index) const;
+};
+
+/* Program decoded from stack machine text; owns its storage */
+class Bytecode {
+public:
+    std::vector<DecodedInstruction> code;
+    std::vector<int32_t> constants;
+    std::vector<uint32_t> stringOffsets;
+    std::vector<char> stringData;
+    std::vector<BytecodeLabel> labels;
+
+    Bytecode();
+
+    /* Decodes stack machine text, one instruction or label per line */
+    /* Labels are resolved to addresses; prints an error and returns false on an invalid line or undefined label */
+    bool assemble(const std::vector<std::string>& lines);
+
+    /* Writes the program as a .vsmb file, returns false if the file could not be written */
+    bool writeFile(const std::string& filename) const;
+
+    /* Replaces PUSH(k);LOAD(), PUSH(k);STORE() and PUSH(k);LOAD();PUSH(j);LOAD();ADD() with superinstructions */
+    /* The first instruction of a match is replaced and records how many it covers; the rest stay */
+    /* in place, so jumps into the middle of a match and instruction numbers are unaffected */
+    void formSuperinstructions();
+
+    /* Returns a view over this object's storage; invalidated when the object changes */
+    BytecodeView view() const;
+
+private:
+    /* Adds a string to the pool, returns its index */
+    uint32_t addString(const std::string& s);
+
+    /* Adds the operand record of vector instruction name to the constant pool and points decoded at it */
+    /* values are the instruction's parameters in text order; returns false if they do not fit the instruction */
+    bool addVectorRecord(const std::string& name, const std::vector<int32_t>& values, DecodedInstruction& decoded);
+
+    /* Parses one line into its decoded form, recording labels and label references */
+    bool parseLine(std::string line, int index, std::vector<std::pair<int, std::string>>& fixups);
+};
+
+/* Returns the stack machine name of an opcode */
+const char* getOpName(Op op);
+
+#endif // BYTECODE_H
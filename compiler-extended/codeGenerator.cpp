@@ -1,13 +1,19 @@
 #include "codeGenerator.h"
+#include "bytecode.h"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cstring>
+#include <cstdint>
 
 // Code generator constructor
 CodeGenerator::CodeGenerator(SymbolTable& st) : 
     symbolTable(st), 
     labelCounter(0), 
-    localVarCount(0) {}
+    localVarCount(0),
+    currentReturnType(ValueType::UNKNOWN),
+    currentParamCount(0) {}
 
 // Generating labels
 std::string CodeGenerator::generateLabel() {
@@ -41,11 +47,56 @@ std::string CodeGenerator::getOpString(OpCode op) const {
         case OpCode::CALL: return "CALL";
         case OpCode::RET: return "RET";
         case OpCode::RETV: return "RETV";
+        case OpCode::TAILCALL: return "TAILCALL";
         case OpCode::PRINT: return "PRINT";
         case OpCode::READ: return "READ";
         case OpCode::READF: return "READF";
         case OpCode::INT: return "INT";
         case OpCode::FLOAT: return "FLOAT";
+        case OpCode::LOADL: return "LOADL";
+        case OpCode::STOREL: return "STOREL";
+        case OpCode::ADDLL: return "ADDLL";
+        case OpCode::IADD: return "IADD";
+        case OpCode::ISUB: return "ISUB";
+        case OpCode::IMUL: return "IMUL";
+        case OpCode::IDIV: return "IDIV";
+        case OpCode::FADD: return "FADD";
+        case OpCode::FSUB: return "FSUB";
+        case OpCode::FMUL: return "FMUL";
+        case OpCode::FDIV: return "FDIV";
+        case OpCode::IEQ: return "IEQ";
+        case OpCode::INE: return "INE";
+        case OpCode::ILE: return "ILE";
+        case OpCode::IGE: return "IGE";
+        case OpCode::ILT: return "ILT";
+        case OpCode::IGT: return "IGT";
+        case OpCode::FEQ: return "FEQ";
+        case OpCode::FNE: return "FNE";
+        case OpCode::FLE: return "FLE";
+        case OpCode::FGE: return "FGE";
+        case OpCode::FLT: return "FLT";
+        case OpCode::FGT: return "FGT";
+        case OpCode::VADDS: return "VADDS";
+        case OpCode::VSUBS: return "VSUBS";
+        case OpCode::VMULS: return "VMULS";
+        case OpCode::VDIVS: return "VDIVS";
+        case OpCode::VREMS: return "VREMS";
+        case OpCode::VADDV: return "VADDV";
+        case OpCode::VSUBV: return "VSUBV";
+        case OpCode::VMULV: return "VMULV";
+        case OpCode::VDIVV: return "VDIVV";
+        case OpCode::VREMV: return "VREMV";
+        case OpCode::VMAP: return "VMAP";
+        case OpCode::VSUM: return "VSUM";
+        case OpCode::VMIN: return "VMIN";
+        case OpCode::VMAX: return "VMAX";
+        case OpCode::VDOT: return "VDOT";
+        case OpCode::HALLOC: return "HALLOC";
+        case OpCode::HFREE: return "HFREE";
+        case OpCode::HLOAD: return "HLOAD";
+        case OpCode::HSTORE: return "HSTORE";
+        case OpCode::VREAD: return "VREAD";
+        case OpCode::VPRINT: return "VPRINT";
         case OpCode::END: return "END";
         default: return "UNKNOWN"; // Should never run
     }
@@ -60,6 +111,7 @@ void CodeGenerator::addVariableToFrame(const std::string& varName, bool isArray,
         info.isArray = isArray;
         info.arraySize = arraySize;
         info.isFloat = isFloat;
+        info.onHeap = isArray && arraySize >= HEAP_ARRAY_MIN_ELEMENTS;
         
         // Store the parameter name and its information
         frameVariables[varName] = info;
@@ -70,7 +122,10 @@ void CodeGenerator::addVariableToFrame(const std::string& varName, bool isArray,
         //           << ", offset: " << info.stackOffset << std::endl;
         
         // Increment localVarCount based on variable size
-        if (isArray) {
+        if (info.onHeap) {
+            localVarCount += 1; // The frame only holds the handle of a heap array
+            heapArrays.push_back(info);
+        } else if (isArray) {
             localVarCount += arraySize; // Each array element gets its own offset
         } else {
             localVarCount += 1; // Scalar variable only needs one slot
@@ -78,6 +133,207 @@ void CodeGenerator::addVariableToFrame(const std::string& varName, bool isArray,
     }
 }
 
+// Emits a load of a frame slot: LOADL(k) instead of PUSH(k); LOAD();
+void CodeGenerator::emitLoadLocal(int offset) {
+    instructions.push_back(Instruction(OpCode::LOADL, std::to_string(offset)));
+}
+
+// Emits a store to a frame slot: STOREL(k) instead of PUSH(k); STORE();
+void CodeGenerator::emitStoreLocal(int offset) {
+    instructions.push_back(Instruction(OpCode::STOREL, std::to_string(offset)));
+}
+
+// Returns the frame offset of an array, or the operand that names a heap array by the slot of its handle
+int CodeGenerator::arrayOperand(const VariableInfo& info) {
+    return info.onHeap ? heapArrayOperand(info.stackOffset) : info.stackOffset;
+}
+
+// Returns the operands of HLOAD and HSTORE for a heap array
+std::string CodeGenerator::heapRecord(const VariableInfo& info) {
+    return std::to_string(info.stackOffset) + "," + std::to_string(info.arraySize);
+}
+
+// Emits a store of the value on top of stack to an element of an array
+void CodeGenerator::emitStoreElement(const VariableInfo& info, int index) {
+    if (!info.onHeap) {
+        emitStoreLocal(info.stackOffset + index);
+        return;
+    }
+    instructions.push_back(Instruction(OpCode::PUSH, std::to_string(index)));
+    instructions.push_back(Instruction(OpCode::HSTORE, heapRecord(info)));
+}
+
+// Emits code setting every element of an array to 0 of its type
+void CodeGenerator::emitZeroFill(const VariableInfo& info) {
+    if (info.onHeap) {
+        // A VMAP of a single scalar stores it in every element, converted to the array's type
+        instructions.push_back(Instruction(OpCode::PUSH, "0"));
+        instructions.push_back(Instruction(OpCode::VMAP, std::to_string(arrayOperand(info)) + "," + std::to_string(info.arraySize) + ","
+                                           + (info.isFloat ? "1" : "0") + "," + std::to_string(VMAP_SCALAR) + ",0"));
+        return;
+    }
+    for (int i = 0; i < info.arraySize; i++) {
+        instructions.push_back(Instruction(OpCode::PUSH, "0"));
+        if (info.isFloat) {
+            instructions.push_back(Instruction(OpCode::FLOAT));
+        }
+        emitStoreLocal(info.stackOffset + i);
+    }
+}
+
+// Emits an ADD for operands of the given type, folding LOADL(k); LOADL(j); ADD(); into ADDLL(k,j);
+void CodeGenerator::emitAdd(ValueType type) {
+    size_t n = instructions.size();
+    if (n >= 2 && instructions[n - 2].op == OpCode::LOADL && instructions[n - 1].op == OpCode::LOADL) {
+        int first = std::stoi(instructions[n - 2].arg);
+        int second = std::stoi(instructions[n - 1].arg);
+        if (first <= ADDLL_MAX_OFFSET && second <= ADDLL_MAX_OFFSET) { // Offsets are packed into 16 bits
+            instructions.pop_back();
+            instructions.back() = Instruction(OpCode::ADDLL, std::to_string(first) + "," + std::to_string(second));
+            return;
+        }
+    }
+    emitTypedOp(OpCode::ADD, type);
+}
+
+// Emits a conversion of the top of stack from one type to another, nothing if they already match
+void CodeGenerator::emitConversion(ValueType from, ValueType to) {
+    if (from == to || to == ValueType::UNKNOWN) return;
+    instructions.push_back(Instruction(to == ValueType::FLOAT ? OpCode::FLOAT : OpCode::INT));
+}
+
+// Emits the typed version of a generic arithmetic or comparison opcode
+// Both operands must already have the given type; UNKNOWN keeps the generic opcode
+void CodeGenerator::emitTypedOp(OpCode op, ValueType type) {
+    if (type != ValueType::UNKNOWN) {
+        bool f = type == ValueType::FLOAT;
+        switch (op) {
+            case OpCode::ADD: op = f ? OpCode::FADD : OpCode::IADD; break;
+            case OpCode::SUB: op = f ? OpCode::FSUB : OpCode::ISUB; break;
+            case OpCode::MUL: op = f ? OpCode::FMUL : OpCode::IMUL; break;
+            case OpCode::DIV: op = f ? OpCode::FDIV : OpCode::IDIV; break;
+            case OpCode::EQ: op = f ? OpCode::FEQ : OpCode::IEQ; break;
+            case OpCode::NE: op = f ? OpCode::FNE : OpCode::INE; break;
+            case OpCode::LE: op = f ? OpCode::FLE : OpCode::ILE; break;
+            case OpCode::GE: op = f ? OpCode::FGE : OpCode::IGE; break;
+            case OpCode::LT: op = f ? OpCode::FLT : OpCode::ILT; break;
+            case OpCode::GT: op = f ? OpCode::FGT : OpCode::IGT; break;
+            default: break; // REM has no typed version
+        }
+    }
+    instructions.push_back(Instruction(op));
+}
+
+// Returns the type of an arithmetic result: float if either side is, unknown if either side is
+ValueType CodeGenerator::combineTypes(ValueType left, ValueType right) {
+    if (left == ValueType::UNKNOWN || right == ValueType::UNKNOWN) return ValueType::UNKNOWN;
+    if (left == ValueType::FLOAT || right == ValueType::FLOAT) return ValueType::FLOAT;
+    return ValueType::INT;
+}
+
+// Returns the declared type of a variable in the current frame
+// Array parameters and unknown names are UNKNOWN
+ValueType CodeGenerator::getVariableType(const std::string& varName) {
+    auto it = frameVariables.find(varName);
+    if (it == frameVariables.end() || (it->second.isArray && it->second.arraySize <= 0)) {
+        return ValueType::UNKNOWN;
+    }
+    return it->second.isFloat ? ValueType::FLOAT : ValueType::INT;
+}
+
+// Type inference, following the same rules as the generate functions below
+// Variables always hold their declared type because assignments, arguments and returns convert to it
+ValueType CodeGenerator::getExpressionType(ASTNode* node) {
+    if (!node) return ValueType::UNKNOWN;
+
+    switch (node->type) {
+        case ASTNodeType::EXPRESSION:
+            // Assignments leave nothing on the stack
+            if (node->children->size() == 1) return getExpressionType(node->children->at(0));
+            return ValueType::UNKNOWN;
+        case ASTNodeType::SIMPLE_EXPRESSION:
+            if (node->children->empty()) return ValueType::UNKNOWN;
+            if (node->children->size() >= 3) return ValueType::INT; // Comparisons give 0 or 1
+            return getExpressionType(node->children->at(0));
+        case ASTNodeType::ADDITIVE_EXPR:
+        case ASTNodeType::TERM: {
+            if (node->children->empty()) return ValueType::UNKNOWN;
+            ValueType type = getExpressionType(node->children->at(0));
+            for (size_t i = 2; i < node->children->size(); i += 2) {
+                if (node->children->at(i - 1)->tokenType == TokenType::MOD) {
+                    type = ValueType::INT; // REM truncates both operands
+                } else {
+                    type = combineTypes(type, getExpressionType(node->children->at(i)));
+                }
+            }
+            return type;
+        }
+        case ASTNodeType::FACTOR:
+            if (node->children->empty()) {
+                if (node->tokenType == NUM) return ValueType::INT;
+                if (node->tokenType == FLOAT_VAL) return ValueType::FLOAT;
+                return ValueType::UNKNOWN;
+            }
+            if (node->children->at(0)->tokenType == NUM && node->children->at(0)->children->empty()) return ValueType::INT;
+            if (node->children->at(0)->tokenType == FLOAT_VAL && node->children->at(0)->children->empty()) return ValueType::FLOAT;
+            return getExpressionType(node->children->at(0));
+        case ASTNodeType::VAR:
+            return getVariableType(node->tokenValue);
+        case ASTNodeType::CALL: {
+            if (isBuiltinCall(node)) {
+                // Float if any array it reads holds floats
+                ValueType type = ValueType::INT;
+                for (ASTNode* arg : *node->children->at(0)->children->at(0)->children) {
+                    ASTNode* var = findBareVar(arg);
+                    if (var && isVariableFloat(var->tokenValue)) type = ValueType::FLOAT;
+                }
+                return type;
+            }
+            auto it = functions.find(node->tokenValue);
+            return it == functions.end() ? ValueType::UNKNOWN : it->second.returnType;
+        }
+        case ASTNodeType::INPUT_STMT: {
+            // Same choice of READ or READF as generateInputStmt
+            if (node->children->size() > 1 && node->children->at(1)->type == ASTNodeType::VAR) {
+                Symbol* varSymbol = symbolTable.findSymbol(node->children->at(1)->tokenValue);
+                if (varSymbol && varSymbol->dataType == "float") return ValueType::FLOAT;
+            }
+            return ValueType::INT;
+        }
+        default:
+            return ValueType::UNKNOWN;
+    }
+}
+
+// Records return and parameter types of every function declaration under node
+void CodeGenerator::collectFunctions(ASTNode* node) {
+    if (!node) return;
+    if (node->type != ASTNodeType::FUN_DECLARATION) {
+        for (ASTNode* child : *node->children) {
+            collectFunctions(child);
+        }
+        return;
+    }
+
+    FunctionInfo info;
+    ASTNode* typeSpec = node->children->empty() ? nullptr : node->children->at(0);
+    if (!typeSpec || typeSpec->tokenType == VOID) {
+        info.returnType = ValueType::UNKNOWN;
+    } else {
+        info.returnType = typeSpec->isFloat ? ValueType::FLOAT : ValueType::INT;
+    }
+
+    // params -> param-list -> param, each with its type specifier as first child
+    if (node->children->size() >= 2 && !node->children->at(1)->children->empty()) {
+        for (ASTNode* param : *node->children->at(1)->children->at(0)->children) {
+            bool isArray = param->children->size() > 1;
+            bool isFloat = !param->children->empty() && param->children->at(0)->isFloat;
+            info.paramTypes.push_back(isArray ? ValueType::UNKNOWN : (isFloat ? ValueType::FLOAT : ValueType::INT));
+        }
+    }
+    functions[node->tokenValue] = info;
+}
+
 // Helper function to get a variable's offset in the current frame
 int CodeGenerator::getVariableOffset(const std::string& varName) {
     auto it = frameVariables.find(varName);
@@ -109,6 +365,7 @@ bool CodeGenerator::isVariableFloat(const std::string& varName) {
 // Clear all variables at the end of a function
 void CodeGenerator::clearFrameVariables() {
     frameVariables.clear();
+    heapArrays.clear();
     localVarCount = 0;
 }
 
@@ -130,6 +387,9 @@ void CodeGenerator::generate(ASTNode* root) {
 void CodeGenerator::generateProgram(ASTNode* node) {
     if (!node) return;
 
+    // Knowing every signature first lets calls convert arguments to the callee's parameter types
+    collectFunctions(node);
+
     // Add a jump to the main function at the start of the program
     instructions.push_back(Instruction(OpCode::JUMP, "main"));
     
@@ -205,17 +465,7 @@ void CodeGenerator::generateVarDeclaration(ASTNode* node) {
     // Initialize variable(s)
     if (isArray && arraySize > 0) {
         // For arrays, initialize each element with 0
-        for (int i = 0; i < arraySize; i++) {
-            instructions.push_back(Instruction(OpCode::PUSH, "0"));
-            if (isFloat) {
-                instructions.push_back(Instruction(OpCode::FLOAT));
-            }
-            
-            // Calculate the array element offset
-            int elementOffset = getVariableOffset(varName) + i;
-            instructions.push_back(Instruction(OpCode::PUSH, std::to_string(elementOffset)));
-            instructions.push_back(Instruction(OpCode::STORE));
-        }
+        emitZeroFill(frameVariables[varName]);
     } else {
         // For scalar variables, initialize with 0
         instructions.push_back(Instruction(OpCode::PUSH, "0"));
@@ -224,8 +474,7 @@ void CodeGenerator::generateVarDeclaration(ASTNode* node) {
         }
         
         // Store the initialization value
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(getVariableOffset(varName))));
-        instructions.push_back(Instruction(OpCode::STORE));
+        emitStoreLocal(getVariableOffset(varName));
     }
 }
 
@@ -245,21 +494,49 @@ void CodeGenerator::generateFunDeclaration(ASTNode* node) {
     symbolTable.enterScope(); // Enter a new scope for the function
     
     std::string funcName = node->tokenValue;
+    currentFunction = funcName;
+    currentReturnType = functions.count(funcName) ? functions[funcName].returnType : ValueType::UNKNOWN;
     
     // Add function label (lowercase for consistency with stack machine)
     instructions.push_back(Instruction(OpCode::LABEL, funcName.size() > 0 ? funcName : "unknown_function"));
+    size_t entry = instructions.size();
     
     // Process parameters
     if (node->children->size() >= 2) {
         generateParams(node->children->at(1));
     }
+
+    // Locals start after the frame header CALL places above the parameters; main is not called, so it has none
+    currentParamCount = functions.count(funcName) ? (int) functions[funcName].paramTypes.size() : localVarCount;
+    if (funcName != "main") {
+        localVarCount = currentParamCount + FRAME_HEADER_SIZE;
+    }
     
     // Process function body
     generateCompoundStmt(node->children->at(2));
     
     // Adding return instruction if not previously included
-    if (funcName != "main" && instructions.back().op != OpCode::RET && instructions.back().op != OpCode::RETV) {
-        instructions.push_back(Instruction(OpCode::RET));
+    if (funcName != "main" && instructions.back().op != OpCode::RET && instructions.back().op != OpCode::RETV
+        && instructions.back().op != OpCode::TAILCALL) {
+        instructions.push_back(Instruction(OpCode::RET, "", currentParamCount));
+    }
+
+    // Heap arrays are allocated on entry, so one declared inside a loop is allocated once, and freed before
+    // every return: freeing the first frees the rest. Branches go to labels, so inserting code moves none
+    if (!heapArrays.empty()) {
+        Instruction release(OpCode::HFREE, std::to_string(heapArrays[0].stackOffset));
+        for (size_t i = entry; i < instructions.size(); i++) {
+            OpCode op = instructions[i].op;
+            if (op == OpCode::RET || op == OpCode::RETV || op == OpCode::TAILCALL) {
+                instructions.insert(instructions.begin() + i, release);
+                i++;
+            }
+        }
+        std::vector<Instruction> allocations;
+        for (const VariableInfo& info : heapArrays) {
+            allocations.push_back(Instruction(OpCode::HALLOC, std::to_string(info.stackOffset) + "," + std::to_string(info.arraySize)));
+        }
+        instructions.insert(instructions.begin() + entry, allocations.begin(), allocations.end());
     }
 
     symbolTable.exitScope(); // Exit the function scope
@@ -304,8 +581,8 @@ void CodeGenerator::generateParam(ASTNode* node) {
     }
 
     // Check if this is a float parameter
-    bool isFloat = node->isFloat;
-    bool isFLoat = isVariableFloat(paramName);
+    // The type is recorded on the type specifier child, not on the param node
+    bool isFloat = !node->children->empty() && node->children->at(0)->isFloat;
     
     // Add parameter to frame tracking
     addVariableToFrame(paramName, isArray, isArray ? 0 : -1, isFloat);
@@ -394,9 +671,22 @@ void CodeGenerator::generateIOStmt(ASTNode* node) {
     }
 }
 
-// Rule 15: input-stmt := input ( STRING ) ;
+// Rule 15: input-stmt := input ( STRING ) ; | input ( ID ) ;
 void CodeGenerator::generateInputStmt(ASTNode* node) {
     if (!node || node->children->empty()) return;
+
+    // Reading a whole array takes one VREAD
+    if (node->children->at(0)->type == ASTNodeType::VAR) {
+        std::string varName = node->children->at(0)->tokenValue;
+        auto it = frameVariables.find(varName);
+        if (it == frameVariables.end()) {
+            std::cerr << "Error: Variable '" << varName << "' not found in frame" << std::endl;
+            return;
+        }
+        const VariableInfo& info = it->second;
+        instructions.push_back(Instruction(OpCode::VREAD, std::to_string(arrayOperand(info)) + "," + std::to_string(info.arraySize) + "," + (info.isFloat ? "1" : "0")));
+        return;
+    }
     
     // Get the string prompt if available
     if (node->children->at(0)->type == ASTNodeType::FACTOR) {
@@ -427,9 +717,14 @@ void CodeGenerator::generateOutputStmt(ASTNode* node) {
     
     ASTNode* outExpr = node->children->at(0);
     
+    ASTNode* wholeArray = findBareVar(outExpr);
+    auto arrayIt = wholeArray ? frameVariables.find(wholeArray->tokenValue) : frameVariables.end();
     if (outExpr->type == ASTNodeType::FACTOR && outExpr->tokenType == STRING) {
         // Push the string literal
         instructions.push_back(Instruction(OpCode::PRINT, outExpr->tokenValue));
+    } else if (arrayIt != frameVariables.end() && arrayIt->second.isArray) {
+        // Printing a whole array takes one VPRINT
+        instructions.push_back(Instruction(OpCode::VPRINT, std::to_string(arrayOperand(arrayIt->second)) + "," + std::to_string(arrayIt->second.arraySize)));
     } else {
         // Generate code for the expression
         generateExpression(outExpr);
@@ -517,22 +812,55 @@ void CodeGenerator::generateIterationStmt(ASTNode* node) {
     continueLabels.pop();
 }
 
+// Returns the call an expression consists of, nullptr if it is anything more than a call
+static ASTNode* findTailCall(ASTNode* node) {
+    while (node && node->type != ASTNodeType::CALL) {
+        switch (node->type) {
+            case ASTNodeType::EXPRESSION:
+            case ASTNodeType::SIMPLE_EXPRESSION:
+            case ASTNodeType::ADDITIVE_EXPR:
+            case ASTNodeType::TERM:
+            case ASTNodeType::FACTOR:
+                if (node->children->size() != 1) return nullptr;
+                node = node->children->at(0);
+                break;
+            default:
+                return nullptr;
+        }
+    }
+    return node && !node->children->empty() ? node : nullptr;
+}
+
 // Rule 20: return-stmt := return ; | return expression ;
 void CodeGenerator::generateReturnStmt(ASTNode* node) {
     if (!node) return;
     
+    // return f(...) reuses this frame for f, which then returns straight to this function's caller
+    // Only when f returns the same type, since no conversion can run after it; main has no frame to reuse
+    ASTNode* call = node->children->empty() ? nullptr : findTailCall(node->children->at(0));
+    if (call && !isBuiltinCall(call) && currentFunction != "main" && currentReturnType != ValueType::UNKNOWN
+        && getExpressionType(call) == currentReturnType && currentParamCount <= TAILCALL_MAX_PARAMS) {
+        int numParams = generateCallArguments(call);
+        if (numParams <= TAILCALL_MAX_PARAMS) {
+            instructions.push_back(Instruction(OpCode::TAILCALL, call->tokenValue, numParams, currentParamCount));
+        } else {
+            instructions.push_back(Instruction(OpCode::CALL, call->tokenValue, numParams));
+            instructions.push_back(Instruction(OpCode::RETV, "", currentParamCount));
+        }
+        return;
+    }
+
     // If there's a return value, generate code for it
     if (!node->children->empty()) {
         generateExpression(node->children->at(0));
         
-        // MISSING: Handling type conversion if needed
-        // Will be handled if function returns to a variable
-        // Only leads to incorrect results in case of output(function());
+        // Converting to the declared return type, so callers know the type of the result
+        emitConversion(getExpressionType(node->children->at(0)), currentReturnType);
         
-        instructions.push_back(Instruction(OpCode::RETV));
+        instructions.push_back(Instruction(OpCode::RETV, "", currentParamCount));
     } else {
         // Return without a value
-        instructions.push_back(Instruction(OpCode::RET));
+        instructions.push_back(Instruction(OpCode::RET, "", currentParamCount));
     }
 }
 
@@ -565,13 +893,8 @@ void CodeGenerator::generateExpression(ASTNode* node) {
             generateSimpleExpression(exprNode);
             
             // Handle type conversion if needed
-            if (isVarFloat) {
-                // If variable is float but expression might be int, convert to float
-                instructions.push_back(Instruction(OpCode::FLOAT));
-            } else {
-                // If variable is int but expression might be float, convert to int
-                instructions.push_back(Instruction(OpCode::INT));
-            }
+            // Skipped when the expression already has the variable's type
+            emitConversion(getExpressionType(exprNode), isVarFloat ? ValueType::FLOAT : ValueType::INT);
             
             // Store the result in the variable
             generateVar(varNode, true);  // true indicates store operation
@@ -605,6 +928,7 @@ void CodeGenerator::generateVar(ASTNode* node, bool isStore) {
     
     int varOffset = it->second.stackOffset;
     bool isArray = it->second.isArray;
+    bool onHeap = it->second.onHeap;
     
     // Check if this is an array access
     if (!node->children->empty() && node->children->at(0)->type == ASTNodeType::SIMPLE_EXPRESSION) {
@@ -620,6 +944,12 @@ void CodeGenerator::generateVar(ASTNode* node, bool isStore) {
         // Convert index to int if needed
         instructions.push_back(Instruction(OpCode::INT));
         
+        if (onHeap) {
+            // The index is checked against the array's length, and goes through the handle in the frame
+            instructions.push_back(Instruction(isStore ? OpCode::HSTORE : OpCode::HLOAD, heapRecord(it->second)));
+            return;
+        }
+
         // Add base offset of the array
         instructions.push_back(Instruction(OpCode::PUSH, std::to_string(varOffset)));
         instructions.push_back(Instruction(OpCode::ADD));
@@ -637,15 +967,19 @@ void CodeGenerator::generateVar(ASTNode* node, bool isStore) {
             // If this is an array but accessed without an index, use the base address
             std::cerr << "Warning: Array variable '" << varName << "' accessed without index" << std::endl;
         }
+        if (onHeap) {
+            // The frame slot holds the handle, so the first element is reached through it
+            instructions.push_back(Instruction(OpCode::PUSH, "0"));
+            instructions.push_back(Instruction(isStore ? OpCode::HSTORE : OpCode::HLOAD, heapRecord(it->second)));
+            return;
+        }
         
         if (isStore) {
             // Store operation - value is already on stack
-            instructions.push_back(Instruction(OpCode::PUSH, std::to_string(varOffset)));
-            instructions.push_back(Instruction(OpCode::STORE));
+            emitStoreLocal(varOffset);
         } else {
             // Load operation
-            instructions.push_back(Instruction(OpCode::PUSH, std::to_string(varOffset)));
-            instructions.push_back(Instruction(OpCode::LOAD));
+            emitLoadLocal(varOffset);
         }
     }
 }
@@ -662,24 +996,31 @@ void CodeGenerator::generateSimpleExpression(ASTNode* node) {
         ASTNode* relopNode = node->children->at(1);
         ASTNode* rightExpr = node->children->at(2);
         
+        // Both sides are compared as floats if either one is a float
+        ValueType leftType = getExpressionType(node->children->at(0));
+        ValueType rightType = getExpressionType(rightExpr);
+        ValueType type = combineTypes(leftType, rightType);
+        emitConversion(leftType, type);
+        
         // Generate code for the second additive expression
         generateAdditiveExpression(rightExpr);
+        emitConversion(rightType, type);
         
         // Apply the relational operator
         std::string relOp = relopNode->tokenValue;
         
         if (relOp == "<=" || relOp == "LE") {
-            instructions.push_back(Instruction(OpCode::LE));
+            emitTypedOp(OpCode::LE, type);
         } else if (relOp == "<" || relOp == "LT") {
-            instructions.push_back(Instruction(OpCode::LT));
+            emitTypedOp(OpCode::LT, type);
         } else if (relOp == ">" || relOp == "GT") {
-            instructions.push_back(Instruction(OpCode::GT));
+            emitTypedOp(OpCode::GT, type);
         } else if (relOp == ">=" || relOp == "GE") {
-            instructions.push_back(Instruction(OpCode::GE));
+            emitTypedOp(OpCode::GE, type);
         } else if (relOp == "==" || relOp == "EE") {
-            instructions.push_back(Instruction(OpCode::EQ));
+            emitTypedOp(OpCode::EQ, type);
         } else if (relOp == "!=" || relOp == "NE") {
-            instructions.push_back(Instruction(OpCode::NE));
+            emitTypedOp(OpCode::NE, type);
         }
     }
 }
@@ -693,6 +1034,7 @@ void CodeGenerator::generateAdditiveExpression(ASTNode* node) {
     
     // Generate code for the first term
     generateTerm(node->children->at(0));
+    ValueType leftType = getExpressionType(node->children->at(0));
     
     // Process additional terms with additive operators
     for (size_t i = 1; i < node->children->size(); i += 2) {
@@ -700,17 +1042,24 @@ void CodeGenerator::generateAdditiveExpression(ASTNode* node) {
             ASTNode* opNode = node->children->at(i);
             ASTNode* termNode = node->children->at(i + 1);
             
+            // An int operand is converted before a float operation, as the stack machine would
+            ValueType rightType = getExpressionType(termNode);
+            ValueType type = combineTypes(leftType, rightType);
+            emitConversion(leftType, type);
+            
             // Generate code for the term
             generateTerm(termNode);
+            emitConversion(rightType, type);
             
             // Apply the additive operator
             std::string addOp = opNode->tokenValue;
             
             if (addOp == "PLUS" || addOp == "+") {
-                instructions.push_back(Instruction(OpCode::ADD));
+                emitAdd(type);
             } else if (addOp == "MINUS" || addOp == "-") {
-                instructions.push_back(Instruction(OpCode::SUB));
+                emitTypedOp(OpCode::SUB, type);
             }
+            leftType = type;
         }
     }
 }
@@ -721,6 +1070,7 @@ void CodeGenerator::generateTerm(ASTNode* node) {
     
     // Generate code for the first factor
     generateFactor(node->children->at(0));
+    ValueType leftType = getExpressionType(node->children->at(0));
     
     // Process additional factors with multiplicative operators
     for (size_t i = 1; i < node->children->size(); i += 2) {
@@ -728,17 +1078,28 @@ void CodeGenerator::generateTerm(ASTNode* node) {
             ASTNode* opNode = node->children->at(i);
             ASTNode* factorNode = node->children->at(i + 1);
             
+            // An int operand is converted before a float operation, as the stack machine would
+            // REM truncates both operands itself, so they are left as they are
+            bool isRem = opNode->tokenType == TokenType::MOD;
+            ValueType rightType = getExpressionType(factorNode);
+            ValueType type = isRem ? ValueType::INT : combineTypes(leftType, rightType);
+            if (!isRem) emitConversion(leftType, type);
+            
             // Generate code for the factor
             generateFactor(factorNode);
+            if (!isRem) emitConversion(rightType, type);
             
             // Apply the multiplication operator
             std::string mulOp = opNode->tokenValue;
             
             if (mulOp == "TIMES" || mulOp == "*") {
-                instructions.push_back(Instruction(OpCode::MUL));
+                emitTypedOp(OpCode::MUL, type);
             } else if (mulOp == "DIVIDE" || mulOp == "/") {
-                instructions.push_back(Instruction(OpCode::DIV));
+                emitTypedOp(OpCode::DIV, type);
+            } else if (mulOp == "MOD" || mulOp == "%") {
+                instructions.push_back(Instruction(OpCode::REM));
             }           
+            leftType = type;
         }
     }
 }
@@ -801,28 +1162,83 @@ void CodeGenerator::generateFactor(ASTNode* node) {
 // Rule 30: call := ID ( args ) | ID ( )
 void CodeGenerator::generateCall(ASTNode* node) {
     if (!node || node->children->empty()) return;
+
+    if (isBuiltinCall(node)) {
+        generateBuiltinCall(node);
+        return;
+    }
     
+    int numParams = generateCallArguments(node);
+
+    // Call the function; the number of parameters is part of the instruction
+    instructions.push_back(Instruction(OpCode::CALL, node->tokenValue, numParams));
+}
+
+// Checks if a call is to a builtin; the parser has decided which calls are and checked their arguments
+bool CodeGenerator::isBuiltinCall(ASTNode* node) {
+    return node->type == ASTNodeType::CALL && node->isBuiltin;
+}
+
+// sum(x), min(x), max(x) and dot(x, y) reduce whole arrays of the frame to one value with a single instruction
+void CodeGenerator::generateBuiltinCall(ASTNode* node) {
+    std::string funcName = node->tokenValue;
+    std::vector<VariableInfo> arrays;
+    for (ASTNode* arg : *node->children->at(0)->children->at(0)->children) {
+        ASTNode* var = findBareVar(arg);
+        auto it = var ? frameVariables.find(var->tokenValue) : frameVariables.end();
+        if (it == frameVariables.end() || !it->second.isArray) {
+            std::cerr << "Error: Argument of '" << funcName << "' must be an array" << std::endl;
+            return;
+        }
+        arrays.push_back(it->second);
+    }
+
+    if (funcName == "dot") {
+        int length = std::min(arrays[0].arraySize, arrays[1].arraySize);
+        if (arrays[0].arraySize != arrays[1].arraySize) {
+            std::cerr << "Warning: 'dot' of arrays of different sizes only uses their first " << length << " elements" << std::endl;
+        }
+        instructions.push_back(Instruction(OpCode::VDOT, std::to_string(arrayOperand(arrays[0])) + "," + std::to_string(arrayOperand(arrays[1])) + "," + std::to_string(length)));
+        return;
+    }
+    OpCode op = funcName == "sum" ? OpCode::VSUM : funcName == "min" ? OpCode::VMIN : OpCode::VMAX;
+    instructions.push_back(Instruction(op, std::to_string(arrayOperand(arrays[0])) + "," + std::to_string(arrays[0].arraySize)));
+}
+
+// Pushes the arguments of a call, returns the callee's number of parameters
+int CodeGenerator::generateCallArguments(ASTNode* node) {
     // Getting function name and arguments
     std::string funcName = node->tokenValue;
     ASTNode* argsNode = node->children->at(0);
     
     // Count the number of arguments
     int numArgs = 0;
+    ASTNode* argListNode = nullptr;
     if (!argsNode->children->empty()) {
-        ASTNode* argListNode = argsNode->children->at(0);
+        argListNode = argsNode->children->at(0);
         numArgs = argListNode->children->size();
-        
-        // Push arguments in normal order (left to right)
-        for (int i = 0; i < numArgs; i++) {
+    }
+
+    // The callee finds its frame header right after its own parameters, so exactly that many values are passed
+    auto it = functions.find(funcName);
+    int numParams = it != functions.end() ? (int) it->second.paramTypes.size() : numArgs;
+    if (numArgs != numParams) {
+        std::cerr << "Warning: Function '" << funcName << "' takes " << numParams << " arguments but is called with " << numArgs << std::endl;
+    }
+
+    // Push arguments in normal order (left to right), converted to the parameter types
+    // Missing arguments are passed as 0, extra ones are not evaluated
+    for (int i = 0; i < numParams; i++) {
+        ValueType paramType = it != functions.end() ? it->second.paramTypes[i] : ValueType::UNKNOWN;
+        if (i < numArgs) {
             generateExpression(argListNode->children->at(i));
+            emitConversion(getExpressionType(argListNode->children->at(i)), paramType);
+        } else {
+            instructions.push_back(Instruction(OpCode::PUSH, "0"));
+            emitConversion(ValueType::INT, paramType);
         }
     }
-    
-    // Push the number of arguments
-    instructions.push_back(Instruction(OpCode::PUSH, std::to_string(numArgs)));
-    
-    // Call the function
-    instructions.push_back(Instruction(OpCode::CALL, funcName));
+    return numParams;
 }
 
 // Rule 31: args := arg-list | empty
@@ -846,22 +1262,15 @@ void CodeGenerator::generateArrayInitExpression(ASTNode* node, const std::string
         return;
     }
     
-    int baseOffset = it->second.stackOffset;
-    int arraySize = it->second.arraySize;
-    bool isFloat = it->second.isFloat;
+    VariableInfo info = it->second;
+    int arraySize = info.arraySize;
+    bool isFloat = info.isFloat;
     
     // Get array elements node
     ASTNode* elementsNode = node->children->at(0);
     if (!elementsNode || elementsNode->children->empty()) {
         // Empty initialization - set all to 0
-        for (int i = 0; i < arraySize; i++) {
-            instructions.push_back(Instruction(OpCode::PUSH, "0"));
-            if (isFloat) {
-                instructions.push_back(Instruction(OpCode::FLOAT));
-            }
-            instructions.push_back(Instruction(OpCode::PUSH, std::to_string(baseOffset + i)));
-            instructions.push_back(Instruction(OpCode::STORE));
-        }
+        emitZeroFill(info);
         return;
     }
     
@@ -877,8 +1286,7 @@ void CodeGenerator::generateArrayInitExpression(ASTNode* node, const std::string
         } else {
             instructions.push_back(Instruction(OpCode::INT));
         }
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(baseOffset + i)));
-        instructions.push_back(Instruction(OpCode::STORE));
+        emitStoreElement(info, (int) i);
     }
     
     // Initialize remaining elements with 0
@@ -887,8 +1295,7 @@ void CodeGenerator::generateArrayInitExpression(ASTNode* node, const std::string
         if (isFloat) {
             instructions.push_back(Instruction(OpCode::FLOAT));
         }
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(baseOffset + i)));
-        instructions.push_back(Instruction(OpCode::STORE));
+        emitStoreElement(info, (int) i);
     }
     
     // Check if we have too many initializers
@@ -924,11 +1331,8 @@ void CodeGenerator::generateArrayElements(ASTNode* node, const std::string& arra
             instructions.push_back(Instruction(OpCode::INT));
         }
         
-        // Calculate the array index offset
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(baseOffset + i)));
-        
         // Store the value in the array
-        instructions.push_back(Instruction(OpCode::STORE));
+        emitStoreLocal(baseOffset + i);
     }
     
     // Initialize remaining elements with 0 if needed
@@ -940,107 +1344,144 @@ void CodeGenerator::generateArrayElements(ASTNode* node, const std::string& arra
             instructions.push_back(Instruction(OpCode::FLOAT));
         }
         
-        // Calculate the array index offset
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(baseOffset + i)));
-        
         // Store the value in the array
-        instructions.push_back(Instruction(OpCode::STORE));
+        emitStoreLocal(baseOffset + i);
     }
 }
 
-// Rule 35: array-operation := var array-op expression
+// Checks if an expression uses an array of the frame without an index, outside of indices and call arguments
+bool CodeGenerator::hasWholeArray(ASTNode* node) {
+    if (!node) return false;
+    if (node->type == ASTNodeType::VAR) {
+        auto it = frameVariables.find(node->tokenValue);
+        return node->children->empty() && it != frameVariables.end() && it->second.isArray;
+    }
+    if (node->type == ASTNodeType::CALL || node->type == ASTNodeType::INPUT_STMT) return false;
+    for (ASTNode* child : *node->children) {
+        if (hasWholeArray(child)) return true;
+    }
+    return false;
+}
+
+// Appends the steps of an array operation in postfix order
+bool CodeGenerator::generateArraySteps(ASTNode* node, ArraySteps& out) {
+    if (!node) return false;
+
+    if (!hasWholeArray(node)) {
+        // The same for every element, so it is worked out once and left on the stack
+        switch (node->type) {
+            case ASTNodeType::SIMPLE_EXPRESSION: generateSimpleExpression(node); break;
+            case ASTNodeType::ADDITIVE_EXPR: generateAdditiveExpression(node); break;
+            case ASTNodeType::TERM: generateTerm(node); break;
+            default: generateFactor(node); break;
+        }
+        out.steps.push_back(VMAP_SCALAR);
+        out.steps.push_back(out.scalars++);
+        out.maxDepth = std::max(out.maxDepth, ++out.depth);
+        return true;
+    }
+
+    switch (node->type) {
+        case ASTNodeType::SIMPLE_EXPRESSION:
+            if (node->children->size() >= 3) {
+                std::cerr << "Error: Arrays cannot be compared element by element" << std::endl;
+                return false;
+            }
+            return generateArraySteps(node->children->at(0), out);
+        case ASTNodeType::ADDITIVE_EXPR:
+        case ASTNodeType::TERM:
+            if (!generateArraySteps(node->children->at(0), out)) return false;
+            for (size_t i = 1; i + 1 < node->children->size(); i += 2) {
+                if (!generateArraySteps(node->children->at(i + 1), out)) return false;
+                int operation;
+                switch (node->children->at(i)->tokenType) {
+                    case TokenType::PLUS: operation = 0; break;
+                    case TokenType::MINUS: operation = 1; break;
+                    case TokenType::TIMES: operation = 2; break;
+                    case TokenType::DIVIDE: operation = 3; break;
+                    default: operation = 4; break; // MOD
+                }
+                out.steps.push_back(VMAP_OP);
+                out.steps.push_back(operation);
+                out.depth--;
+            }
+            return true;
+        case ASTNodeType::FACTOR:
+            return generateArraySteps(node->children->at(0), out);
+        case ASTNodeType::VAR: {
+            const VariableInfo& info = frameVariables[node->tokenValue];
+            out.steps.push_back(VMAP_ARRAY);
+            out.steps.push_back(arrayOperand(info));
+            out.length = std::min(out.length, info.arraySize);
+            out.maxDepth = std::max(out.maxDepth, ++out.depth);
+            return true;
+        }
+        default:
+            std::cerr << "Error: Unexpected node in array operation: " << getNodeTypeName(node->type) << std::endl;
+            return false;
+    }
+}
+
+// Rule 35: array-operation := simple-expression that uses whole arrays
+// Compiles to one instruction that works out the expression for every element in a single pass, with
+// no temporary arrays: parts without whole arrays are evaluated first and left on the stack for it.
+// array op scalar and array op array have instructions of their own; anything else is a VMAP
 void CodeGenerator::generateArrayOperation(ASTNode* node, ASTNode* varNode) {
-    if (!node || node->children->size() < 3) {
+    if (!node || node->children->empty()) {
         std::cerr << "Error: Invalid array operation structure" << std::endl;
         return;
     }
-
-    // Get the nodes for the operation components
-    ASTNode* rightArrayNode = node->children->at(0);  // Left array
-    ASTNode* opNode = node->children->at(1);         // Operator
-    ASTNode* rightExprNode = node->children->at(2);  // Right expression
-   
-    // Get info about the  array
-    std::string arrayName = rightArrayNode->tokenValue;
-    auto it = frameVariables.find(arrayName);
-    if (it == frameVariables.end() || !it->second.isArray) {
-        std::cerr << "Error: Cannot perform array operation on non-array variable '" << arrayName << "'" << std::endl;
+    if (!varNode) {
+        std::cerr << "Error: Array operation result must be assigned to an array" << std::endl;
         return;
     }
 
-    int baseOffset = it->second.stackOffset;
-    int arraySize = it->second.arraySize;
-    bool isFloat = it->second.isFloat;
-
-    // Get info about right array
+    // Get info about the array being assigned
     std::string leftArrayName = varNode->tokenValue;
-    auto it2 = frameVariables.find(leftArrayName);
-    if (it2 == frameVariables.end() || !it2->second.isArray) {
-        std::cerr << "Error: Cannot perform array operation on non-array variable '" << leftArrayName << "'" << std::endl;
+    auto it = frameVariables.find(leftArrayName);
+    if (it == frameVariables.end() || !it->second.isArray || !varNode->children->empty()) {
+        std::cerr << "Error: Cannot assign array operation to non-array variable '" << leftArrayName << "'" << std::endl;
         return;
     }
     
-    int leftBaseOffset = it2->second.stackOffset;
-    int leftArraySize = it2->second.arraySize;
-    bool leftIsFloat = it2->second.isFloat;
-    
-    // Generate code for the scalar expression (right side)
-    generateSimpleExpression(rightExprNode);
-    
-    // Store the scalar value in a temporary location for reuse
-    int tempLocation = localVarCount++;  // Allocate a temporary location
-    instructions.push_back(Instruction(OpCode::PUSH, std::to_string(tempLocation)));
-    instructions.push_back(Instruction(OpCode::STORE));
-    
-    // Get operator type
-    TokenType opType = opNode->tokenType;
-    
-    // Process each array element
-    for (int i = 0; i < arraySize; i++) {
-        // Load the current array element
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(baseOffset + i)));
-        instructions.push_back(Instruction(OpCode::LOAD));
-        
-        // Load the scalar value
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(tempLocation)));
-        instructions.push_back(Instruction(OpCode::LOAD));
-        
-        // Apply the operation
-        switch (opType) {
-            case TokenType::PLUS:
-                instructions.push_back(Instruction(OpCode::ADD));
-                break;
-            case TokenType::MINUS:
-                instructions.push_back(Instruction(OpCode::SUB));
-                break;
-            case TokenType::TIMES:
-                instructions.push_back(Instruction(OpCode::MUL));
-                break;
-            case TokenType::DIVIDE:
-                instructions.push_back(Instruction(OpCode::DIV));
-                break;
-            case TokenType::MOD:
-                instructions.push_back(Instruction(OpCode::REM));
-                break;
-            default:
-                std::cerr << "Error: Unknown array operation" << std::endl;
-                break;
-        }
-        
-        // Convert to the appropriate type if needed
-        if (isFloat) {
-            instructions.push_back(Instruction(OpCode::FLOAT));
-        } else {
-            instructions.push_back(Instruction(OpCode::INT));
+    int leftBaseOffset = arrayOperand(it->second);
+    int leftArraySize = it->second.arraySize;
+    bool leftIsFloat = it->second.isFloat;
+
+    ArraySteps steps;
+    steps.scalars = 0;
+    steps.length = leftArraySize;
+    steps.depth = 0;
+    steps.maxDepth = 0;
+    if (!generateArraySteps(node->children->at(0), steps)) {
+        return;
+    }
+    if (steps.maxDepth > VMAP_MAX_DEPTH) {
+        std::cerr << "Error: Array operation on '" << leftArrayName << "' is nested too deeply" << std::endl;
+        return;
+    }
+
+    // Elements past the end of the shortest array are left alone
+    int length = steps.length;
+    if (length != leftArraySize) {
+        std::cerr << "Warning: Array operation on '" << leftArrayName << "' only sets its first " << length << " elements" << std::endl;
+    }
+    std::string tail = std::to_string(length) + "," + (leftIsFloat ? "1" : "0"); // Length, and 1 when the result is stored as floats
+
+    const std::vector<int32_t>& s = steps.steps;
+    if (s.size() == 6 && s[0] == VMAP_ARRAY && s[2] == VMAP_SCALAR && s[4] == VMAP_OP) {
+        OpCode op = static_cast<OpCode>(static_cast<int>(OpCode::VADDS) + s[5]);
+        instructions.push_back(Instruction(op, std::to_string(leftBaseOffset) + "," + std::to_string(s[1]) + "," + tail));
+    } else if (s.size() == 6 && s[0] == VMAP_ARRAY && s[2] == VMAP_ARRAY && s[4] == VMAP_OP) {
+        OpCode op = static_cast<OpCode>(static_cast<int>(OpCode::VADDV) + s[5]);
+        instructions.push_back(Instruction(op, std::to_string(leftBaseOffset) + "," + std::to_string(s[1]) + "," + std::to_string(s[3]) + "," + tail));
+    } else {
+        std::string operands = std::to_string(leftBaseOffset) + "," + tail;
+        for (int32_t value : s) {
+            operands += "," + std::to_string(value);
         }
-        
-        // Store the result back in the array
-        instructions.push_back(Instruction(OpCode::PUSH, std::to_string(leftBaseOffset + i)));
-        instructions.push_back(Instruction(OpCode::STORE));
+        instructions.push_back(Instruction(OpCode::VMAP, operands));
     }
-    
-    // Free the temporary location by decrementing localVarCount
-    localVarCount--;
 }
 
 // Rule 36: array-op := + | - | * | /
@@ -1092,7 +1533,8 @@ std::vector<std::string> CodeGenerator::getCode() const {
                 } (instr.arg);
                 
                 // Adding quotations marks if necessary 
-                if (instr.op == OpCode::PRINT || instr.op == OpCode::BRZ || instr.op == OpCode::BRT || instr.op == OpCode::CALL || instr.op == OpCode::JUMP) {
+                if (instr.op == OpCode::PRINT || instr.op == OpCode::BRZ || instr.op == OpCode::BRT || instr.op == OpCode::CALL || instr.op == OpCode::JUMP
+                    || instr.op == OpCode::TAILCALL) {
                     if (!canBeInt && !canBeFloat) {
                         oss << "\"" << instr.arg << "\""; // Add quotes around the string argument
                     } else {
@@ -1102,7 +1544,15 @@ std::vector<std::string> CodeGenerator::getCode() const {
                     oss << instr.arg; // Argument w/o quotes (int) or empty string (no arg)
                 }
                 
+                if (instr.numParams >= 0) {
+                    oss << "," << instr.numParams; // CALL("gcd",2)
+                }
+                if (instr.frameParams >= 0) {
+                    oss << "," << instr.frameParams; // TAILCALL("gcd",2,2)
+                }
                 oss << ");"; // Close parentheses
+            } else if (instr.numParams >= 0) {
+                oss << "(" << instr.numParams << ");"; // RET(2) and RETV(2)
             } else {
                 oss << "();"; // Empty parentheses for instructions with no arguments
             }
@@ -1115,10 +1565,1230 @@ std::vector<std::string> CodeGenerator::getCode() const {
     return code;
 }
 
+// Runtime for getCppCode(): the stack machine's memory and instructions as inline functions
+// Each function does what the stack machine's handler of the same name does, so translated
+// programs give the same output; int arithmetic wraps through unsigned, as it does in practice in s.exe
+static const char* CPP_RUNTIME = R"RUNTIME(#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+struct Value {
+    union {
+        int32_t i;
+        float f;
+    };
+    int32_t isFloat; // 0 for int, 1 for float
+};
+
+const int MEMORY_SLOTS = 1024; // Same defaults as s.exe
+const int MAX_MEMORY_SLOTS = 16 * 1024 * 1024;
+
+static std::vector<Value> memoryStorage(MEMORY_SLOTS, Value());
+static Value* m = memoryStorage.data();
+static int memorySize = MEMORY_SLOTS;
+static Value gpr;
+
+static Value makeInt(int32_t i) { Value v; v.i = i; v.isFloat = 0; return v; }
+static Value makeFloat(float f) { Value v; v.f = f; v.isFloat = 1; return v; }
+static float toFloat(const Value& v) { return v.isFloat ? v.f : (float) v.i; }
+static int32_t toInt(const Value& v) { return v.isFloat ? (int32_t) v.f : v.i; }
+static bool isTrue(const Value& v) { return v.isFloat ? v.f != 0.0f : v.i != 0; }
+static int32_t wrap(int64_t x) { return (int32_t) (uint32_t) (uint64_t) x; }
+
+static void grow(int slot) {
+    if (slot < 0) {
+        std::cerr << "Error: Memory access below the bottom of the stack (slot " << slot << ")" << std::endl;
+        exit(1);
+    }
+    if (slot >= MAX_MEMORY_SLOTS) {
+        std::cerr << "Error: Stack overflow: slot " << slot << " exceeds the memory limit of " << MAX_MEMORY_SLOTS << " slots" << std::endl;
+        exit(1);
+    }
+    long long newSize = memorySize;
+    while (newSize <= slot) newSize *= 2;
+    if (newSize > MAX_MEMORY_SLOTS) newSize = MAX_MEMORY_SLOTS;
+    memoryStorage.resize((size_t) newSize, makeInt(0));
+    m = memoryStorage.data();
+    memorySize = (int) newSize;
+}
+static inline void reserve(int slot) { if ((unsigned) slot >= (unsigned) memorySize) grow(slot); }
+
+// CALL: saves the frame above the parameters and returns the callee's stack pointer
+static inline int enterFrame(int& top, int sp, int numParams, int returnAddress) {
+    reserve(top + 1);
+    m[top] = makeInt(sp);
+    m[top + 1] = makeInt(returnAddress);
+    top += 2;
+    return top - 2 - numParams;
+}
+// RETV: the caller's stack top is the callee's stack pointer; RET returns sp itself
+static inline int leaveFrameValue(int top, int sp) { m[sp] = m[top - 1]; return sp + 1; }
+// TAILCALL: moves the arguments over the parameters and the frame header behind them, returns the callee's stack top
+static inline int replaceFrame(int top, int sp, int numParams, int frameParams) {
+    Value savedStackPointer = m[sp + frameParams];
+    Value returnAddress = m[sp + frameParams + 1];
+    for (int i = 0; i < numParams; i++) m[sp + i] = m[top - numParams + i];
+    m[sp + numParams] = savedStackPointer;
+    m[sp + numParams + 1] = returnAddress;
+    return sp + numParams + 2;
+}
+
+static inline void opPUSH(int& top) { reserve(top); m[top++] = gpr; }
+static inline void opPUSH(int& top, int32_t value) { reserve(top); m[top++] = makeInt(value); }
+static inline void opPUSHF(int& top, uint32_t bits) { float f; std::memcpy(&f, &bits, 4); reserve(top); m[top++] = makeFloat(f); }
+static inline void opPOP(int& top) { gpr = m[--top]; }
+static inline void opDUP(int& top) { reserve(top); m[top] = m[top - 1]; top += 1; }
+static inline void opLOAD(int& top, int sp) { int slot = sp + m[top - 1].i; reserve(slot); m[top - 1] = m[slot]; }
+static inline void opSAVE(int& top, int sp) { int slot = sp + m[--top].i; reserve(slot); m[slot] = m[top - 1]; }
+static inline void opSTORE(int& top, int sp) {
+    int slot = sp + m[top - 1].i; reserve(slot); m[slot] = m[top - 2]; top -= 2;
+    if (slot >= top) top = slot + 1;
+}
+static inline void opLOADL(int& top, int sp, int k) { reserve(sp + k); reserve(top); m[top++] = m[sp + k]; }
+static inline void opSTOREL(int& top, int sp, int k) {
+    int slot = sp + k; reserve(slot); m[slot] = m[--top];
+    if (slot >= top) top = slot + 1;
+}
+static inline void opADDLL(int& top, int sp, int k, int j) {
+    reserve(sp + k); reserve(sp + j); reserve(top);
+    Value a = m[sp + k], b = m[sp + j];
+    m[top++] = (a.isFloat | b.isFloat) ? makeFloat(toFloat(a) + toFloat(b)) : makeInt(wrap((int64_t) a.i + b.i));
+}
+
+// Heap arrays: HALLOC allocates on top of the heap and stores the handle, the heap index of the first element,
+// in a frame slot; HFREE moves the top of the heap back to a handle
+static std::vector<Value> heapStorage;
+static Value* heap = nullptr;
+static int heapTop = 0;
+
+[[noreturn]] static void heapError(int index) {
+    std::cerr << "Error: Heap access out of range: index " << index << ", " << heapTop << " heap slots allocated" << std::endl;
+    exit(1);
+}
+static inline void opHALLOC(int& top, int sp, int k, int length) {
+    if (length > MAX_MEMORY_SLOTS - heapTop) {
+        std::cerr << "Error: Heap overflow: " << heapTop << " slots plus an array of " << length << " exceed the memory limit of " << MAX_MEMORY_SLOTS << " slots" << std::endl;
+        exit(1);
+    }
+    if (heapTop + length > (int) heapStorage.size()) {
+        long long newSize = heapStorage.empty() ? 1 : (long long) heapStorage.size();
+        while (newSize < heapTop + length) newSize *= 2;
+        heapStorage.resize((size_t) (newSize > MAX_MEMORY_SLOTS ? MAX_MEMORY_SLOTS : newSize), makeInt(0));
+        heap = heapStorage.data();
+    }
+    int slot = sp + k; reserve(slot); m[slot] = makeInt(heapTop); heapTop += length;
+    if (slot >= top) top = slot + 1;
+}
+static inline void opHFREE(int sp, int k) { reserve(sp + k); int h = m[sp + k].i; if (h < 0 || h > heapTop) heapError(h); heapTop = h; }
+// HLOAD and HSTORE take an element index, checked against the length of the array whose handle is in frame slot k
+static inline int heapElement(int sp, int k, int length, int index) {
+    if ((unsigned) index >= (unsigned) length) {
+        std::cerr << "Error: Heap array index out of range: index " << index << ", array of " << length << " elements" << std::endl;
+        exit(1);
+    }
+    int h = m[sp + k].i + index; if ((unsigned) h >= (unsigned) heapTop) heapError(h);
+    return h;
+}
+static inline void opHLOAD(int& top, int sp, int k, int length) { m[top - 1] = heap[heapElement(sp, k, length, m[top - 1].i)]; }
+static inline void opHSTORE(int& top, int sp, int k, int length) { heap[heapElement(sp, k, length, m[top - 1].i)] = m[top - 2]; top -= 2; }
+
+#define GENERIC_ARITH(name, op, iexpr) \
+    static inline void name(int& top) { \
+        Value& a = m[top - 2]; const Value& b = m[top - 1]; top -= 1; \
+        if (a.isFloat | b.isFloat) { a.f = toFloat(a) op toFloat(b); a.isFloat = 1; } else { a.i = iexpr; } \
+    }
+GENERIC_ARITH(opADD, +, wrap((int64_t) a.i + b.i))
+GENERIC_ARITH(opSUB, -, wrap((int64_t) a.i - b.i))
+GENERIC_ARITH(opMUL, *, wrap((int64_t) a.i * b.i))
+GENERIC_ARITH(opDIV, /, a.i / b.i)
+static inline void opREM(int& top) { Value& a = m[top - 2]; const Value& b = m[top - 1]; top -= 1; a.i = toInt(a) % toInt(b); a.isFloat = 0; }
+
+#define GENERIC_COMPARE(name, op) \
+    static inline void name(int& top) { \
+        Value& a = m[top - 2]; const Value& b = m[top - 1]; top -= 1; \
+        a.i = (a.isFloat | b.isFloat) ? toFloat(a) op toFloat(b) : a.i op b.i; a.isFloat = 0; \
+    }
+GENERIC_COMPARE(opEQ, ==) GENERIC_COMPARE(opNE, !=) GENERIC_COMPARE(opLE, <=)
+GENERIC_COMPARE(opGE, >=) GENERIC_COMPARE(opLT, <) GENERIC_COMPARE(opGT, >)
+
+#define TYPED(name, field, expr) static inline void name(int& top) { m[top - 2].field = expr; top -= 1; }
+TYPED(opIADD, i, wrap((int64_t) m[top - 2].i + m[top - 1].i)) TYPED(opISUB, i, wrap((int64_t) m[top - 2].i - m[top - 1].i))
+TYPED(opIMUL, i, wrap((int64_t) m[top - 2].i * m[top - 1].i)) TYPED(opIDIV, i, m[top - 2].i / m[top - 1].i)
+TYPED(opFADD, f, m[top - 2].f + m[top - 1].f) TYPED(opFSUB, f, m[top - 2].f - m[top - 1].f)
+TYPED(opFMUL, f, m[top - 2].f * m[top - 1].f) TYPED(opFDIV, f, m[top - 2].f / m[top - 1].f)
+TYPED(opIEQ, i, m[top - 2].i == m[top - 1].i) TYPED(opINE, i, m[top - 2].i != m[top - 1].i)
+TYPED(opILE, i, m[top - 2].i <= m[top - 1].i) TYPED(opIGE, i, m[top - 2].i >= m[top - 1].i)
+TYPED(opILT, i, m[top - 2].i < m[top - 1].i) TYPED(opIGT, i, m[top - 2].i > m[top - 1].i)
+
+#define FLOAT_COMPARE(name, op) \
+    static inline void name(int& top) { Value& a = m[top - 2]; a.i = a.f op m[top - 1].f; a.isFloat = 0; top -= 1; }
+FLOAT_COMPARE(opFEQ, ==) FLOAT_COMPARE(opFNE, !=) FLOAT_COMPARE(opFLE, <=)
+FLOAT_COMPARE(opFGE, >=) FLOAT_COMPARE(opFLT, <) FLOAT_COMPARE(opFGT, >)
+
+// Vector instructions: op is 0 ADD, 1 SUB, 2 MUL, 3 DIV, 4 REM; flags 1 stores the results as floats
+static inline Value vectorArith(int op, const Value& a, const Value& b) {
+    if (op == 4) return makeInt(toInt(a) % toInt(b));
+    if (a.isFloat | b.isFloat) {
+        float x = toFloat(a), y = toFloat(b);
+        return makeFloat(op == 0 ? x + y : op == 1 ? x - y : op == 2 ? x * y : x / y);
+    }
+    return makeInt(op == 0 ? wrap((int64_t) a.i + b.i) : op == 1 ? wrap((int64_t) a.i - b.i) : op == 2 ? wrap((int64_t) a.i * b.i) : a.i / b.i);
+}
+static inline Value vectorElement(int op, const Value& a, const Value& b, int flags) {
+    Value r = vectorArith(op, a, b);
+    return flags ? makeFloat(toFloat(r)) : makeInt(toInt(r));
+}
+// Array operands are frame offsets, or -1 - k for the heap array whose handle is in frame slot k
+static inline void reserveArray(int sp, int a, int length) {
+    if (a >= 0) { reserve(sp + a); reserve(sp + a + length - 1); return; }
+    reserve(sp - 1 - a);
+    int h = m[sp - 1 - a].i;
+    if (h < 0 || h > heapTop - length) heapError(h < 0 ? h : h + length - 1);
+}
+// First element of an array operand, once every operand of the instruction is reserved
+static inline Value* array(int sp, int a) { return a >= 0 ? m + sp + a : heap + m[sp - 1 - a].i; }
+static inline void raiseTop(int& top, int sp, int dst, int length) { if (dst >= 0 && sp + dst + length > top) top = sp + dst + length; }
+static inline void opVECTORS(int& top, int sp, int op, int dst, int src, int length, int flags) {
+    Value scalar = m[--top];
+    if (length == 0) return;
+    reserveArray(sp, dst, length); reserveArray(sp, src, length);
+    Value* d = array(sp, dst); const Value* a = array(sp, src);
+    for (int i = 0; i < length; i++) d[i] = vectorElement(op, a[i], scalar, flags);
+    raiseTop(top, sp, dst, length);
+}
+static inline void opVECTORV(int& top, int sp, int op, int dst, int src, int src2, int length, int flags) {
+    if (length == 0) return;
+    reserveArray(sp, dst, length); reserveArray(sp, src, length); reserveArray(sp, src2, length);
+    Value* d = array(sp, dst); const Value* a = array(sp, src); const Value* b = array(sp, src2);
+    for (int i = 0; i < length; i++) d[i] = vectorElement(op, a[i], b[i], flags);
+    raiseTop(top, sp, dst, length);
+}
+// VMAP: r is the record as in the stack machine: dst, length, flags, step count, scalar count, then kind and value pairs
+static inline void opVMAP(int& top, int sp, const int32_t* r) {
+    top -= r[4];
+    int scalars = top, length = r[1];
+    if (length == 0) return;
+    reserveArray(sp, r[0], length);
+    for (int s = 0; s < r[3]; s++) if (r[5 + 2 * s] == 0) reserveArray(sp, r[6 + 2 * s], length);
+    Value* d = array(sp, r[0]);
+    for (int i = 0; i < length; i++) {
+        Value values[16];
+        int depth = 0;
+        for (int s = 0; s < r[3]; s++) {
+            int kind = r[5 + 2 * s], value = r[6 + 2 * s];
+            if (kind == 0) values[depth++] = array(sp, value)[i];
+            else if (kind == 1) values[depth++] = m[scalars + value];
+            else { depth--; values[depth - 1] = vectorArith(value, values[depth - 1], values[depth]); }
+        }
+        d[i] = r[2] ? makeFloat(toFloat(values[0])) : makeInt(toInt(values[0]));
+    }
+    raiseTop(top, sp, r[0], length);
+}
+// Reductions: op is 0 SUM, 1 MIN, 2 MAX, 3 DOT; pushes an int when every element is an int and a float otherwise
+// Float sums are added up in blocks of 4096 elements as in the stack machine: element i of a block goes to
+// partial sum i % 8, the partial sums are added pairwise, and the block sums are added in order
+static inline void opREDUCE(int& top, int sp, int op, int src, int src2, int length) {
+    Value result = makeInt(0);
+    if (length > 0) {
+        reserveArray(sp, src, length);
+        if (op == 3) reserveArray(sp, src2, length);
+        const Value* a = array(sp, src);
+        const Value* b = op == 3 ? array(sp, src2) : a;
+        bool anyFloat = false;
+        for (int i = 0; i < length; i++) anyFloat |= a[i].isFloat || (op == 3 && b[i].isFloat);
+        if (op == 1 || op == 2) {
+            result = a[0];
+            for (int i = 1; i < length; i++) {
+                const Value& v = a[i];
+                bool better = anyFloat ? (op == 1 ? toFloat(v) < toFloat(result) : toFloat(v) > toFloat(result)) : (op == 1 ? v.i < result.i : v.i > result.i);
+                if (better) result = v;
+            }
+            if (anyFloat) result = makeFloat(toFloat(result));
+        } else if (!anyFloat) {
+            int32_t sum = 0;
+            for (int i = 0; i < length; i++) sum = wrap((int64_t) sum + (op == 3 ? wrap((int64_t) a[i].i * b[i].i) : a[i].i));
+            result = makeInt(sum);
+        } else {
+            float sum = 0;
+            for (int start = 0; start < length; start += 4096) {
+                float lanes[8] = {};
+                for (int i = start; i < length && i < start + 4096; i++) lanes[i % 8] += op == 3 ? toFloat(a[i]) * toFloat(b[i]) : toFloat(a[i]);
+                sum += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+            }
+            result = makeFloat(sum);
+        }
+    }
+    reserve(top);
+    m[top++] = result;
+}
+
+static inline void opINT(int& top) { Value& v = m[top - 1]; if (v.isFloat) v = makeInt((int32_t) v.f); }
+static inline void opFLOAT(int& top) { Value& v = m[top - 1]; if (!v.isFloat) v = makeFloat((float) v.i); }
+static inline bool popTrue(int& top) { return isTrue(m[--top]); }
+
+static inline void opPRINT(int top) {
+    const Value& v = m[top - 1];
+    if (v.isFloat) std::cout << v.f << std::endl;
+    else std::cout << v.i << std::endl;
+}
+static inline void opPRINT(const char* message) { std::cout << message << std::endl; }
+// A read past the end of the input gives 0, as in s.exe
+static inline void opREAD(int& top) { int temp = 0; std::cin >> temp; opPUSH(top, temp); }
+static inline void opREADF(int& top) { float temp = 0; std::cin >> temp; reserve(top); m[top++] = makeFloat(temp); }
+// Whole-array input and output: VREAD reads floats when flags is 1; VPRINT flushes once, after the last element
+static inline void opVREAD(int& top, int sp, int dst, int length, int flags) {
+    if (length == 0) return;
+    reserveArray(sp, dst, length);
+    Value* d = array(sp, dst);
+    for (int i = 0; i < length; i++) {
+        if (flags) { float temp = 0; std::cin >> temp; d[i] = makeFloat(temp); }
+        else { int temp = 0; std::cin >> temp; d[i] = makeInt(temp); }
+    }
+    raiseTop(top, sp, dst, length);
+}
+static inline void opVPRINT(int sp, int src, int length) {
+    if (length == 0) return;
+    reserveArray(sp, src, length);
+    const Value* a = array(sp, src);
+    for (int i = 0; i < length; i++) {
+        if (a[i].isFloat) std::cout << a[i].f << '\n';
+        else std::cout << a[i].i << '\n';
+    }
+    std::cout.flush();
+}
+
+// END and running past the last instruction stop the program the way they stop s.exe
+[[noreturn]] static inline void opEND() { std::cout.flush(); exit(0); }
+[[noreturn]] static inline void finish() { std::cout << "Program execution completed successfully." << std::endl; exit(0); }
+[[noreturn]] static inline void unsupported(const char* what) { std::cerr << "Error: " << what << " cannot be translated to C++" << std::endl; exit(1); }
+)RUNTIME";
+
+// Returns source, second source and length of a reduction, as a comma separated list; only VDOT has a second source
+static std::string reduceRecord(OpCode op, const std::string& arg) {
+    if (op == OpCode::VDOT) return arg;
+    size_t comma = arg.find(',');
+    return arg.substr(0, comma) + ",0" + arg.substr(comma);
+}
+
+// Returns the VMAP record for the operands of a VMAP instruction, as a comma separated list
+// Operands are dst, length and flags followed by the steps; the record adds the step and scalar counts
+static std::string vmapRecord(const std::string& arg) {
+    std::vector<std::string> values;
+    std::istringstream operands(arg);
+    std::string value;
+    while (std::getline(operands, value, ',')) {
+        values.push_back(value);
+    }
+    int scalars = 0;
+    for (size_t i = 3; i + 1 < values.size(); i += 2) {
+        if (std::stoi(values[i]) == VMAP_SCALAR) scalars++;
+    }
+    std::string record = values[0] + ", " + values[1] + ", " + values[2] + ", " + std::to_string((values.size() - 3) / 2) + ", " + std::to_string(scalars);
+    for (size_t i = 3; i < values.size(); i++) {
+        record += ", " + values[i];
+    }
+    return record;
+}
+
+// Returns label or function name as a C++ identifier
+static std::string cppName(const std::string& prefix, const std::string& name) {
+    std::string result = prefix;
+    for (char c : name) {
+        result += (isalnum((unsigned char) c) || c == '_') ? c : '_';
+    }
+    return result;
+}
+
+// Returns text as a C++ string literal
+static std::string cppString(const std::string& text) {
+    std::ostringstream oss;
+    oss << "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            oss << '\\' << c;
+        } else if (c < 0x20 || c >= 0x7F) {
+            oss << '\\' << (char) ('0' + ((c >> 6) & 7)) << (char) ('0' + ((c >> 3) & 7)) << (char) ('0' + (c & 7));
+        } else {
+            oss << c;
+        }
+    }
+    oss << "\"";
+    return oss.str();
+}
+
+// Translate instructions to a standalone C++ program
+// Every function becomes a C++ function taking the stack top and its frame's stack pointer and
+// returning the stack top after it returns; labels become goto targets. Frames stay in one memory
+// array laid out as in s.exe, since parameters are pushed by the caller and arrays are indexed at run time
+std::vector<std::string> CodeGenerator::getCppCode() const {
+    std::vector<std::string> code;
+    code.push_back("// Generated by the C- compiler; build with g++ -O2");
+    std::istringstream runtime(CPP_RUNTIME);
+    std::string line;
+    while (std::getline(runtime, line)) {
+        code.push_back(line);
+    }
+
+    // Functions start at CALL targets and at main; code before the first one is the entry point
+    std::unordered_map<std::string, bool> calledLabels;
+    for (const auto& instr : instructions) {
+        if ((instr.op == OpCode::CALL || instr.op == OpCode::TAILCALL) && !instr.arg.empty()) calledLabels[instr.arg] = true;
+    }
+    calledLabels["main"] = true;
+    std::unordered_map<std::string, bool> isFunction; // Function labels defined in the program
+    std::vector<std::pair<std::string, size_t>> functionStarts; // C++ name and first instruction
+    functionStarts.push_back(std::make_pair(std::string("vsmEntry"), (size_t) 0));
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const std::string& label = instructions[i].arg;
+        if (instructions[i].op == OpCode::LABEL && calledLabels.count(label) && !isFunction.count(label)) {
+            isFunction[label] = true;
+            functionStarts.push_back(std::make_pair(cppName("vsm_", label), i));
+        }
+    }
+
+    code.push_back("");
+    for (const auto& function : functionStarts) {
+        code.push_back("static int " + function.first + "(int top, int sp);");
+    }
+
+    for (size_t f = 0; f < functionStarts.size(); f++) {
+        size_t start = functionStarts[f].second;
+        size_t end = f + 1 < functionStarts.size() ? functionStarts[f + 1].second : instructions.size();
+
+        // Only labels something in this function jumps to are emitted, so g++ does not warn about the rest
+        std::unordered_map<std::string, bool> localLabels;
+        std::unordered_map<std::string, bool> usedLabels;
+        for (size_t i = start; i < end; i++) {
+            if (instructions[i].op == OpCode::LABEL && i != start) localLabels[instructions[i].arg] = true;
+            if (instructions[i].op == OpCode::BRT || instructions[i].op == OpCode::BRZ || instructions[i].op == OpCode::JUMP) {
+                usedLabels[instructions[i].arg] = true;
+            }
+        }
+
+        // Returns statement that continues at a label
+        auto jumpTo = [&](const std::string& label) -> std::string {
+            if (localLabels.count(label)) return "goto " + cppName("label_", label) + ";";
+            if (isFunction.count(label)) return "return " + cppName("vsm_", label) + "(top, sp);"; // Same frame
+            return "unsupported(" + cppString("Jump to " + label) + ");";
+        };
+
+        code.push_back("");
+        code.push_back("static int " + functionStarts[f].first + "(int top, int sp) {");
+        for (size_t i = start; i < end; i++) {
+            const Instruction& instr = instructions[i];
+            const std::string& arg = instr.arg;
+            std::string s;
+            switch (instr.op) {
+                case OpCode::LABEL:
+                    if (i != start && usedLabels.count(arg)) s = cppName("label_", arg) + ":;";
+                    break;
+                case OpCode::CALL:
+                    if (arg.empty() || !isFunction.count(arg) || instr.numParams < 0) {
+                        s = "unsupported(\"CALL without a label\");";
+                    } else {
+                        s = "{ int callee = enterFrame(top, sp, " + std::to_string(instr.numParams) + ", " + std::to_string(i + 1) + "); top = "
+                            + cppName("vsm_", arg) + "(top, callee); }";
+                    }
+                    break;
+                case OpCode::TAILCALL:
+                    if (arg.empty() || !isFunction.count(arg)) {
+                        s = "unsupported(\"TAILCALL without a label\");";
+                    } else {
+                        // A sibling call, which g++ turns into a jump at -O2
+                        s = "return " + cppName("vsm_", arg) + "(replaceFrame(top, sp, " + std::to_string(instr.numParams) + ", "
+                            + std::to_string(instr.frameParams) + "), sp);";
+                    }
+                    break;
+                case OpCode::RET: s = "return sp;"; break;
+                case OpCode::RETV: s = "return leaveFrameValue(top, sp);"; break;
+                case OpCode::PUSH:
+                    if (arg.empty()) {
+                        s = "opPUSH(top);";
+                    } else if (arg.find_first_of(".eEnNiI") == std::string::npos) {
+                        long long value = std::stoll(arg);
+                        s = "opPUSH(top, " + (value == INT32_MIN ? std::string("INT32_MIN") : std::to_string(value)) + ");";
+                    } else {
+                        float value = std::stof(arg);
+                        uint32_t bits;
+                        memcpy(&bits, &value, sizeof(bits));
+                        s = "opPUSHF(top, " + std::to_string(bits) + "u); // " + arg;
+                    }
+                    break;
+                case OpCode::LOAD: s = "opLOAD(top, sp);"; break;
+                case OpCode::SAVE: s = "opSAVE(top, sp);"; break;
+                case OpCode::STORE: s = "opSTORE(top, sp);"; break;
+                case OpCode::LOADL: s = "opLOADL(top, sp, " + arg + ");"; break;
+                case OpCode::STOREL: s = "opSTOREL(top, sp, " + arg + ");"; break;
+                case OpCode::ADDLL: s = "opADDLL(top, sp, " + arg + ");"; break;
+                case OpCode::BRT: s = "if (popTrue(top)) " + jumpTo(arg); break;
+                case OpCode::BRZ: s = "if (!popTrue(top)) " + jumpTo(arg); break;
+                case OpCode::JUMP: s = jumpTo(arg); break;
+                case OpCode::PRINT: s = arg.empty() ? "opPRINT(top);" : "opPRINT(" + cppString(arg) + ");"; break;
+                case OpCode::READ: s = "opREAD(top);"; break;
+                case OpCode::READF: s = "opREADF(top);"; break;
+                case OpCode::END: s = "opEND();"; break;
+                case OpCode::NE: s = "opNE(top);"; break; // getOpString() gives NEQ
+                case OpCode::VADDS: case OpCode::VSUBS: case OpCode::VMULS: case OpCode::VDIVS: case OpCode::VREMS:
+                    s = "opVECTORS(top, sp, " + std::to_string((int) instr.op - (int) OpCode::VADDS) + ", " + arg + ");";
+                    break;
+                case OpCode::VADDV: case OpCode::VSUBV: case OpCode::VMULV: case OpCode::VDIVV: case OpCode::VREMV:
+                    s = "opVECTORV(top, sp, " + std::to_string((int) instr.op - (int) OpCode::VADDV) + ", " + arg + ");";
+                    break;
+                case OpCode::VMAP:
+                    s = "{ static const int32_t record[] = { " + vmapRecord(arg) + " }; opVMAP(top, sp, record); }";
+                    break;
+                case OpCode::VSUM: case OpCode::VMIN: case OpCode::VMAX: case OpCode::VDOT:
+                    s = "opREDUCE(top, sp, " + std::to_string((int) instr.op - (int) OpCode::VSUM) + ", " + reduceRecord(instr.op, arg) + ");";
+                    break;
+                case OpCode::HALLOC: s = "opHALLOC(top, sp, " + arg + ");"; break;
+                case OpCode::HFREE: s = "opHFREE(sp, " + arg + ");"; break;
+                case OpCode::HLOAD: s = "opHLOAD(top, sp, " + arg + ");"; break;
+                case OpCode::HSTORE: s = "opHSTORE(top, sp, " + arg + ");"; break;
+                case OpCode::VREAD: s = "opVREAD(top, sp, " + arg + ");"; break;
+                case OpCode::VPRINT: s = "opVPRINT(sp, " + arg + ");"; break;
+                default:
+                    s = "op" + getOpString(instr.op) + "(top);";
+                    break;
+            }
+            if (!s.empty()) {
+                code.push_back("    " + s);
+            }
+        }
+
+        // Running off the end continues in the next function, as the stack machine does
+        bool returned = code.back().rfind("    return ", 0) == 0 || code.back() == "    opEND();";
+        if (returned) {
+            // Nothing after a return is reachable
+        } else if (f + 1 < functionStarts.size()) {
+            code.push_back("    return " + functionStarts[f + 1].first + "(top, sp);");
+        } else {
+            code.push_back("    finish();");
+        }
+        code.push_back("}");
+    }
+
+    code.push_back("");
+    code.push_back("int main() {");
+    code.push_back("    vsmEntry(0, 0);");
+    code.push_back("    finish();");
+    code.push_back("}");
+    return code;
+}
+
+// Prelude for getAsmCode(): one macro per stack machine instruction
+// Registers: %r12 memory, %r13d stack top, %r14d frame (stackPointer), %r15d slot being accessed,
+// %rbx saved %rsp while nativeRuntime.cpp is called with an aligned stack. All are callee-saved
+static const char* ASM_PRELUDE = R"PRELUDE(    .text
+
+    # Calls a runtime function with the stack aligned to 16 bytes
+    .macro ccall fn
+    movq %rsp, %rbx
+    andq $-16, %rsp
+    call \fn
+    movq %rbx, %rsp
+    .endm
+
+    # Makes sure the slot in reg is in memory, growing it like s.exe
+    .macro reserve reg
+    cmpl vsm_memory_size(%rip), \reg
+    jb .Lr\@
+    movl \reg, %edi
+    ccall vsm_grow
+    movq %rax, %r12
+.Lr\@:
+    .endm
+
+    .macro vsm_push_i value
+    reserve %r13d
+    movl $\value, (%r12,%r13,8)
+    movl $0, 4(%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_push_f bits
+    reserve %r13d
+    movl $\bits, (%r12,%r13,8)
+    movl $1, 4(%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_push
+    reserve %r13d
+    movq vsm_gpr(%rip), %rax
+    movq %rax, (%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_pop
+    decl %r13d
+    movq (%r12,%r13,8), %rax
+    movq %rax, vsm_gpr(%rip)
+    .endm
+
+    .macro vsm_dup
+    reserve %r13d
+    movq -8(%r12,%r13,8), %rax
+    movq %rax, (%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_load
+    movl -8(%r12,%r13,8), %r15d
+    addl %r14d, %r15d
+    reserve %r15d
+    movq (%r12,%r15,8), %rax
+    movq %rax, -8(%r12,%r13,8)
+    .endm
+
+    .macro vsm_save
+    decl %r13d
+    movl (%r12,%r13,8), %r15d
+    addl %r14d, %r15d
+    reserve %r15d
+    movq -8(%r12,%r13,8), %rax
+    movq %rax, (%r12,%r15,8)
+    .endm
+
+    # Storing at or past the stack top raises it
+    .macro raise_top
+    cmpl %r13d, %r15d
+    jb .Lt\@
+    leal 1(%r15), %r13d
+.Lt\@:
+    .endm
+
+    .macro vsm_store
+    movl -8(%r12,%r13,8), %r15d
+    addl %r14d, %r15d
+    reserve %r15d
+    movq -16(%r12,%r13,8), %rax
+    movq %rax, (%r12,%r15,8)
+    subl $2, %r13d
+    raise_top
+    .endm
+
+    .macro vsm_loadl offset
+    leal \offset(%r14), %r15d
+    reserve %r15d
+    reserve %r13d
+    movq (%r12,%r15,8), %rax
+    movq %rax, (%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_storel offset
+    leal \offset(%r14), %r15d
+    reserve %r15d
+    decl %r13d
+    movq (%r12,%r13,8), %rax
+    movq %rax, (%r12,%r15,8)
+    raise_top
+    .endm
+
+    # Generic arithmetic and comparisons: ints inline, anything with a float in the runtime
+    .macro generic op, done
+    movl -12(%r12,%r13,8), %eax
+    orl -4(%r12,%r13,8), %eax
+    jz .Lg\@
+    leaq -16(%r12,%r13,8), %rdi
+    movl $\op, %esi
+    ccall vsm_generic
+    decl %r13d
+    jmp \done
+.Lg\@:
+    .endm
+
+    .macro int_arith insn
+    movl -16(%r12,%r13,8), %eax
+    \insn -8(%r12,%r13,8), %eax
+    movl %eax, -16(%r12,%r13,8)
+    decl %r13d
+    .endm
+
+    .macro int_divide result
+    movl -16(%r12,%r13,8), %eax
+    cltd
+    idivl -8(%r12,%r13,8)
+    movl \result, -16(%r12,%r13,8)
+    decl %r13d
+    .endm
+
+    .macro int_compare set
+    movl -16(%r12,%r13,8), %eax
+    cmpl -8(%r12,%r13,8), %eax
+    \set %al
+    movzbl %al, %eax
+    movl %eax, -16(%r12,%r13,8)
+    decl %r13d
+    .endm
+
+    .macro float_arith insn
+    movss -16(%r12,%r13,8), %xmm0
+    \insn -8(%r12,%r13,8), %xmm0
+    movss %xmm0, -16(%r12,%r13,8)
+    decl %r13d
+    .endm
+
+    # Unordered operands compare false, except for FNE; parity is set when they are unordered
+    .macro float_compare set, swap=0, parity=none
+    movss -16(%r12,%r13,8), %xmm0
+    movss -8(%r12,%r13,8), %xmm1
+    .if \swap
+    ucomiss %xmm0, %xmm1
+    .else
+    ucomiss %xmm1, %xmm0
+    .endif
+    \set %al
+    .ifc \parity,ordered
+    setnp %cl
+    andb %cl, %al
+    .endif
+    .ifc \parity,unordered
+    setp %cl
+    orb %cl, %al
+    .endif
+    movzbl %al, %eax
+    movl %eax, -16(%r12,%r13,8)
+    movl $0, -12(%r12,%r13,8)
+    decl %r13d
+    .endm
+
+    .macro vsm_add
+    generic 0, .Ld\@
+    int_arith addl
+.Ld\@:
+    .endm
+    .macro vsm_sub
+    generic 1, .Ld\@
+    int_arith subl
+.Ld\@:
+    .endm
+    .macro vsm_mul
+    generic 2, .Ld\@
+    int_arith imull
+.Ld\@:
+    .endm
+    .macro vsm_div
+    generic 3, .Ld\@
+    int_divide %eax
+.Ld\@:
+    .endm
+    .macro vsm_rem
+    generic 4, .Ld\@
+    int_divide %edx
+.Ld\@:
+    .endm
+    .macro vsm_eq
+    generic 5, .Ld\@
+    int_compare sete
+.Ld\@:
+    .endm
+    .macro vsm_ne
+    generic 6, .Ld\@
+    int_compare setne
+.Ld\@:
+    .endm
+    .macro vsm_le
+    generic 7, .Ld\@
+    int_compare setle
+.Ld\@:
+    .endm
+    .macro vsm_ge
+    generic 8, .Ld\@
+    int_compare setge
+.Ld\@:
+    .endm
+    .macro vsm_lt
+    generic 9, .Ld\@
+    int_compare setl
+.Ld\@:
+    .endm
+    .macro vsm_gt
+    generic 10, .Ld\@
+    int_compare setg
+.Ld\@:
+    .endm
+
+    .macro vsm_addll first, second
+    vsm_loadl \first
+    vsm_loadl \second
+    vsm_add
+    .endm
+
+    .macro vsm_iadd
+    int_arith addl
+    .endm
+    .macro vsm_isub
+    int_arith subl
+    .endm
+    .macro vsm_imul
+    int_arith imull
+    .endm
+    .macro vsm_idiv
+    int_divide %eax
+    .endm
+    .macro vsm_fadd
+    float_arith addss
+    .endm
+    .macro vsm_fsub
+    float_arith subss
+    .endm
+    .macro vsm_fmul
+    float_arith mulss
+    .endm
+    .macro vsm_fdiv
+    float_arith divss
+    .endm
+    .macro vsm_ieq
+    int_compare sete
+    .endm
+    .macro vsm_ine
+    int_compare setne
+    .endm
+    .macro vsm_ile
+    int_compare setle
+    .endm
+    .macro vsm_ige
+    int_compare setge
+    .endm
+    .macro vsm_ilt
+    int_compare setl
+    .endm
+    .macro vsm_igt
+    int_compare setg
+    .endm
+    .macro vsm_feq
+    float_compare sete, 0, ordered
+    .endm
+    .macro vsm_fne
+    float_compare setne, 0, unordered
+    .endm
+    .macro vsm_fle
+    float_compare setae, 1
+    .endm
+    .macro vsm_fge
+    float_compare setae
+    .endm
+    .macro vsm_flt
+    float_compare seta, 1
+    .endm
+    .macro vsm_fgt
+    float_compare seta
+    .endm
+
+    .macro vsm_int
+    cmpl $0, -4(%r12,%r13,8)
+    je .Ld\@
+    cvttss2si -8(%r12,%r13,8), %eax
+    movl %eax, -8(%r12,%r13,8)
+    movl $0, -4(%r12,%r13,8)
+.Ld\@:
+    .endm
+
+    .macro vsm_float
+    cmpl $0, -4(%r12,%r13,8)
+    jne .Ld\@
+    cvtsi2ssl -8(%r12,%r13,8), %xmm0
+    movss %xmm0, -8(%r12,%r13,8)
+    movl $1, -4(%r12,%r13,8)
+.Ld\@:
+    .endm
+
+    # Pops the top value and jumps to target if it is not 0 (true=1) or if it is 0 (true=0)
+    .macro branch target, true
+    decl %r13d
+    cmpl $0, 4(%r12,%r13,8)
+    je .Li\@
+    movss (%r12,%r13,8), %xmm0
+    xorps %xmm1, %xmm1
+    ucomiss %xmm1, %xmm0
+    .if \true
+    jp \target
+    jne \target
+    .else
+    jp .Ld\@
+    je \target
+    .endif
+    jmp .Ld\@
+.Li\@:
+    cmpl $0, (%r12,%r13,8)
+    .if \true
+    jne \target
+    .else
+    je \target
+    .endif
+.Ld\@:
+    .endm
+
+    .macro vsm_brt target
+    branch \target, 1
+    .endm
+    .macro vsm_brz target
+    branch \target, 0
+    .endm
+
+    # Same frame as s.exe: the saved stack pointer and return address go above the
+    # parameters; the native return address is on %rsp
+    .macro vsm_call target, numParams, returnAddress
+    leal 1(%r13), %r15d
+    reserve %r15d
+    movl %r14d, (%r12,%r13,8)
+    movl $0, 4(%r12,%r13,8)
+    movl $\returnAddress, 8(%r12,%r13,8)
+    movl $0, 12(%r12,%r13,8)
+    leal -\numParams(%r13), %r14d
+    addl $2, %r13d
+    call \target
+    .endm
+
+    # The callee takes over the frame: the arguments move over the parameters and the
+    # frame header behind them, and the callee returns to this function's caller
+    .macro vsm_tailcall target, numParams, frameParams
+    movq 8*\frameParams(%r12,%r14,8), %r8
+    movq 8*\frameParams+8(%r12,%r14,8), %r9
+    leal -\numParams(%r13), %eax
+    movl %r14d, %ecx
+    movl $\numParams, %edx
+.Lt\@:
+    testl %edx, %edx
+    jle .Lu\@
+    movq (%r12,%rax,8), %rsi
+    movq %rsi, (%r12,%rcx,8)
+    incl %eax
+    incl %ecx
+    decl %edx
+    jmp .Lt\@
+.Lu\@:
+    movq %r8, (%r12,%rcx,8)
+    movq %r9, 8(%r12,%rcx,8)
+    leal 2(%rcx), %r13d
+    jmp \target
+    .endm
+
+    # Restores the caller's stack top and stack pointer from the frame header
+    .macro pop_frame numParams
+    movl %r14d, %r13d
+    movl 8*\numParams(%r12,%r14,8), %r14d
+    .endm
+
+    .macro vsm_ret numParams
+    pop_frame \numParams
+    ret
+    .endm
+
+    .macro vsm_retv numParams
+    movq -8(%r12,%r13,8), %r8
+    pop_frame \numParams
+    movq %r8, (%r12,%r13,8)
+    incl %r13d
+    ret
+    .endm
+
+    .macro vsm_print
+    leaq -8(%r12,%r13,8), %rdi
+    ccall vsm_print_value
+    .endm
+
+    .macro vsm_print_s label
+    leaq \label(%rip), %rdi
+    ccall vsm_print_string
+    .endm
+
+    .macro vsm_read
+    ccall vsm_read_int
+    movl %eax, %r15d
+    reserve %r13d
+    movl %r15d, (%r12,%r13,8)
+    movl $0, 4(%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_readf
+    ccall vsm_read_float
+    movd %xmm0, %r15d
+    reserve %r13d
+    movl %r15d, (%r12,%r13,8)
+    movl $1, 4(%r12,%r13,8)
+    incl %r13d
+    .endm
+
+    .macro vsm_end
+    ccall vsm_end
+    .endm
+
+    # Vector instructions run in the runtime, which may grow memory
+    .macro vsm_vector record
+    movl %r13d, %edi
+    movl %r14d, %esi
+    leaq \record(%rip), %rdx
+    ccall vsm_vector
+    movl %eax, %r13d
+    movq vsm_memory(%rip), %r12
+    .endm
+
+    .macro vsm_vmap record
+    movl %r13d, %edi
+    movl %r14d, %esi
+    leaq \record(%rip), %rdx
+    ccall vsm_map
+    movl %eax, %r13d
+    movq vsm_memory(%rip), %r12
+    .endm
+
+    .macro vsm_reduce record
+    movl %r13d, %edi
+    movl %r14d, %esi
+    leaq \record(%rip), %rdx
+    ccall vsm_reduce
+    movl %eax, %r13d
+    movq vsm_memory(%rip), %r12
+    .endm
+
+    # Whole-array input and output run in the runtime, which may grow memory
+    .macro vsm_vread record
+    movl %r13d, %edi
+    movl %r14d, %esi
+    leaq \record(%rip), %rdx
+    ccall vsm_vread
+    movl %eax, %r13d
+    movq vsm_memory(%rip), %r12
+    .endm
+
+    .macro vsm_vprint record
+    movl %r14d, %edi
+    leaq \record(%rip), %rsi
+    ccall vsm_vprint
+    movq vsm_memory(%rip), %r12
+    .endm
+
+    # Heap arrays are allocated in the runtime, which may grow memory to store the handle
+    .macro vsm_halloc slot, length
+    movl %r13d, %edi
+    movl %r14d, %esi
+    movl $\slot, %edx
+    movl $\length, %ecx
+    ccall vsm_halloc
+    movl %eax, %r13d
+    movq vsm_memory(%rip), %r12
+    .endm
+
+    .macro vsm_hfree slot
+    leal \slot(%r14), %r15d
+    reserve %r15d
+    movl (%r12,%r15,8), %edi
+    ccall vsm_hfree
+    .endm
+
+    # Element index on top of stack, checked against the length of the heap array whose handle is in frame
+    # slot; its heap index, checked against the top of the heap, in %r15d and the heap base in %rax
+    .macro heap_index slot, length
+    movl -8(%r12,%r13,8), %r15d
+    cmpl $\length, %r15d
+    jb .Li\@
+    movl %r15d, %edi
+    movl $\length, %esi
+    ccall vsm_heap_index_error
+.Li\@:
+    leal \slot(%r14), %eax
+    addl (%r12,%rax,8), %r15d
+    cmpl vsm_heap_top(%rip), %r15d
+    jb .Lh\@
+    movl %r15d, %edi
+    ccall vsm_heap_error
+.Lh\@:
+    movq vsm_heap(%rip), %rax
+    .endm
+
+    .macro vsm_hload slot, length
+    heap_index \slot, \length
+    movq (%rax,%r15,8), %rax
+    movq %rax, -8(%r12,%r13,8)
+    .endm
+
+    .macro vsm_hstore slot, length
+    heap_index \slot, \length
+    movq -16(%r12,%r13,8), %rcx
+    movq %rcx, (%rax,%r15,8)
+    subl $2, %r13d
+    .endm
+
+    # %rsp at the start of the program, restored when it runs off its end
+    .local vsm_exit_stack
+    .comm vsm_exit_stack, 8, 8
+
+    # Entry point called by nativeRuntime.cpp; returns when the program runs off its end
+    .globl vsm_run
+    .type vsm_run, @function
+vsm_run:
+    pushq %rbx
+    pushq %rbp
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    movq vsm_memory(%rip), %r12
+    xorl %r13d, %r13d
+    xorl %r14d, %r14d
+    call .Lvsm_program
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbp
+    popq %rbx
+    ret
+
+.Lvsm_program:
+    movq %rsp, vsm_exit_stack(%rip)
+)PRELUDE";
+
+// Translate instructions to GNU assembler source for x86-64 Linux
+// Link the output with nativeRuntime.cpp, which provides memory, input and output
+// Memory and frames are laid out as in s.exe, so programs behave the same natively
+std::vector<std::string> CodeGenerator::getAsmCode() const {
+    std::vector<std::string> code;
+    code.push_back("# Generated by the C- compiler; link with nativeRuntime.cpp");
+    std::istringstream prelude(ASM_PRELUDE);
+    std::string line;
+    while (std::getline(prelude, line)) {
+        code.push_back(line);
+    }
+
+    std::vector<std::string> strings; // PRINT messages, emitted as .Lvsm_string<index>
+    std::vector<std::string> vectors; // Vector instruction operands, emitted as .Lvsm_vector<index>
+    std::vector<std::string> maps; // VMAP records, emitted as .Lvsm_map<index>
+    std::vector<std::string> reductions; // Reduction operands, emitted as .Lvsm_reduce<index>
+    std::vector<std::string> ios; // VREAD and VPRINT operands, emitted as .Lvsm_io<index>
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& instr = instructions[i];
+        const std::string& arg = instr.arg;
+        std::string s;
+        switch (instr.op) {
+            case OpCode::LABEL:
+                code.push_back(cppName(".Lvsm_", arg) + ":");
+                continue;
+            case OpCode::CALL:
+                if (arg.empty() || instr.numParams < 0) {
+                    s = "vsm_end # CALL without a label is not supported";
+                } else {
+                    s = "vsm_call " + cppName(".Lvsm_", arg) + ", " + std::to_string(instr.numParams) + ", " + std::to_string(i + 1);
+                }
+                break;
+            case OpCode::TAILCALL:
+                s = "vsm_tailcall " + cppName(".Lvsm_", arg) + ", " + std::to_string(instr.numParams) + ", " + std::to_string(instr.frameParams);
+                break;
+            case OpCode::RET: s = "vsm_ret " + std::to_string(instr.numParams); break;
+            case OpCode::RETV: s = "vsm_retv " + std::to_string(instr.numParams); break;
+            case OpCode::PUSH:
+                if (arg.empty()) {
+                    s = "vsm_push";
+                } else if (arg.find_first_of(".eEnNiI") == std::string::npos) {
+                    s = "vsm_push_i " + std::to_string((int32_t) std::stoll(arg));
+                } else {
+                    float value = std::stof(arg);
+                    uint32_t bits;
+                    memcpy(&bits, &value, sizeof(bits));
+                    s = "vsm_push_f " + std::to_string(bits) + " # " + arg;
+                }
+                break;
+            case OpCode::LOADL: s = "vsm_loadl " + arg; break;
+            case OpCode::STOREL: s = "vsm_storel " + arg; break;
+            case OpCode::ADDLL: s = "vsm_addll " + arg; break;
+            case OpCode::HALLOC: s = "vsm_halloc " + arg; break;
+            case OpCode::HFREE: s = "vsm_hfree " + arg; break;
+            case OpCode::HLOAD: s = "vsm_hload " + arg; break;
+            case OpCode::HSTORE: s = "vsm_hstore " + arg; break;
+            case OpCode::BRT: s = "vsm_brt " + cppName(".Lvsm_", arg); break;
+            case OpCode::BRZ: s = "vsm_brz " + cppName(".Lvsm_", arg); break;
+            case OpCode::JUMP: s = "jmp " + cppName(".Lvsm_", arg); break;
+            case OpCode::PRINT:
+                if (arg.empty()) {
+                    s = "vsm_print";
+                } else {
+                    s = "vsm_print_s .Lvsm_string" + std::to_string(strings.size());
+                    strings.push_back(arg);
+                }
+                break;
+            case OpCode::NE: s = "vsm_ne"; break; // getOpString() gives NEQ
+            case OpCode::VADDS: case OpCode::VSUBS: case OpCode::VMULS: case OpCode::VDIVS: case OpCode::VREMS:
+                s = "vsm_vector .Lvsm_vector" + std::to_string(vectors.size());
+                {
+                    size_t sources = arg.find(',', arg.find(',') + 1); // End of destination and source
+                    vectors.push_back(std::to_string((int) instr.op - (int) OpCode::VADDS) + ", " + arg.substr(0, sources) + ",0" + arg.substr(sources));
+                }
+                break;
+            case OpCode::VADDV: case OpCode::VSUBV: case OpCode::VMULV: case OpCode::VDIVV: case OpCode::VREMV:
+                s = "vsm_vector .Lvsm_vector" + std::to_string(vectors.size());
+                vectors.push_back(std::to_string(5 + (int) instr.op - (int) OpCode::VADDV) + ", " + arg);
+                break;
+            case OpCode::VMAP:
+                s = "vsm_vmap .Lvsm_map" + std::to_string(maps.size());
+                maps.push_back(vmapRecord(arg));
+                break;
+            case OpCode::VSUM: case OpCode::VMIN: case OpCode::VMAX: case OpCode::VDOT:
+                s = "vsm_reduce .Lvsm_reduce" + std::to_string(reductions.size());
+                reductions.push_back(std::to_string((int) instr.op - (int) OpCode::VSUM) + ", " + reduceRecord(instr.op, arg));
+                break;
+            case OpCode::VREAD: case OpCode::VPRINT:
+                s = std::string(instr.op == OpCode::VREAD ? "vsm_vread" : "vsm_vprint") + " .Lvsm_io" + std::to_string(ios.size());
+                ios.push_back(instr.op == OpCode::VREAD ? arg : arg + ",0");
+                break;
+            default: {
+                s = "vsm_" + getOpString(instr.op);
+                for (char& c : s) c = (char) tolower((unsigned char) c);
+                break;
+            }
+        }
+        code.push_back("    " + s);
+    }
+
+    // Running off the end stops the program, wherever it is
+    code.push_back("    movq vsm_exit_stack(%rip), %rsp");
+    code.push_back("    ret");
+    code.push_back("");
+
+    code.push_back("    .section .rodata");
+    for (size_t i = 0; i < strings.size(); i++) {
+        std::string literal = cppString(strings[i]); // Same escapes work in .string
+        code.push_back(".Lvsm_string" + std::to_string(i) + ":");
+        code.push_back("    .string " + literal);
+    }
+    code.push_back("    .balign 4");
+    for (size_t i = 0; i < vectors.size(); i++) {
+        code.push_back(".Lvsm_vector" + std::to_string(i) + ":");
+        code.push_back("    .long " + vectors[i]); // Operation, destination, source, second source, length, flags
+    }
+    for (size_t i = 0; i < maps.size(); i++) {
+        code.push_back(".Lvsm_map" + std::to_string(i) + ":");
+        code.push_back("    .long " + maps[i]);
+    }
+    for (size_t i = 0; i < reductions.size(); i++) {
+        code.push_back(".Lvsm_reduce" + std::to_string(i) + ":");
+        code.push_back("    .long " + reductions[i]); // Operation, source, second source, length
+    }
+    for (size_t i = 0; i < ios.size(); i++) {
+        code.push_back(".Lvsm_io" + std::to_string(i) + ":");
+        code.push_back("    .long " + ios[i]); // Array, length, flags
+    }
+    code.push_back("    .section .note.GNU-stack,\"\",@progbits");
+    return code;
+}
+
 // Writes stack machine code to file
 void CodeGenerator::printStackMachineCodeToFile(std::string filename, std::vector<std::string> code) {
     // Writing to file
     std::ofstream file(filename);
     for (std::string s : code) file << s << std::endl;
     file.close();
+}
+// Writes stack machine code to a binary .vsmb file
+// Decodes the same text getCode() produces, so .vsm and .vsmb always agree
+bool CodeGenerator::printBytecodeToFile(std::string filename) const {
+    Bytecode bytecode;
+    if (!bytecode.assemble(getCode())) {
+        return false;
+    }
+    return bytecode.writeFile(filename);
 }
\ No newline at end of file
@@ -12,7 +12,7 @@ class SymbolTable;
 
 // Stack machine instruction opcodes
 enum class OpCode {
-    CALL, RET, RETV, // Call and return
+    CALL, RET, RETV, TAILCALL, // Call and return
     PUSH, POP, // Add, remove from stack top
     DUP, // Duplicate
     LOAD, SAVE, STORE, // Add, remove from stack 
@@ -22,6 +22,15 @@ enum class OpCode {
     PRINT, READ, READF, // IO operations - added READF for float input
     LABEL, // Labels
     INT, FLOAT, // Type conversion operations
+    LOADL, STOREL, ADDLL, // Frame access superinstructions
+    IADD, ISUB, IMUL, IDIV, FADD, FSUB, FMUL, FDIV, // Typed arithmetic
+    IEQ, INE, ILE, IGE, ILT, IGT, FEQ, FNE, FLE, FGE, FLT, FGT, // Typed comparisons
+    VADDS, VSUBS, VMULS, VDIVS, VREMS, // Whole-array arithmetic with a scalar
+    VADDV, VSUBV, VMULV, VDIVV, VREMV, // Whole-array arithmetic on two arrays
+    VMAP, // Whole-array expression
+    VSUM, VMIN, VMAX, VDOT, // Whole-array reductions
+    HALLOC, HFREE, HLOAD, HSTORE, // Heap arrays
+    VREAD, VPRINT, // Whole-array input and output
     END // End program
 };
 
@@ -29,8 +38,23 @@ enum class OpCode {
 struct Instruction {
     OpCode op;
     std::string arg;  // Could be a value, variable name, or label
+    int numParams;    // CALL, RET, RETV and TAILCALL: parameters of the callee, -1 when the count is on the stack instead
+    int frameParams;  // TAILCALL: parameters of the function whose frame the callee takes over
 
-    Instruction(OpCode op, const std::string& arg = "") : op(op), arg(arg) {}
+    Instruction(OpCode op, const std::string& arg = "", int numParams = -1, int frameParams = -1)
+        : op(op), arg(arg), numParams(numParams), frameParams(frameParams) {}
+};
+
+// Slots CALL places between a function's parameters and its locals: the saved stack pointer and return address
+const int FRAME_HEADER_SIZE = 2;
+
+// Static type of an expression; UNKNOWN when the compiler cannot tell, which keeps generic opcodes
+enum class ValueType { INT, FLOAT, UNKNOWN };
+
+// Return and parameter types of a function, used to convert arguments and return values
+struct FunctionInfo {
+    ValueType returnType; // UNKNOWN for void
+    std::vector<ValueType> paramTypes; // UNKNOWN for array parameters
 };
 
 // Structure to track variable information for the stack machine
@@ -39,6 +63,16 @@ struct VariableInfo {
     bool isArray;     // Whether this is an array variable
     int arraySize;    // Size of the array (if isArray is true)
     bool isFloat;     // Whether this is a float variable
+    bool onHeap;      // Whether the array lives in the heap; stackOffset is then the slot of its handle
+};
+
+// Postfix steps of an array operation, as in a VMAP record
+struct ArraySteps {
+    std::vector<int32_t> steps; // Kind and value pairs
+    int scalars;  // Scalar steps, whose values are left on the stack
+    int length;   // Elements of the shortest array used
+    int depth;    // Values the steps leave
+    int maxDepth; // Most values held at once
 };
 
 class CodeGenerator {
@@ -53,6 +87,12 @@ private:
     std::unordered_map<std::string, VariableInfo> frameVariables; // Could (Should?) be part of symbol table
     int localVarCount;  // Counter for local variables in the current function frame
 
+    std::unordered_map<std::string, FunctionInfo> functions; // Signatures of every function in the program
+    ValueType currentReturnType; // Return type of the function being generated
+    int currentParamCount; // Parameters of the function being generated, which its RET and RETV skip to find the frame header
+    std::string currentFunction; // Name of the function being generated
+    std::vector<VariableInfo> heapArrays; // Heap arrays of the function being generated, in the order they are allocated
+
     // Helper methods
     std::string generateLabel();
     std::string getOpString(OpCode op) const;
@@ -66,6 +106,45 @@ private:
     // Checks if a variable is a float type
     bool isVariableFloat(const std::string& varName);
 
+    // Emit frame access as superinstructions
+    void emitLoadLocal(int offset);
+    void emitStoreLocal(int offset);
+    void emitAdd(ValueType type = ValueType::UNKNOWN);
+
+    // Array operand of a vector instruction for an array of the frame or the heap
+    static int arrayOperand(const VariableInfo& info);
+
+    // Pops a value into element index of an array, as emitStoreLocal() does for frame arrays
+    void emitStoreElement(const VariableInfo& info, int index);
+
+    // Operands of HLOAD and HSTORE for a heap array: the slot of its handle and its length
+    static std::string heapRecord(const VariableInfo& info);
+
+    // Sets every element of an array to 0; heap arrays take one VMAP instead of a store per element
+    void emitZeroFill(const VariableInfo& info);
+
+    // Type inference: returns the type of the value an expression node leaves on the stack
+    ValueType getExpressionType(ASTNode* node);
+    ValueType getVariableType(const std::string& varName);
+    static ValueType combineTypes(ValueType left, ValueType right);
+
+    // Records the signature of every function before any code is generated
+    void collectFunctions(ASTNode* node);
+
+    // Emit conversions and typed opcodes; generic opcodes are kept for UNKNOWN types
+    void emitConversion(ValueType from, ValueType to);
+    void emitTypedOp(OpCode op, ValueType type);
+
+    // Checks if an expression uses an array of the frame without an index, outside of indices and call arguments
+    bool hasWholeArray(ASTNode* node);
+
+    // Checks if a call is to a builtin (sum, min, max or dot) rather than to a function of the program
+    bool isBuiltinCall(ASTNode* node);
+
+    // Appends the steps of an array operation; parts without whole arrays are evaluated onto the stack
+    // Returns false after printing an error if the expression cannot be worked out element by element
+    bool generateArraySteps(ASTNode* node, ArraySteps& out);
+
 
 public:
     CodeGenerator(SymbolTable& st);
@@ -102,6 +181,8 @@ public:
     void generateTerm(ASTNode* node);
     void generateFactor(ASTNode* node);
     void generateCall(ASTNode* node);
+    int generateCallArguments(ASTNode* node);           // Returns the callee's number of parameters
+    void generateBuiltinCall(ASTNode* node);
     void generateArgs(ASTNode* node);                   // 31   // Empty function
     void generateArgList(ASTNode* node);                       // Empty function
     void generateArrayInitExpression(ASTNode* node, const std::string& arrayName);
@@ -118,8 +199,17 @@ public:
     // Convert instructions to text
     std::vector<std::string> getCode() const;
 
+    // Translate instructions to a standalone C++ program, one C++ function per function
+    std::vector<std::string> getCppCode() const;
+
+    // Translate instructions to GNU assembler source for x86-64 Linux, linked with nativeRuntime.cpp
+    std::vector<std::string> getAsmCode() const;
+
     // Print the generated code to a file
     void printStackMachineCodeToFile(std::string filename, std::vector<std::string> code);
+
+    // Write the generated code to a binary .vsmb file; returns false on failure
+    bool printBytecodeToFile(std::string filename) const;
 };
 
 #endif // CODE_GENERATOR_H
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "inputReader.h"
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define read _read
+#define close _close
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+InputReader::InputReader()
+    : fd(0), ownsFd(false), buffer(INPUT_BLOCK_SIZE), position(0), end(0), failed(false), interactive(isStream(0)) {}
+
+InputReader::~InputReader() {
+    if (ownsFd) {
+        close(fd);
+    }
+}
+
+bool InputReader::open(const std::string& filename) {
+#ifdef _WIN32
+    int opened = _open(filename.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    int opened = ::open(filename.c_str(), O_RDONLY);
+#endif
+    if (opened < 0) {
+        return false;
+    }
+    if (ownsFd) {
+        close(fd);
+    }
+    fd = opened;
+    ownsFd = true;
+    interactive = isStream(fd);
+    position = 0;
+    end = 0;
+    failed = false;
+    return true;
+}
+
+void InputReader::openEmpty() {
+    if (ownsFd) {
+        close(fd);
+    }
+    fd = -1;
+    ownsFd = false;
+    interactive = false;
+    position = 0;
+    end = 0;
+    failed = false;
+}
+
+bool InputReader::isStream(int fd) {
+    struct stat info;
+    return fstat(fd, &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG;
+}
+
+bool InputReader::fill() {
+    if (fd < 0) {
+        return false;
+    }
+    long got;
+    do {
+        got = (long) read(fd, buffer.data(), (unsigned) buffer.size());
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) {
+        return false;
+    }
+    position = 0;
+    end = (size_t) got;
+    return true;
+}
+
+void InputReader::skipWhitespace() {
+    for (;;) {
+        while (position < end) {
+            if (!std::isspace((unsigned char) buffer[position])) {
+                return;
+            }
+            position++;
+        }
+        if (!fill()) {
+            return;
+        }
+    }
+}
+
+int InputReader::scanDigits(std::string& token) {
+    int count = 0;
+    for (int c = peek(); c >= '0' && c <= '9'; c = peek()) {
+        token += (char) c;
+        position++;
+        count++;
+    }
+    return count;
+}
+
+int32_t InputReader::readInt() {
+    if (failed) {
+        return 0;
+    }
+    skipWhitespace();
+    bool negative = false;
+    int c = peek();
+    if (c == '-' || c == '+') {
+        negative = c == '-';
+        position++;
+        c = peek();
+    }
+    if (c < '0' || c > '9') {
+        failed = true;
+        return 0;
+    }
+
+    // Accumulating the magnitude in 64 bits; out of range values are clamped, as std::cin does
+    int64_t magnitude = 0;
+    for (; c >= '0' && c <= '9'; c = peek()) {
+        if (magnitude <= (int64_t) INT_MAX + 1) {
+            magnitude = magnitude * 10 + (c - '0');
+        }
+        position++;
+    }
+    int64_t value = negative ? -magnitude : magnitude;
+    if (value > INT_MAX) {
+        failed = true;
+        return INT_MAX;
+    }
+    if (value < INT_MIN) {
+        failed = true;
+        return INT_MIN;
+    }
+    return (int32_t) value;
+}
+
+float InputReader::readFloat() {
+    if (failed) {
+        return 0.0f;
+    }
+    skipWhitespace();
+
+    // Scanning sign, digits, fraction and exponent, then converting the token with correct rounding
+    std::string token;
+    int c = peek();
+    if (c == '-' || c == '+') {
+        token += (char) c;
+        position++;
+    }
+    int digits = scanDigits(token);
+    if (peek() == '.') {
+        token += '.';
+        position++;
+        digits += scanDigits(token);
+    }
+    if (digits == 0) {
+        failed = true;
+        return 0.0f;
+    }
+    c = peek();
+    if (c == 'e' || c == 'E') {
+        token += (char) c;
+        position++;
+        c = peek();
+        if (c == '-' || c == '+') {
+            token += (char) c;
+            position++;
+        }
+        if (scanDigits(token) == 0) {
+            failed = true;
+            return 0.0f;
+        }
+    }
+    return std::strtof(token.c_str(), nullptr);
+}
@@ -0,0 +1,72 @@
+#ifndef INPUT_READER_H
+#define INPUT_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Bytes read from the input at a time */
+const size_t INPUT_BLOCK_SIZE = 1024 * 1024;
+
+/* Source of the numbers READ and READF take: stdin, or a file given with --input */
+/* Input is read in large blocks and numbers are scanned by hand instead of through std::cin */
+/* A block read returns as soon as a line is typed, so interactive input works as before */
+class InputReader {
+public:
+    /* Reads stdin */
+    InputReader();
+    ~InputReader();
+
+    InputReader(const InputReader&) = delete;
+    InputReader& operator=(const InputReader&) = delete;
+
+    /* Reads filename instead of stdin, returns false if it could not be opened */
+    bool open(const std::string& filename);
+
+    /* Stops reading: every later read returns 0, as at the end of input */
+    void openEmpty();
+
+    /* Reads a decimal int after any whitespace, like std::cin >> int */
+    /* Returns 0 once input is missing or not a number; every later read returns 0 as well */
+    int32_t readInt();
+
+    /* Reads a float after any whitespace, like std::cin >> float, with the same failure rules as readInt */
+    float readFloat();
+
+    /* Returns false when input comes from a regular file, so nobody waits for a prompt before typing it */
+    bool isInteractive() const {
+        return interactive;
+    }
+
+private:
+    int fd; // File descriptor read from, -1 once closed
+    bool ownsFd; // Whether fd was opened by open() and must be closed
+    std::vector<char> buffer;
+    size_t position; // Next unread byte in buffer
+    size_t end; // Bytes of buffer holding input
+    bool failed; // Set by a missing or invalid number
+    bool interactive; // Whether fd is a terminal or pipe rather than a regular file
+
+    /* Returns true unless fd is a regular file */
+    static bool isStream(int fd);
+
+    /* Reads the next block, returns false at the end of input */
+    bool fill();
+
+    /* Returns the next byte without consuming it, -1 at the end of input */
+    int peek() {
+        if (position == end && !fill()) {
+            return -1;
+        }
+        return (unsigned char) buffer[position];
+    }
+
+    /* Skips spaces, tabs and newlines */
+    void skipWhitespace();
+
+    /* Appends digits to token, returns how many there were */
+    int scanDigits(std::string& token);
+};
+
+#endif // INPUT_READER_H
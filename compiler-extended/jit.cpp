@@ -0,0 +1,608 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+
+#if VSM_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+/* Size of the executable buffer; functions that do not fit stay interpreted */
+const size_t JIT_CODE_SIZE = 16 * 1024 * 1024;
+
+/* Size of one memory slot and the offset of its tag, as laid out by the interpreter */
+const int SLOT = 8;
+const int TAG = 4;
+
+/* x86-64 registers */
+enum Reg { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+           R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+/* Condition codes for jcc and setcc */
+enum Cond { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+/* Registers compiled code keeps the machine state in; all callee-saved */
+const Reg CONTEXT = RBX; // JitContext*
+const Reg MEMORY = R12; // First memory slot
+const Reg TOP = R13; // stackTop
+const Reg FRAME = R14; // stackPointer
+
+/* Memory operand [base + index * 8 + disp]; index is -1 for [base + disp] */
+struct Mem {
+    int base;
+    int index;
+    int32_t disp;
+};
+
+/* Returns operand for slot stackTop + k */
+Mem top(int k, int offset = 0) {
+    return Mem{MEMORY, TOP, k * SLOT + offset};
+}
+
+/* Returns operand for a JitContext field */
+Mem field(size_t offset) {
+    return Mem{CONTEXT, -1, (int32_t) offset};
+}
+
+/* Encodes the handful of instructions the JIT needs */
+/* Memory operands always use a SIB byte and a 32-bit displacement, which works for every base register */
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    size_t size() const { return code.size(); }
+    void byte(uint8_t b) { code.push_back(b); }
+    void dword(int32_t d) { for (int i = 0; i < 4; i++) byte((uint8_t) ((uint32_t) d >> (8 * i))); }
+    void qword(uint64_t q) { for (int i = 0; i < 8; i++) byte((uint8_t) (q >> (8 * i))); }
+
+    /* Patches the rel32 at pos to reach target, both offsets into code */
+    void patch(size_t pos, size_t target) {
+        int32_t rel = (int32_t) ((int64_t) target - (int64_t) (pos + 4));
+        std::memcpy(&code[pos], &rel, 4);
+    }
+
+    // op reg, [mem] and op [mem], reg
+    void opMem(std::initializer_list<uint8_t> opcode, int reg, Mem m, bool wide = false) {
+        rex(wide, reg, m.index < 0 ? 0 : m.index, m.base);
+        for (uint8_t b : opcode) byte(b);
+        byte((uint8_t) (0x80 | ((reg & 7) << 3) | 4));
+        if (m.index < 0) {
+            byte((uint8_t) ((4 << 3) | (m.base & 7)));
+        } else {
+            byte((uint8_t) ((3 << 6) | ((m.index & 7) << 3) | (m.base & 7)));
+        }
+        dword(m.disp);
+    }
+
+    // op reg, rm with both in registers
+    void opReg(std::initializer_list<uint8_t> opcode, int reg, int rm, bool wide = false) {
+        rex(wide, reg, 0, rm);
+        for (uint8_t b : opcode) byte(b);
+        byte((uint8_t) (0xC0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    void load32(int reg, Mem m) { opMem({0x8B}, reg, m); }
+    void load64(int reg, Mem m) { opMem({0x8B}, reg, m, true); }
+    void store32(Mem m, int reg) { opMem({0x89}, reg, m); }
+    void store64(Mem m, int reg) { opMem({0x89}, reg, m, true); }
+    void lea32(int reg, Mem m) { opMem({0x8D}, reg, m); }
+    void add32(int reg, Mem m) { opMem({0x03}, reg, m); }
+    void or32(int reg, Mem m) { opMem({0x0B}, reg, m); }
+    void cmp32(int reg, Mem m) { opMem({0x3B}, reg, m); }
+    void idiv32(Mem m) { opMem({0xF7}, 7, m); }
+    void cmpImm8(Mem m, int8_t imm) { opMem({0x83}, 7, m); byte((uint8_t) imm); }
+    void storeImm32(Mem m, int32_t imm) { opMem({0xC7}, 0, m); dword(imm); }
+
+    void mov32(int dst, int src) { opReg({0x89}, src, dst); }
+    void add32(int dst, int src) { opReg({0x01}, src, dst); }
+    void sub32(int dst, int src) { opReg({0x29}, src, dst); }
+    void cmp32(int a, int b) { opReg({0x39}, b, a); }
+    void test32(int a, int b) { opReg({0x85}, b, a); }
+    void test64(int a, int b) { opReg({0x85}, b, a, true); }
+    void addImm32(int reg, int32_t imm) { opReg({0x81}, 0, reg); dword(imm); }
+    void cmpImm32(int reg, int32_t imm) { opReg({0x81}, 7, reg); dword(imm); }
+
+    void movImm32(int reg, int32_t imm) { rex(false, 0, 0, reg); byte((uint8_t) (0xB8 + (reg & 7))); dword(imm); }
+    void movImm64(int reg, uint64_t imm) { rex(true, 0, 0, reg); byte((uint8_t) (0xB8 + (reg & 7))); qword(imm); }
+
+    void cdq() { byte(0x99); }
+    void setccAl(Cond cc) { byte(0x0F); byte((uint8_t) (0x90 + cc)); byte(0xC0); } // setcc al
+    void movzxEaxAl() { byte(0x0F); byte(0xB6); byte(0xC0); }
+    void push(int reg) { rex(false, 0, 0, reg); byte((uint8_t) (0x50 + (reg & 7))); }
+    void pop(int reg) { rex(false, 0, 0, reg); byte((uint8_t) (0x58 + (reg & 7))); }
+    void ret() { byte(0xC3); }
+    void jmpReg(int reg) { opReg({0xFF}, 4, reg); }
+
+    /* Jumps return the position of their rel32 for patching */
+    size_t jmp() { byte(0xE9); dword(0); return size() - 4; }
+    size_t jcc(Cond cc) { byte(0x0F); byte((uint8_t) (0x80 + cc)); dword(0); return size() - 4; }
+
+private:
+    void rex(bool wide, int reg, int index, int base) {
+        uint8_t r = (uint8_t) (0x40 | (wide << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((base >> 3) & 1));
+        if (r != 0x40) byte(r);
+    }
+};
+
+}
+
+Jit::Jit(const BytecodeView& program)
+    : program(program), entries(program.codeCount, nullptr), functionsCompiled(0),
+      codeBase(nullptr), codeSize(0), codeUsed(0), exitStub(nullptr) {
+    // Functions start at instruction 0, at every CALL target and at main, which the first instruction jumps to
+    functionStarts.push_back(0);
+    if (program.codeCount > 0 && program.code[0].op == Op::JUMP_I && program.code[0].iArg >= 0
+        && (uint32_t) program.code[0].iArg < program.codeCount) {
+        functionStarts.push_back(program.code[0].iArg);
+    }
+    for (uint32_t i = 0; i < program.codeCount; i++) {
+        const DecodedInstruction& instr = program.code[i];
+        if ((instr.op == Op::CALL_I || instr.op == Op::CALL_N || instr.op == Op::TAILCALL) && instr.iArg >= 0 && (uint32_t) instr.iArg < program.codeCount) {
+            functionStarts.push_back(instr.iArg);
+        }
+    }
+    std::sort(functionStarts.begin(), functionStarts.end());
+    functionStarts.erase(std::unique(functionStarts.begin(), functionStarts.end()), functionStarts.end());
+    compiled.assign(functionStarts.size(), false);
+
+#if VSM_JIT_SUPPORTED
+    void* buffer = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        return;
+    }
+    codeBase = static_cast<uint8_t*>(buffer);
+    codeSize = JIT_CODE_SIZE;
+
+    // enter(context, entry): saves callee-saved registers, loads the machine state and jumps to entry
+    Assembler a;
+    for (int reg : {RBX, RBP, R12, R13, R14, R15}) {
+        a.push(reg);
+    }
+    a.opReg({0x8B}, CONTEXT, RDI, true); // mov rbx, rdi
+    a.load64(MEMORY, field(offsetof(JitContext, memory)));
+    a.load32(TOP, field(offsetof(JitContext, stackTop)));
+    a.load32(FRAME, field(offsetof(JitContext, stackPointer)));
+    a.jmpReg(RSI);
+
+    // Exit: stores the machine state back and returns from enter()
+    size_t exitOffset = a.size();
+    a.store32(field(offsetof(JitContext, stackTop)), TOP);
+    a.store32(field(offsetof(JitContext, stackPointer)), FRAME);
+    for (int reg : {R15, R14, R13, R12, RBP, RBX}) {
+        a.pop(reg);
+    }
+    a.ret();
+
+    std::memcpy(codeBase, a.code.data(), a.size());
+    exitStub = codeBase + exitOffset;
+    codeUsed = (a.size() + 15) & ~(size_t) 15;
+    if (!setWritable(false)) {
+        munmap(codeBase, codeSize);
+        codeBase = nullptr;
+    }
+#endif
+}
+
+Jit::~Jit() {
+#if VSM_JIT_SUPPORTED
+    if (codeBase != nullptr) {
+        munmap(codeBase, codeSize);
+    }
+#endif
+}
+
+bool Jit::setWritable(bool writable) {
+#if VSM_JIT_SUPPORTED
+    return mprotect(codeBase, codeSize, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#else
+    (void) writable;
+    return false;
+#endif
+}
+
+bool Jit::supported(int i) const {
+    switch (program.code[i].op) {
+        case Op::NOP: case Op::CALL_I: case Op::RET: case Op::RETV:
+        case Op::CALL_N: case Op::RET_N: case Op::RETV_N: case Op::TAILCALL:
+        case Op::PUSH: case Op::PUSH_I: case Op::PUSH_F: case Op::POP: case Op::DUP:
+        case Op::LOAD: case Op::SAVE: case Op::STORE:
+        case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV: case Op::REM:
+        case Op::EQ: case Op::NE: case Op::LE: case Op::GE: case Op::LT: case Op::GT:
+        case Op::BRT_I: case Op::BRZ_I: case Op::JUMP_I:
+        case Op::INT: case Op::LOADL: case Op::STOREL: case Op::ADDLL:
+        case Op::IADD: case Op::ISUB: case Op::IMUL: case Op::IDIV:
+        case Op::IEQ: case Op::INE: case Op::ILE: case Op::IGE: case Op::ILT: case Op::IGT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Jit::compileFunctionAt(int pc) {
+    if (codeBase == nullptr || pc < 0 || (uint32_t) pc >= program.codeCount) {
+        return;
+    }
+    size_t function = (size_t) (std::upper_bound(functionStarts.begin(), functionStarts.end(), pc) - functionStarts.begin()) - 1;
+    if (compiled[function]) {
+        return;
+    }
+    compiled[function] = true;
+    const int start = functionStarts[function];
+    const int end = function + 1 < functionStarts.size() ? functionStarts[function + 1] : (int) program.codeCount;
+
+    Assembler a;
+    std::vector<size_t> labels(end - start); // Native offset of each instruction
+    std::vector<std::pair<size_t, int>> jumps; // rel32 to an instruction of this function
+    std::vector<std::pair<size_t, int>> exits; // rel32 to an exit that resumes the interpreter at an instruction
+    std::vector<size_t> continues; // rel32 to the code that continues at the instruction in eax
+    std::vector<size_t> leaves; // rel32 to the exit stub
+
+    // Exits at instruction i, before it has changed anything, when a check fails
+    auto exitAt = [&](Cond cc, int i) { exits.push_back({a.jcc(cc), i}); };
+    // Goes to instruction target, inside this function or not
+    auto jumpTo = [&](int target) {
+        if (target >= start && target < end) {
+            jumps.push_back({a.jmp(), target});
+        } else {
+            a.movImm32(RAX, target);
+            continues.push_back(a.jmp());
+        }
+    };
+    // Makes sure slot stackTop + k is in memory
+    auto checkTop = [&](int i, int k) {
+        if (k == 0) {
+            a.cmp32(TOP, field(offsetof(JitContext, memorySize)));
+        } else {
+            a.lea32(RAX, Mem{TOP, -1, k});
+            a.cmp32(RAX, field(offsetof(JitContext, memorySize)));
+        }
+        exitAt(CC_AE, i);
+    };
+    // Makes sure the slot in reg is in memory; negative slots compare as large unsigned values
+    auto checkSlot = [&](int i, int reg) {
+        a.cmp32(reg, field(offsetof(JitContext, memorySize)));
+        exitAt(CC_AE, i);
+    };
+    // Exits unless the two top values are ints
+    auto checkInts = [&](int i) {
+        a.load32(RAX, top(-2, TAG));
+        a.or32(RAX, top(-1, TAG));
+        exitAt(CC_NE, i);
+    };
+    // Superinstructions continue after the instructions they cover
+    auto skip = [&](int i) {
+        if (program.code[i].aux != 0) {
+            jumpTo(i + 1 + program.code[i].aux);
+        }
+    };
+    // Binary int operation on the two top values
+    auto binary = [&](std::initializer_list<uint8_t> opcode) {
+        a.load32(RAX, top(-2));
+        a.opMem(opcode, RAX, top(-1));
+        a.store32(top(-2), RAX);
+        a.addImm32(TOP, -1);
+    };
+    auto divide = [&](bool remainder) {
+        a.load32(RAX, top(-2));
+        a.cdq();
+        a.idiv32(top(-1));
+        a.store32(top(-2), remainder ? RDX : RAX);
+        a.addImm32(TOP, -1);
+    };
+    auto compare = [&](Cond cc) {
+        a.load32(RAX, top(-2));
+        a.cmp32(RAX, top(-1));
+        a.setccAl(cc);
+        a.movzxEaxAl();
+        a.store32(top(-2), RAX);
+        a.addImm32(TOP, -1);
+    };
+    // Pops the frame the way RET does, leaving the return address in eax
+    auto popFrame = [&]() {
+        a.movImm32(RCX, 0);
+        a.test32(FRAME, FRAME);
+        size_t inMain = a.jcc(CC_E);
+        a.load32(RCX, Mem{MEMORY, FRAME, -SLOT}); // numParams
+        a.patch(inMain, a.size());
+        a.add32(RCX, FRAME);
+        a.load32(RDX, Mem{MEMORY, RCX, 0}); // Previous stackPointer
+        a.load32(RAX, Mem{MEMORY, RCX, SLOT}); // Return address
+        a.mov32(TOP, FRAME);
+        a.test32(FRAME, FRAME);
+        size_t inMain2 = a.jcc(CC_E);
+        a.addImm32(TOP, -1);
+        a.patch(inMain2, a.size());
+        a.mov32(FRAME, RDX);
+    };
+
+    for (int i = start; i < end; i++) {
+        labels[i - start] = a.size();
+        const DecodedInstruction& instr = program.code[i];
+        if (!supported(i)) {
+            a.storeImm32(field(offsetof(JitContext, programCounter)), i);
+            leaves.push_back(a.jmp());
+            continue;
+        }
+        switch (instr.op) {
+            case Op::NOP:
+                break;
+            case Op::PUSH_I:
+                checkTop(i, 0);
+                a.movImm32(RAX, instr.iArg); // Zero-extends, so the tag is 0
+                a.store64(top(0), RAX);
+                a.addImm32(TOP, 1);
+                break;
+            case Op::PUSH_F: {
+                uint32_t bits;
+                std::memcpy(&bits, &instr.fArg, 4);
+                checkTop(i, 0);
+                a.movImm64(RAX, ((uint64_t) 1 << 32) | bits);
+                a.store64(top(0), RAX);
+                a.addImm32(TOP, 1);
+                break;
+            }
+            case Op::PUSH:
+                checkTop(i, 0);
+                a.load64(RAX, field(offsetof(JitContext, gpr)));
+                a.store64(top(0), RAX);
+                a.addImm32(TOP, 1);
+                break;
+            case Op::POP:
+                a.load64(RAX, top(-1));
+                a.store64(field(offsetof(JitContext, gpr)), RAX);
+                a.addImm32(TOP, -1);
+                break;
+            case Op::DUP:
+                checkTop(i, 0);
+                a.load64(RAX, top(-1));
+                a.store64(top(0), RAX);
+                a.addImm32(TOP, 1);
+                break;
+            case Op::LOAD:
+                a.load32(RAX, top(-1));
+                a.add32(RAX, FRAME);
+                checkSlot(i, RAX);
+                a.load64(RCX, Mem{MEMORY, RAX, 0});
+                a.store64(top(-1), RCX);
+                break;
+            case Op::SAVE:
+                a.load32(RAX, top(-1));
+                a.add32(RAX, FRAME);
+                checkSlot(i, RAX);
+                a.load64(RCX, top(-2));
+                a.store64(Mem{MEMORY, RAX, 0}, RCX);
+                a.addImm32(TOP, -1);
+                break;
+            case Op::STORE:
+            case Op::STOREL: {
+                int popped = instr.op == Op::STORE ? 2 : 1;
+                if (instr.op == Op::STORE) {
+                    a.load32(RAX, top(-1));
+                    a.add32(RAX, FRAME);
+                } else {
+                    a.lea32(RAX, Mem{FRAME, -1, instr.iArg});
+                }
+                checkSlot(i, RAX);
+                a.load64(RCX, top(-popped));
+                a.store64(Mem{MEMORY, RAX, 0}, RCX);
+                a.addImm32(TOP, -popped);
+                a.cmp32(RAX, TOP); // Storing at or past the top raises it
+                size_t below = a.jcc(CC_B);
+                a.lea32(TOP, Mem{RAX, -1, 1});
+                a.patch(below, a.size());
+                skip(i);
+                break;
+            }
+            case Op::LOADL:
+                checkTop(i, 0);
+                a.lea32(RAX, Mem{FRAME, -1, instr.iArg});
+                checkSlot(i, RAX);
+                a.load64(RCX, Mem{MEMORY, RAX, 0});
+                a.store64(top(0), RCX);
+                a.addImm32(TOP, 1);
+                skip(i);
+                break;
+            case Op::ADDLL:
+                checkTop(i, 0);
+                a.lea32(RAX, Mem{FRAME, -1, addllFirst(instr.iArg)});
+                checkSlot(i, RAX);
+                a.lea32(RCX, Mem{FRAME, -1, addllSecond(instr.iArg)});
+                checkSlot(i, RCX);
+                a.load32(RDX, Mem{MEMORY, RAX, TAG});
+                a.or32(RDX, Mem{MEMORY, RCX, TAG});
+                exitAt(CC_NE, i); // Float operands are added by the interpreter
+                a.load32(RDX, Mem{MEMORY, RAX, 0});
+                a.add32(RDX, Mem{MEMORY, RCX, 0});
+                a.store64(top(0), RDX); // Upper half is zero, so the tag is 0
+                a.addImm32(TOP, 1);
+                skip(i);
+                break;
+            case Op::ADD: checkInts(i); binary({0x03}); break;
+            case Op::SUB: checkInts(i); binary({0x2B}); break;
+            case Op::MUL: checkInts(i); binary({0x0F, 0xAF}); break;
+            case Op::DIV: checkInts(i); divide(false); break;
+            case Op::REM: checkInts(i); divide(true); break;
+            case Op::EQ: checkInts(i); compare(CC_E); break;
+            case Op::NE: checkInts(i); compare(CC_NE); break;
+            case Op::LE: checkInts(i); compare(CC_LE); break;
+            case Op::GE: checkInts(i); compare(CC_GE); break;
+            case Op::LT: checkInts(i); compare(CC_L); break;
+            case Op::GT: checkInts(i); compare(CC_G); break;
+            case Op::IADD: binary({0x03}); break;
+            case Op::ISUB: binary({0x2B}); break;
+            case Op::IMUL: binary({0x0F, 0xAF}); break;
+            case Op::IDIV: divide(false); break;
+            case Op::IEQ: compare(CC_E); break;
+            case Op::INE: compare(CC_NE); break;
+            case Op::ILE: compare(CC_LE); break;
+            case Op::IGE: compare(CC_GE); break;
+            case Op::ILT: compare(CC_L); break;
+            case Op::IGT: compare(CC_G); break;
+            case Op::INT:
+                a.cmpImm8(top(-1, TAG), 0);
+                exitAt(CC_NE, i); // Floats are converted by the interpreter
+                break;
+            case Op::BRT_I:
+            case Op::BRZ_I: {
+                a.cmpImm8(top(-1, TAG), 0);
+                exitAt(CC_NE, i);
+                a.load32(RAX, top(-1));
+                a.addImm32(TOP, -1);
+                a.test32(RAX, RAX);
+                size_t fallThrough = a.jcc(instr.op == Op::BRT_I ? CC_E : CC_NE);
+                jumpTo(instr.iArg);
+                a.patch(fallThrough, a.size());
+                break;
+            }
+            case Op::JUMP_I:
+                jumpTo(instr.iArg);
+                break;
+            case Op::CALL_I: {
+                checkTop(i, 1); // Room for the saved stack pointer and return address
+                a.load64(RDX, top(-1)); // numParams
+                a.mov32(RAX, TOP);
+                a.mov32(RCX, RDX);
+                // Moving numParams to behind the params
+                size_t loop = a.size();
+                a.test32(RCX, RCX);
+                size_t done = a.jcc(CC_LE);
+                a.load64(R8, Mem{MEMORY, RAX, -2 * SLOT});
+                a.store64(Mem{MEMORY, RAX, -SLOT}, R8);
+                a.addImm32(RAX, -1);
+                a.addImm32(RCX, -1);
+                a.patch(a.jmp(), loop);
+                a.patch(done, a.size());
+                a.store64(Mem{MEMORY, RAX, -SLOT}, RDX);
+                // Saving stackPointer and the return address
+                a.mov32(RAX, FRAME);
+                a.store64(top(0), RAX);
+                a.movImm32(RAX, i + 1);
+                a.store64(top(1), RAX);
+                a.addImm32(TOP, 2);
+                a.lea32(FRAME, Mem{TOP, -1, -2});
+                a.sub32(FRAME, RDX);
+                jumpTo(instr.iArg);
+                break;
+            }
+            case Op::CALL_N:
+                checkTop(i, 1); // Room for the saved stack pointer and return address
+                a.mov32(RAX, FRAME);
+                a.store64(top(0), RAX);
+                a.movImm32(RAX, i + 1);
+                a.store64(top(1), RAX);
+                a.lea32(FRAME, Mem{TOP, -1, -(int32_t) instr.aux});
+                a.addImm32(TOP, 2);
+                jumpTo(instr.iArg);
+                break;
+            case Op::TAILCALL: {
+                int numParams = tailCallParams(instr.aux);
+                int header = tailCallFrameParams(instr.aux) * SLOT;
+                a.load64(R8, Mem{MEMORY, FRAME, header}); // Saved stackPointer
+                a.load64(R9, Mem{MEMORY, FRAME, header + SLOT}); // Return address
+                for (int k = 0; k < numParams; k++) {
+                    a.load64(RCX, top(k - numParams));
+                    a.store64(Mem{MEMORY, FRAME, k * SLOT}, RCX);
+                }
+                a.store64(Mem{MEMORY, FRAME, numParams * SLOT}, R8);
+                a.store64(Mem{MEMORY, FRAME, (numParams + 1) * SLOT}, R9);
+                a.lea32(TOP, Mem{FRAME, -1, numParams + 2});
+                jumpTo(instr.iArg);
+                break;
+            }
+            case Op::RET_N:
+            case Op::RETV_N:
+                if (instr.op == Op::RETV_N) {
+                    a.load64(R8, top(-1)); // Return value
+                }
+                a.mov32(TOP, FRAME);
+                a.load32(RAX, Mem{MEMORY, FRAME, instr.iArg * SLOT + SLOT}); // Return address
+                a.load32(FRAME, Mem{MEMORY, FRAME, instr.iArg * SLOT}); // Previous stackPointer
+                if (instr.op == Op::RETV_N) {
+                    a.store64(top(0), R8);
+                    a.addImm32(TOP, 1);
+                }
+                continues.push_back(a.jmp());
+                break;
+            case Op::RET:
+                popFrame();
+                continues.push_back(a.jmp());
+                break;
+            case Op::RETV:
+                a.load64(R8, top(-1)); // Return value
+                popFrame();
+                a.store64(top(0), R8);
+                a.addImm32(TOP, 1);
+                continues.push_back(a.jmp());
+                break;
+            default:
+                break;
+        }
+    }
+    // Falling off the end of the function continues with the next instruction
+    a.movImm32(RAX, end);
+    continues.push_back(a.jmp());
+
+    // Continues at the instruction in eax: its native code if it has any, the interpreter otherwise
+    size_t continueOffset = a.size();
+    a.cmpImm32(RAX, (int32_t) program.codeCount);
+    size_t outside = a.jcc(CC_AE);
+    a.load64(RCX, field(offsetof(JitContext, entries)));
+    a.load64(RCX, Mem{RCX, RAX, 0});
+    a.test64(RCX, RCX);
+    size_t notCompiled = a.jcc(CC_E);
+    a.jmpReg(RCX);
+    a.patch(outside, a.size());
+    a.patch(notCompiled, a.size());
+    a.store32(field(offsetof(JitContext, programCounter)), RAX);
+    leaves.push_back(a.jmp());
+
+    // Exits that resume the interpreter at an instruction, one per instruction
+    std::map<int, size_t> exitStubs;
+    for (const auto& exit : exits) {
+        auto found = exitStubs.find(exit.second);
+        if (found == exitStubs.end()) {
+            found = exitStubs.insert({exit.second, a.size()}).first;
+            a.storeImm32(field(offsetof(JitContext, programCounter)), exit.second);
+            leaves.push_back(a.jmp());
+        }
+        a.patch(exit.first, found->second);
+    }
+
+    for (const auto& jump : jumps) {
+        a.patch(jump.first, labels[jump.second - start]);
+    }
+    for (size_t pos : continues) {
+        a.patch(pos, continueOffset);
+    }
+    if (codeUsed + a.size() > codeSize) {
+        return; // Out of code space: the function stays interpreted
+    }
+    uint8_t* origin = codeBase + codeUsed;
+    for (size_t pos : leaves) {
+        int32_t rel = (int32_t) (exitStub - (origin + pos + 4));
+        std::memcpy(&a.code[pos], &rel, 4);
+    }
+
+    if (!setWritable(true)) {
+        return;
+    }
+    std::memcpy(origin, a.code.data(), a.size());
+    setWritable(false);
+    codeUsed = (codeUsed + a.size() + 15) & ~(size_t) 15;
+    for (int i = start; i < end; i++) {
+        if (supported(i)) {
+            entries[i] = origin + labels[i - start];
+        }
+    }
+    functionsCompiled++;
+}
+
+void Jit::enter(JitContext& context, const void* entry) const {
+    typedef void (*EnterFunction)(JitContext*, const void*);
+    context.entries = entries.data();
+    reinterpret_cast<EnterFunction>(reinterpret_cast<uintptr_t>(codeBase))(&context, entry);
+}
@@ -0,0 +1,90 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bytecode.h"
+
+/* The JIT emits x86-64 code for System V targets; elsewhere Jit::available() is false */
+#if defined(__x86_64__) && !defined(_WIN32)
+#define VSM_JIT_SUPPORTED 1
+#else
+#define VSM_JIT_SUPPORTED 0
+#endif
+
+/* Default number of calls or backward branches to an instruction before its function is compiled */
+const int DEFAULT_JIT_THRESHOLD = 100;
+
+/* Machine state shared between the interpreter and compiled code */
+/* Compiled code keeps memory in the interpreter's format: 8-byte slots, int or float bits then the tag */
+struct JitContext {
+    void* memory; // First memory slot; compiled code never grows memory
+    int32_t memorySize; // Number of slots in memory
+    int32_t stackTop;
+    int32_t stackPointer;
+    int32_t programCounter; // Instruction the interpreter continues at when compiled code exits
+    uint64_t gpr; // General purpose register, as the bits of one slot
+    const void* const* entries; // Native address of each instruction, nullptr if it is not compiled
+};
+
+/* Compiles the functions of a program to native code once they get hot */
+/* A function runs from a CALL target up to the next one. Only the int subset is compiled: pushes, */
+/* frame and memory access, int arithmetic and comparisons, branches, calls and returns. Everything */
+/* else, and any operand that turns out to be a float, exits back to the interpreter at that instruction */
+class Jit {
+public:
+    /* program must outlive the Jit */
+    explicit Jit(const BytecodeView& program);
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    /* Returns false if native code cannot run here; the interpreter is used on its own then */
+    bool available() const {
+        return codeBase != nullptr;
+    }
+
+    /* Returns native address of instruction pc, nullptr if it is not compiled */
+    const void* entry(int pc) const {
+        return entries[pc];
+    }
+
+    /* Returns the table compiled code uses to find instructions in other functions */
+    const void* const* entryTable() const {
+        return entries.data();
+    }
+
+    /* Compiles the function containing instruction pc, unless that was already tried */
+    void compileFunctionAt(int pc);
+
+    /* Runs compiled code from entry until it reaches an instruction it cannot run */
+    /* Updates stackTop, stackPointer, programCounter and gpr in context */
+    void enter(JitContext& context, const void* entry) const;
+
+    /* Returns number of functions compiled so far */
+    int getFunctionsCompiled() const {
+        return functionsCompiled;
+    }
+
+private:
+    const BytecodeView& program;
+    std::vector<const void*> entries; // One per instruction
+    std::vector<int> functionStarts; // Sorted first instruction of each function
+    std::vector<bool> compiled; // Per function: whether compiling was tried
+    int functionsCompiled;
+
+    uint8_t* codeBase; // Executable buffer, nullptr if the JIT is unavailable
+    size_t codeSize;
+    size_t codeUsed;
+    const uint8_t* exitStub; // Stores the registers back into the context and returns to enter()
+
+    /* Returns true if instruction i can be compiled */
+    bool supported(int i) const;
+
+    /* Makes the code buffer writable or executable */
+    bool setWritable(bool writable);
+};
+
+#endif // JIT_H
@@ -281,18 +281,38 @@ void printAST(ASTNode* root) {
 
 
 int main(int argc, char *argv[]) {
-    // Confirming proper number of arguments
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+    // Reading options; the last argument is the program
+    // --binary also writes a .vsmb file the stack machine maps without parsing
+    // --cpp also writes a .cpp file that g++ compiles to a native program
+    // --asm also writes a .s file that is linked with nativeRuntime.cpp
+    bool writeBinary = false;
+    bool writeCpp = false;
+    bool writeAsm = false;
+    bool validArgs = argc >= 2;
+    for (int i = 1; i < argc - 1; i++) {
+        std::string arg = argv[i];
+        if (arg == "--binary") {
+            writeBinary = true;
+        } else if (arg == "--cpp") {
+            writeCpp = true;
+        } else if (arg == "--asm") {
+            writeAsm = true;
+        } else {
+            validArgs = false;
+        }
+    }
+    if (!validArgs) {
+        std::cerr << "Usage: " << argv[0] << " [--binary] [--cpp] [--asm] <filename>" << std::endl;
         return 1;
     }
+    char* sourceFile = argv[argc - 1];
     
     /* LEXING */
 
     // Opening file
-    std::ifstream file(argv[1]);
+    std::ifstream file(sourceFile);
     if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+        std::cerr << "Error: Could not open file " << sourceFile << std::endl;
         return 1;
     }
 
@@ -354,8 +374,19 @@ int main(int argc, char *argv[]) {
     // }
     
     // Print the code to a file
-    std::string filename = argv[1] + std::string(".vsm"); // Output file name
+    std::string filename = sourceFile + std::string(".vsm"); // Output file name
     codeGen.printStackMachineCodeToFile(filename, code);
+    if (writeBinary && !codeGen.printBytecodeToFile(filename + "b")) {
+        std::cerr << "Error: Could not write " << filename << "b" << std::endl;
+        delete root;
+        return 1;
+    }
+    if (writeCpp) {
+        codeGen.printStackMachineCodeToFile(sourceFile + std::string(".cpp"), codeGen.getCppCode());
+    }
+    if (writeAsm) {
+        codeGen.printStackMachineCodeToFile(sourceFile + std::string(".s"), codeGen.getAsmCode());
+    }
     
     // Clean up
     delete root;
@@ -0,0 +1,407 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Runtime for programs compiled with ./c.exe --asm
+// Build: g++ filename.txt.s nativeRuntime.cpp -o filename
+// Provides the memory the program's frames live in, input and output, and the float cases
+// of the generic instructions; everything else runs as inline machine code
+
+// One memory slot, as in the stack machine
+struct Value {
+    union {
+        int32_t i;
+        float f;
+    };
+    int32_t isFloat; // 0 for int, 1 for float
+};
+
+// Same defaults as s.exe
+const int MEMORY_SLOTS = 1024;
+const int MAX_MEMORY_SLOTS = 16 * 1024 * 1024;
+
+static std::vector<Value> memoryStorage;
+static std::vector<Value> heapStorage;
+
+extern "C" {
+
+Value* vsm_memory; // First memory slot; the program keeps it in %r12
+int vsm_memory_size; // Number of slots in memory
+Value vsm_gpr; // General purpose register
+Value* vsm_heap; // First heap slot; heap arrays live here, apart from the frames
+int vsm_heap_top; // Heap slots in use
+
+// Generated code
+void vsm_run();
+
+// Grows memory so that slot is valid, doubling its size each time; returns the new first slot
+Value* vsm_grow(int slot) {
+    if (slot < 0) {
+        std::cerr << "Error: Memory access below the bottom of the stack (slot " << slot << ")" << std::endl;
+        exit(1);
+    }
+    if (slot >= MAX_MEMORY_SLOTS) {
+        std::cerr << "Error: Stack overflow: slot " << slot << " exceeds the memory limit of " << MAX_MEMORY_SLOTS << " slots" << std::endl;
+        exit(1);
+    }
+    long long newSize = vsm_memory_size;
+    while (newSize <= slot) {
+        newSize *= 2;
+    }
+    if (newSize > MAX_MEMORY_SLOTS) {
+        newSize = MAX_MEMORY_SLOTS;
+    }
+    Value zero;
+    zero.i = 0;
+    zero.isFloat = 0;
+    memoryStorage.resize((size_t) newSize, zero);
+    vsm_memory = memoryStorage.data();
+    vsm_memory_size = (int) newSize;
+    return vsm_memory;
+}
+
+// Reports a heap index that is not allocated and stops the program
+void vsm_heap_error(int index) {
+    std::cerr << "Error: Heap access out of range: index " << index << ", " << vsm_heap_top << " heap slots allocated" << std::endl;
+    exit(1);
+}
+
+void vsm_heap_index_error(int index, int length) {
+    std::cerr << "Error: Heap array index out of range: index " << index << ", array of " << length << " elements" << std::endl;
+    exit(1);
+}
+
+// HALLOC: allocates length slots on top of the heap and stores the handle, the heap index of the first,
+// in frame slot; returns the stack top after it
+int vsm_halloc(int top, int sp, int slot, int length) {
+    if (length > MAX_MEMORY_SLOTS - vsm_heap_top) {
+        std::cerr << "Error: Heap overflow: " << vsm_heap_top << " slots plus an array of " << length << " exceed the memory limit of "
+                  << MAX_MEMORY_SLOTS << " slots" << std::endl;
+        exit(1);
+    }
+    if (vsm_heap_top + length > (int) heapStorage.size()) {
+        long long newSize = heapStorage.empty() ? 1 : (long long) heapStorage.size();
+        while (newSize < vsm_heap_top + length) {
+            newSize *= 2;
+        }
+        Value zero;
+        zero.i = 0;
+        zero.isFloat = 0;
+        heapStorage.resize((size_t) (newSize > MAX_MEMORY_SLOTS ? MAX_MEMORY_SLOTS : newSize), zero);
+        vsm_heap = heapStorage.data();
+    }
+    slot += sp;
+    if ((unsigned) slot >= (unsigned) vsm_memory_size) {
+        vsm_grow(slot);
+    }
+    vsm_memory[slot].i = vsm_heap_top;
+    vsm_memory[slot].isFloat = 0;
+    vsm_heap_top += length;
+    return top > slot ? top : slot + 1;
+}
+
+// HFREE: frees the heap array whose handle is given, and every one allocated after it
+void vsm_hfree(int handle) {
+    if (handle < 0 || handle > vsm_heap_top) {
+        vsm_heap_error(handle);
+    }
+    vsm_heap_top = handle;
+}
+
+// Array operands of vector instructions are frame offsets, or -1 - k for the heap array whose handle
+// is in frame slot k. Makes sure the length elements of one are in memory, or allocated in the heap
+static void reserveArray(int sp, int operand, int length) {
+    int first = operand >= 0 ? sp + operand : sp - 1 - operand;
+    int last = operand >= 0 ? first + length - 1 : first;
+    if ((unsigned) last >= (unsigned) vsm_memory_size) {
+        vsm_grow(last);
+    }
+    if ((unsigned) first >= (unsigned) vsm_memory_size) {
+        vsm_grow(first);
+    }
+    if (operand < 0) {
+        int handle = vsm_memory[first].i;
+        if (handle < 0 || handle > vsm_heap_top - length) {
+            vsm_heap_error(handle < 0 ? handle : handle + length - 1);
+        }
+    }
+}
+
+// Returns the first element of an array operand, once every operand of the instruction is reserved
+static Value* array(int sp, int operand) {
+    return operand >= 0 ? vsm_memory + sp + operand : vsm_heap + vsm_memory[sp - 1 - operand].i;
+}
+
+// Returns the stack top after storing length elements to array operand dst: storing past it raises it
+static int raisedTop(int top, int sp, int dst, int length) {
+    return dst < 0 || top > sp + dst + length ? top : sp + dst + length;
+}
+
+// Generic instruction on a and the slot after it, when at least one is a float
+// op: 0 ADD, 1 SUB, 2 MUL, 3 DIV, 4 REM, 5 EQ, 6 NE, 7 LE, 8 GE, 9 LT, 10 GT
+void vsm_generic(Value* a, int op) {
+    const Value& b = a[1];
+    float x = a->isFloat ? a->f : (float) a->i;
+    float y = b.isFloat ? b.f : (float) b.i;
+    if (op == 4) { // REM is only defined for ints
+        a->i = (a->isFloat ? (int) a->f : a->i) % (b.isFloat ? (int) b.f : b.i);
+        a->isFloat = 0;
+    } else if (op < 4) {
+        a->f = op == 0 ? x + y : op == 1 ? x - y : op == 2 ? x * y : x / y;
+        a->isFloat = 1;
+    } else {
+        a->i = op == 5 ? x == y : op == 6 ? x != y : op == 7 ? x <= y : op == 8 ? x >= y : op == 9 ? x < y : x > y;
+        a->isFloat = 0;
+    }
+}
+
+// Vector instruction, returns the stack top after it
+// record: operation (0 VADDS to 4 VREMS, 5 VADDV to 9 VREMV), destination, source, second source, length, flags
+int vsm_vector(int top, int sp, const int32_t* record) {
+    int op = record[0] % 5;
+    bool scalarForm = record[0] < 5;
+    int length = record[4];
+    Value scalar;
+    if (scalarForm) {
+        scalar = vsm_memory[--top];
+    }
+    if (length == 0) {
+        return top;
+    }
+    reserveArray(sp, record[1], length);
+    reserveArray(sp, record[2], length);
+    if (!scalarForm) {
+        reserveArray(sp, record[3], length);
+    }
+    Value* dst = array(sp, record[1]);
+    const Value* src = array(sp, record[2]);
+    const Value* src2 = scalarForm ? src : array(sp, record[3]);
+    for (int i = 0; i < length; i++) {
+        Value a = src[i];
+        Value b = scalarForm ? scalar : src2[i];
+        Value& result = dst[i];
+        if (!(a.isFloat | b.isFloat)) {
+            result.i = op == 0 ? (int32_t) ((uint32_t) a.i + (uint32_t) b.i) : op == 1 ? (int32_t) ((uint32_t) a.i - (uint32_t) b.i)
+                : op == 2 ? (int32_t) ((uint32_t) a.i * (uint32_t) b.i) : op == 3 ? a.i / b.i : a.i % b.i;
+            result.isFloat = 0;
+        } else {
+            Value pair[2] = { a, b };
+            vsm_generic(pair, op);
+            result = pair[0];
+        }
+        if (record[5] & 1) {
+            result.f = result.isFloat ? result.f : (float) result.i;
+            result.isFloat = 1;
+        } else {
+            result.i = result.isFloat ? (int32_t) result.f : result.i;
+            result.isFloat = 0;
+        }
+    }
+    return raisedTop(top, sp, record[1], length);
+}
+
+// VMAP, returns the stack top after it
+// record: destination, length, flags, step count, scalar count, then the steps as kind and value pairs:
+// 0 and an array operand for an array element, 1 and an index for a scalar popped from the stack,
+// 2 and 0 ADD to 4 REM for an operation on the two values before it
+int vsm_map(int top, int sp, const int32_t* record) {
+    top -= record[4];
+    int scalars = top;
+    int length = record[1], steps = record[3];
+    const int32_t* step = record + 5;
+    if (length == 0) {
+        return top;
+    }
+    reserveArray(sp, record[0], length);
+    for (int s = 0; s < steps; s++) {
+        if (step[2 * s] == 0) {
+            reserveArray(sp, step[2 * s + 1], length);
+        }
+    }
+    Value* dst = array(sp, record[0]);
+    for (int i = 0; i < length; i++) {
+        Value values[16]; // Deepest expression the compiler emits
+        int depth = 0;
+        for (int s = 0; s < steps; s++) {
+            int kind = step[2 * s], value = step[2 * s + 1];
+            if (kind == 0) {
+                values[depth++] = array(sp, value)[i];
+            } else if (kind == 1) {
+                values[depth++] = vsm_memory[scalars + value];
+            } else {
+                depth--;
+                Value& a = values[depth - 1];
+                const Value& b = values[depth];
+                if (a.isFloat | b.isFloat) {
+                    vsm_generic(&a, value); // a and b are next to each other, as vsm_generic expects
+                } else {
+                    a.i = value == 0 ? (int32_t) ((uint32_t) a.i + (uint32_t) b.i) : value == 1 ? (int32_t) ((uint32_t) a.i - (uint32_t) b.i)
+                        : value == 2 ? (int32_t) ((uint32_t) a.i * (uint32_t) b.i) : value == 3 ? a.i / b.i : a.i % b.i;
+                }
+            }
+        }
+        Value& result = dst[i];
+        if (record[2] & 1) {
+            result.f = values[0].isFloat ? values[0].f : (float) values[0].i;
+            result.isFloat = 1;
+        } else {
+            result.i = values[0].isFloat ? (int32_t) values[0].f : values[0].i;
+            result.isFloat = 0;
+        }
+    }
+    return raisedTop(top, sp, record[0], length);
+}
+
+// Reduction, pushes its result and returns the stack top after it
+// record: operation (0 VSUM, 1 VMIN, 2 VMAX, 3 VDOT), source, second source, length
+// Float sums are added up in blocks of 4096 elements as in the stack machine: element i of a block goes to
+// partial sum i % 8, the partial sums are added pairwise, and the block sums are added in order
+int vsm_reduce(int top, int sp, const int32_t* record) {
+    int op = record[0], length = record[3];
+    Value result;
+    result.i = 0;
+    result.isFloat = 0;
+    if (length > 0) {
+        reserveArray(sp, record[1], length);
+        if (op == 3) {
+            reserveArray(sp, record[2], length);
+        }
+        const Value* src = array(sp, record[1]);
+        const Value* src2 = op == 3 ? array(sp, record[2]) : src;
+        bool anyFloat = false;
+        for (int i = 0; i < length; i++) {
+            anyFloat |= src[i].isFloat || (op == 3 && src2[i].isFloat);
+        }
+        if (op == 1 || op == 2) {
+            result = src[0];
+            for (int i = 1; i < length; i++) {
+                const Value& v = src[i];
+                float x = v.isFloat ? v.f : (float) v.i;
+                float best = result.isFloat ? result.f : (float) result.i;
+                if (anyFloat ? (op == 1 ? x < best : x > best) : (op == 1 ? v.i < result.i : v.i > result.i)) {
+                    result = v;
+                }
+            }
+        } else if (!anyFloat) {
+            uint32_t sum = 0;
+            for (int i = 0; i < length; i++) {
+                sum += op == 3 ? (uint32_t) src[i].i * (uint32_t) src2[i].i : (uint32_t) src[i].i;
+            }
+            result.i = (int32_t) sum;
+        } else {
+            float sum = 0;
+            for (int start = 0; start < length; start += 4096) {
+                float lanes[8] = {};
+                for (int i = start; i < length && i < start + 4096; i++) {
+                    const Value& a = src[i];
+                    float x = a.isFloat ? a.f : (float) a.i;
+                    if (op == 3) {
+                        const Value& b = src2[i];
+                        x *= b.isFloat ? b.f : (float) b.i;
+                    }
+                    lanes[i % 8] += x;
+                }
+                sum += ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+            }
+            result.f = sum;
+            result.isFloat = 1;
+        }
+        if (anyFloat && !result.isFloat) {
+            result.f = (float) result.i;
+            result.isFloat = 1;
+        }
+    }
+    if ((unsigned) top >= (unsigned) vsm_memory_size) {
+        vsm_grow(top);
+    }
+    vsm_memory[top] = result;
+    return top + 1;
+}
+
+void vsm_print_value(const Value* v) {
+    if (v->isFloat) {
+        std::cout << v->f << std::endl;
+    } else {
+        std::cout << v->i << std::endl;
+    }
+}
+
+void vsm_print_string(const char* message) {
+    std::cout << message << std::endl;
+}
+
+// VREAD and VPRINT record: array, length, flags (VECTOR_FLOAT_RESULT to read floats)
+// VREAD reads every element and returns the stack top after storing them; reads past the end of the input give 0
+int vsm_vread(int top, int sp, const int32_t* record) {
+    int length = record[1];
+    if (length == 0) {
+        return top;
+    }
+    reserveArray(sp, record[0], length);
+    Value* dst = array(sp, record[0]);
+    for (int i = 0; i < length; i++) {
+        if (record[2] & 1) {
+            float temp = 0;
+            std::cin >> temp;
+            dst[i].f = temp;
+        } else {
+            int temp = 0;
+            std::cin >> temp;
+            dst[i].i = temp;
+        }
+        dst[i].isFloat = record[2] & 1;
+    }
+    return raisedTop(top, sp, record[0], length);
+}
+
+// VPRINT prints every element on a line of its own and flushes once, after the last one
+void vsm_vprint(int sp, const int32_t* record) {
+    int length = record[1];
+    if (length == 0) {
+        return;
+    }
+    reserveArray(sp, record[0], length);
+    const Value* src = array(sp, record[0]);
+    for (int i = 0; i < length; i++) {
+        if (src[i].isFloat) {
+            std::cout << src[i].f << '\n';
+        } else {
+            std::cout << src[i].i << '\n';
+        }
+    }
+    std::cout.flush();
+}
+
+// A read past the end of the input gives 0, as in s.exe
+int vsm_read_int() {
+    int temp = 0;
+    std::cin >> temp;
+    return temp;
+}
+
+float vsm_read_float() {
+    float temp = 0;
+    std::cin >> temp;
+    return temp;
+}
+
+// END stops the program without the completion message
+void vsm_end() {
+    std::cout.flush();
+    exit(0);
+}
+
+}
+
+int main() {
+    Value zero;
+    zero.i = 0;
+    zero.isFloat = 0;
+    memoryStorage.assign((size_t) MEMORY_SLOTS, zero);
+    vsm_memory = memoryStorage.data();
+    vsm_memory_size = MEMORY_SLOTS;
+    vsm_run();
+    std::cout << "Program execution completed successfully." << std::endl;
+    return 0;
+}
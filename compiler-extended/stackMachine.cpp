@@ -1,983 +1,1916 @@
+#include "stackMachine.h"
 #include <stdio.h>
 #include <string>
 #include <cstring>
 #include <iostream>
 #include <algorithm>
 #include <fstream>
-#include <tuple>
-
-class Operation {
-private:
-    // Attributes
-    int iGpr; // General purpose register for int
-    float fGpr; // General purpose register for float
-    bool tGpr; // Type of GP register (false for int, true for float)
-
-    int intStack[1024];
-    float floatStack[1024];
-    bool typeStack[1024]; // false for int, true for float
-    int stackTop; // Top available slot in memory; last value added at intStack[stackTop - 1]
-    int stackPointer; // Current frame; memory slot 0 is in intStack[stackPointer + 0]
-
-    int programCounter; // Current instruction being executed
-    std::string instructions[1024];
-
-    // Helper functions
-
-    /* Returns index of label, -1 if does not exist*/
-    int LABEL(std::string label) {
-        for (int i = 0; i < 1024; i++) {
-            // Trim any whitespace from the instruction
-            std::string instr = instructions[i];
-            instr.erase(0, instr.find_first_not_of(" \t\n\r"));
-            instr.erase(instr.find_last_not_of(" \t\n\r") + 1);
-            
-            // Check if this is the label we're looking for
-            if (instr == label) {
-                return i;
-            }
-        }
-        return -1;
-    }
-
-    /* Returns top value from stacks without modifying values*/
-    std::tuple<int, float, bool> PEEK() {
-        std::tuple<int, float, bool> retVal = std::make_tuple(intStack[stackTop - 1], floatStack[stackTop - 1], typeStack[stackTop - 1]);
-        this->iGpr = std::get<0>(retVal);
-        this->fGpr = std::get<1>(retVal);
-        this->tGpr = std::get<2>(retVal); // Set general purpose register to peeked value
-        return retVal;
-    }
-
-    /* Calls appropriate function based on parameters provided */
-    /* std::string f: function name*/
-    /* std::string s: string parameter */
-    /* int i: int parameter */
-    /* float fl: float parameter */
-    void execINSTRUCTION(std::string f, std::string s = "", int i = -1, float fl = -1.0f) {
-        // Functions with no parameters
-        if (s == "" && i == -1 && fl == -1.0f) {
-            if (f == "CALL") CALL();
-            else if (f == "RET") RET();
-            else if (f == "RETV") RETV();
-            else if (f == "PUSH") PUSH();
-            else if (f == "POP") POP();
-            else if (f == "DUP") DUP();
-            else if (f == "LOAD") LOAD();
-            else if (f == "SAVE") SAVE();
-            else if (f == "STORE") STORE();
-            else if (f == "ADD") ADD();
-            else if (f == "SUB") SUB();
-            else if (f == "MUL") MUL();
-            else if (f == "DIV") DIV();
-            else if (f == "REM") REM();
-            else if (f == "EQ") EQ();
-            else if (f == "NE") NE();
-            else if (f == "LE") LE();
-            else if (f == "GE") GE();
-            else if (f == "LT") LT();
-            else if (f == "GT") GT();
-            else if (f == "BRT") BRT();
-            else if (f == "BRZ") BRZ();
-            else if (f == "JUMP") JUMP();
-            else if (f == "PRINT") PRINT();
-            else if (f == "READ") READ();
-            else if (f == "READF") READF();
-            else if (f == "END") END();
-            else if (f == "INT") INT();
-            else if (f == "FLOAT") FLOAT();
-        }
-
-        // Functions with string parameters
-        else if (s != "" && i == -1 && fl == -1.0f) {
-            if (f == "PRINT") PRINT(s);
-            else if (f == "BRT") BRT(s);
-            else if (f == "BRZ") BRZ(s);
-            else if (f == "JUMP") JUMP(s);
-            else if (f == "CALL") CALL(s);
-        } 
-
-        // Functions with int parameters
-        else if (s == "" && i != -1 && fl == -1.0f) {
-            if (f == "PUSH") PUSH(i);
-            else if (f == "BRT") BRT(i); // BRT, BRZ, JUMP param is index, not variable
-            else if (f == "BRZ") BRZ(i);
-            else if (f == "JUMP") JUMP(i);
-        }
-        
-        // Functions with float parameters
-        else if (s == "" && i == -1 && fl != -1.0f) {
-            if (f == "PUSH") PUSH(fl); // For all other instructions, type is inferred from stack
-        }
-    }
-
-public:
-    /* Empty constructor */
-    // Should never be called
-    Operation() {
-        iGpr = 0;
-        fGpr = 0.0f;
-        tGpr = false; // false for int, true for float
-        stackTop = 0;
-        stackPointer = 0;
-        programCounter = 0;
-        for (int i = 0; i < 1024; i++) {
-            intStack[i] = 0;
-            floatStack[i] = 0.0f;
-            typeStack[i] = false; // false for int, true for float
-            instructions[i] = "";
-        }
-    }
-
-    /* Constructor with one parameter: filename, a file containing the programs to be executed*/
-    Operation(std::string& filename) {
-        iGpr = 0;
-        fGpr = 0.0f;
-        tGpr = false;
-        stackTop = 0;
-        stackPointer = 0;
-        programCounter = 0;
-        for (int i = 0; i < 1024; i++) {
-            intStack[i] = 0;
-            floatStack[i] = 0.0f;
-            typeStack[i] = false;
-            instructions[i] = "";
-        }
-
-        FILE* file = fopen(filename.c_str(), "r");
-        if (file != nullptr) {
-            char line[32];
-            int index = 0;
-            while (fgets(line, sizeof(line), file) && index < 1024) {
-                instructions[index] = std::string(line);
-                index++;
-            }
-            fclose(file);
+#include <vector>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// GCC and Clang support labels as values, which lets execute() jump straight to a handler
+#ifndef VSM_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define VSM_COMPUTED_GOTO 1
+#else
+#define VSM_COMPUTED_GOTO 0
+#endif
+#endif
+
+/* Returns an int value */
+static Value makeInt(int i) {
+    Value v;
+    v.i = i;
+    v.isFloat = 0;
+    return v;
+}
+
+/* Returns a float value */
+static Value makeFloat(float f) {
+    Value v;
+    v.f = f;
+    v.isFloat = 1;
+    return v;
+}
+
+/* Returns value as a float, converting ints */
+static float toFloat(const Value& v) {
+    return v.isFloat ? v.f : (float) v.i;
+}
+
+/* Returns value as an int, truncating floats */
+static int toInt(const Value& v) {
+    return v.isFloat ? (int) v.f : v.i;
+}
+
+/* Returns true if value is not 0 */
+static bool isTrue(const Value& v) {
+    return v.isFloat ? v.f != 0.0f : v.i != 0;
+}
+
+/* Writes an int as decimal digits into text, which must hold 11 characters; returns the length */
+static int formatInt(int32_t value, char* text) {
+    char digits[10];
+    int count = 0;
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+    do {
+        digits[count++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    int length = 0;
+    if (value < 0) {
+        text[length++] = '-';
+    }
+    while (count > 0) {
+        text[length++] = digits[--count];
+    }
+    return length;
+}
+
+Program::Program() : mappedImage(nullptr), mappedSize(0) {
+    program = decodedText.view();
+}
+
+/* Unmaps a .vsmb program */
+Program::~Program() {
+    if (mappedImage != nullptr) {
+#ifdef _WIN32
+        free(mappedImage);
+#else
+        munmap(mappedImage, mappedSize);
+#endif
+    }
+}
+
+std::shared_ptr<const Program> Program::load(const std::string& filename) {
+    std::shared_ptr<Program> program = std::make_shared<Program>();
+    if (!program->read(filename)) {
+        return nullptr;
+    }
+    return program;
+}
+
+bool Program::read(const std::string& filename) {
+    bool isBinary = false;
+    if (!loadBinary(filename, isBinary)) {
+        return false;
+    }
+    return isBinary || loadText(filename);
+}
+
+std::string Program::instructionText(int pc) const {
+    if (pc < (int) instructions.size()) {
+        return instructions[pc];
+    }
+    return program.disassemble(pc) + "\n";
+}
+
+bool Program::loadText(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Could not read " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        instructions.push_back(line + "\n"); // The debug log prints lines with their newline
+    }
+
+    // Decoding once so run() never parses text
+    if (!decodedText.assemble(instructions)) {
+        return false;
+    }
+    decodedText.formSuperinstructions(); // Older compilers wrote PUSH(k);LOAD() instead of LOADL(k)
+    program = decodedText.view();
+    return true;
+}
+
+bool Program::loadBinary(const std::string& filename, bool& isBinary) {
+    // Checking the magic number before mapping anything
+    char magic[4] = {0, 0, 0, 0};
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+        return true;
+    }
+    size_t got = fread(magic, 1, sizeof(magic), file);
+    if (got != sizeof(magic) || std::memcmp(magic, VSMB_MAGIC, sizeof(magic)) != 0) {
+        fclose(file);
+        return true;
+    }
+    isBinary = true;
+
+#ifdef _WIN32
+    // No mmap: reading the image into one buffer instead
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* image = size > 0 ? malloc(size) : nullptr;
+    if (image == nullptr || fread(image, 1, size, file) != (size_t) size) {
+        free(image);
+        fclose(file);
+        std::cerr << "Error: Could not read " << filename << std::endl;
+        return false;
+    }
+    fclose(file);
+#else
+    fclose(file);
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
         }
+        std::cerr << "Error: Could not read " << filename << std::endl;
+        return false;
     }
+    size_t size = (size_t) info.st_size;
+    void* image = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        std::cerr << "Error: Could not map " << filename << std::endl;
+        return false;
+    }
+#endif
+    mappedImage = image;
+    mappedSize = (size_t) size;
 
-    /* Runs stack machine*/
-    void run() {
-        // Creating a log file to store debug information
-        std::ofstream logFile("debuglog.txt", std::ios::app);
+    if (!attachImage()) {
+        std::cerr << "Error: " << filename << " is not a valid version " << VSMB_VERSION << " .vsmb file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* Instructions are checked too, so run() can trust opcodes and string indices */
+bool Program::attachImage() {
+    if (mappedSize < sizeof(BytecodeHeader)) return false;
+    const char* base = static_cast<const char*>(mappedImage);
+    const BytecodeHeader* header = reinterpret_cast<const BytecodeHeader*>(base);
+    if (header->version != VSMB_VERSION || header->fileSize != mappedSize) return false;
+
+    // Returns true if count items of size bytes at offset fit in the image and are aligned
+    auto fits = [&](uint32_t offset, uint32_t count, size_t size) {
+        return offset % 8 == 0 && offset <= mappedSize && count <= (mappedSize - offset) / size;
+    };
+    if (!fits(header->codeOffset, header->codeCount, sizeof(DecodedInstruction))) return false;
+    if (!fits(header->constantOffset, header->constantCount, sizeof(int32_t))) return false;
+    if (header->stringCount == UINT32_MAX || !fits(header->stringOffsetsOffset, header->stringCount + 1, sizeof(uint32_t))) return false;
+    if (!fits(header->stringDataOffset, header->stringDataSize, 1)) return false;
+    if (!fits(header->labelOffset, header->labelCount, sizeof(BytecodeLabel))) return false;
+
+    program.code = reinterpret_cast<const DecodedInstruction*>(base + header->codeOffset);
+    program.codeCount = header->codeCount;
+    program.constants = reinterpret_cast<const int32_t*>(base + header->constantOffset);
+    program.constantCount = header->constantCount;
+    program.stringOffsets = reinterpret_cast<const uint32_t*>(base + header->stringOffsetsOffset);
+    program.stringData = base + header->stringDataOffset;
+    program.stringCount = header->stringCount;
+    program.labels = reinterpret_cast<const BytecodeLabel*>(base + header->labelOffset);
+    program.labelCount = header->labelCount;
+
+    // Every string must lie in the data section and end with a NUL
+    if (program.stringOffsets[0] != 0) return false;
+    for (uint32_t i = 0; i < program.stringCount; i++) {
+        uint32_t end = program.stringOffsets[i + 1];
+        if (end <= program.stringOffsets[i] || end > header->stringDataSize || program.stringData[end - 1] != '\0') return false;
+    }
+    for (uint32_t i = 0; i < program.labelCount; i++) {
+        if (program.labels[i].name >= program.stringCount) return false;
+    }
+    for (uint32_t i = 0; i < program.codeCount; i++) {
+        const DecodedInstruction& instr = program.code[i];
+        if (instr.op >= Op::OP_COUNT) return false;
+        if (instr.op == Op::PRINT_S && (instr.iArg < 0 || (uint32_t) instr.iArg >= program.stringCount)) return false;
+        if (isVectorOp(instr.op) && (instr.iArg < 0 || (uint32_t) instr.iArg > program.constantCount - VECTOR_RECORD_SIZE
+                                     || program.constantCount < (uint32_t) VECTOR_RECORD_SIZE)) return false;
+        if (instr.op == Op::VMAP && (instr.iArg < 0 || (uint32_t) instr.iArg > program.constantCount
+                                     || !isValidVectorMap(program.constants + instr.iArg, program.constantCount - instr.iArg))) return false;
+        if (isReduceOp(instr.op) && (instr.iArg < 0 || (uint32_t) instr.iArg > program.constantCount - REDUCE_RECORD_SIZE
+                                     || program.constantCount < (uint32_t) REDUCE_RECORD_SIZE
+                                     || program.constants[instr.iArg + REDUCE_LENGTH] < 0)) return false;
+        if ((instr.op == Op::HALLOC || instr.op == Op::HLOAD || instr.op == Op::HSTORE) && (instr.iArg < 0 || (uint32_t) instr.iArg > program.constantCount - HEAP_RECORD_SIZE
+                                     || program.constantCount < (uint32_t) HEAP_RECORD_SIZE
+                                     || program.constants[instr.iArg + HEAP_SLOT] < 0
+                                     || program.constants[instr.iArg + HEAP_LENGTH] < 0)) return false;
+        if ((instr.op == Op::VREAD || instr.op == Op::VPRINT)
+            && (instr.iArg < 0 || (uint32_t) instr.iArg > program.constantCount - ARRAY_IO_RECORD_SIZE
+                || program.constantCount < (uint32_t) ARRAY_IO_RECORD_SIZE
+                || program.constants[instr.iArg + ARRAY_IO_LENGTH] < 0)) return false;
+    }
+    return true;
+}
+
+ExecutionContext::ExecutionContext(std::shared_ptr<const Program> program, int initialSlots, int maxSlots)
+    : gpr(makeInt(0)), maxMemorySize(maxSlots), stackTop(0), stackPointer(0), heap(nullptr), heapTop(0),
+      programCounter(0), ended(false), instructionsExecuted(0), image(std::move(program)), program(image->view()), trace(nullptr), pool(nullptr), jit(nullptr), jitThreshold(DEFAULT_JIT_THRESHOLD),
+      outputBuffer(OUTPUT_BUFFER_SIZE, 0), outputUsed(0), outputBuffered(true), output(&std::cout) {
+    memorySize = initialSlots < 1 ? 1 : initialSlots;
+    if (maxMemorySize < memorySize) {
+        maxMemorySize = memorySize;
+    }
+    memoryStorage.assign((size_t) memorySize, makeInt(0));
+    memory = memoryStorage.data();
+}
+
+ExecutionContext::~ExecutionContext() {
+    flushOutput();
+    delete trace;
+    delete pool;
+    delete jit;
+}
+
+void ExecutionContext::setThreads(int threads) {
+    delete pool;
+    pool = threads > 1 ? new ThreadPool(threads) : nullptr;
+}
+
+void ExecutionContext::enableTrace(const std::string& filename, size_t capacity) {
+    delete trace;
+    trace = new RingTrace(capacity);
+    traceFilename = filename;
+}
+
+void ExecutionContext::enableJit(int threshold) {
+    delete jit;
+    jit = new Jit(program);
+    if (!jit->available()) {
+        std::cerr << "Warning: The JIT is not supported here, interpreting instead" << std::endl;
+        delete jit;
+        jit = nullptr;
+        return;
+    }
+    jitThreshold = threshold < 1 ? 1 : (uint32_t) threshold;
+    hotness.assign(program.codeCount, 0);
+}
+
+void ExecutionContext::flushOutput() {
+    if (outputUsed > 0) {
+        output->write(outputBuffer.data(), outputUsed);
+        outputUsed = 0;
+    }
+    output->flush();
+}
+
+/* Tracing and the JIT are template parameters, so the plain loop carries no code for either */
+/* A run-time error unwinds out of execute() and is reported here, so the host process keeps running */
+RunStatus ExecutionContext::run() {
+    error.clear();
+    try {
+        if (trace != nullptr) {
+            execute(*trace);
+        } else if (jit != nullptr) {
+            NoTrace none;
+            execute<NoTrace, true>(none);
+        } else {
+            NoTrace none;
+            execute(none);
+        }
+    } catch (const std::runtime_error& e) {
+        error = e.what();
+        flushOutput(); // Output so far comes before the error
+        std::cerr << "Error: " << error << std::endl;
+        writeTrace();
+        return RunStatus::RUNTIME_ERROR;
+    }
+    writeTrace();
+    flushOutput();
+    return ended ? RunStatus::ENDED : RunStatus::FINISHED;
+}
+
+void ExecutionContext::reset() {
+    flushOutput();
+    gpr = makeInt(0);
+    stackTop = 0;
+    stackPointer = 0;
+    programCounter = 0;
+    ended = false;
+    instructionsExecuted = 0;
+    error.clear();
+    std::fill(memoryStorage.begin(), memoryStorage.end(), makeInt(0));
+    std::fill(heapStorage.begin(), heapStorage.end(), makeInt(0));
+    heapTop = 0;
+}
+
+void ExecutionContext::writeOutput(const char* text, size_t length) {
+    if (outputUsed + length > outputBuffer.size()) {
+        flushOutput();
+        if (length > outputBuffer.size()) {
+            output->write(text, length);
+            return;
+        }
+    }
+    std::memcpy(outputBuffer.data() + outputUsed, text, length);
+    outputUsed += length;
+}
+
+void ExecutionContext::endOutputLine() {
+    writeOutput("\n", 1);
+    if (!outputBuffered) {
+        flushOutput();
+    }
+}
 
-        while (programCounter < 1024) {
-            // Checking for OOB
-            if (instructions[programCounter].empty()) {
-                break;
+void ExecutionContext::grow(int slot) {
+    if (slot < 0) {
+        throw std::runtime_error("Memory access below the bottom of the stack (slot " + std::to_string(slot) +
+                                 ", instruction " + std::to_string(programCounter - 1) + ")");
+    }
+    if (slot >= maxMemorySize) {
+        throw std::runtime_error("Stack overflow: slot " + std::to_string(slot) + " exceeds the memory limit of " +
+                                 std::to_string(maxMemorySize) + " slots (instruction " + std::to_string(programCounter - 1) + ")");
+    }
+    long long newSize = memorySize;
+    while (newSize <= slot) {
+        newSize *= 2;
+    }
+    if (newSize > maxMemorySize) {
+        newSize = maxMemorySize;
+    }
+    memoryStorage.resize((size_t) newSize, makeInt(0));
+    memory = memoryStorage.data();
+    memorySize = (int) newSize;
+}
+
+void ExecutionContext::writeTrace() {
+    if (trace != nullptr && !trace->writeFile(traceFilename)) {
+        std::cerr << "Error: Could not write trace to " << traceFilename << std::endl;
+    }
+}
+
+/* Interpreter loop, traced through the Trace policy */
+/* Each decoded opcode jumps straight to its handler: through a table of label addresses */
+/* when VSM_COMPUTED_GOTO is set, through a dense switch otherwise */
+/* With UseJit, calls, returns and backward branches run compiled code for their target if there is any */
+template <typename Trace, bool UseJit>
+void ExecutionContext::execute(Trace& tracer) {
+    const DecodedInstruction* code = program.code;
+    const int codeSize = (int) program.codeCount;
+    const DecodedInstruction* instr = nullptr;
+    ended = false;
+
+#if VSM_COMPUTED_GOTO
+    // Order must match enum class Op
+    static void* const dispatchTable[] = {
+        &&do_NOP,
+        &&do_CALL, &&do_CALL_I, &&do_RET, &&do_RETV,
+        &&do_PUSH, &&do_PUSH_I, &&do_PUSH_F, &&do_POP,
+        &&do_DUP,
+        &&do_LOAD, &&do_SAVE, &&do_STORE,
+        &&do_ADD, &&do_SUB, &&do_MUL, &&do_DIV, &&do_REM,
+        &&do_EQ, &&do_NE, &&do_LE, &&do_GE, &&do_LT, &&do_GT,
+        &&do_BRT, &&do_BRT_I, &&do_BRZ, &&do_BRZ_I, &&do_JUMP, &&do_JUMP_I,
+        &&do_PRINT, &&do_PRINT_S, &&do_READ, &&do_READF,
+        &&do_END,
+        &&do_INT, &&do_FLOAT,
+        &&do_LOADL, &&do_STOREL, &&do_ADDLL,
+        &&do_IADD, &&do_ISUB, &&do_IMUL, &&do_IDIV, &&do_FADD, &&do_FSUB, &&do_FMUL, &&do_FDIV,
+        &&do_IEQ, &&do_INE, &&do_ILE, &&do_IGE, &&do_ILT, &&do_IGT, &&do_FEQ, &&do_FNE, &&do_FLE, &&do_FGE, &&do_FLT, &&do_FGT,
+        &&do_CALL_N, &&do_RET_N, &&do_RETV_N,
+        &&do_TAILCALL,
+        &&do_VADDS, &&do_VSUBS, &&do_VMULS, &&do_VDIVS, &&do_VREMS,
+        &&do_VADDV, &&do_VSUBV, &&do_VMULV, &&do_VDIVV, &&do_VREMV,
+        &&do_VMAP,
+        &&do_VSUM, &&do_VMIN, &&do_VMAX, &&do_VDOT,
+        &&do_HALLOC, &&do_HFREE, &&do_HLOAD, &&do_HSTORE,
+        &&do_VREAD, &&do_VPRINT
+    };
+#define VM_CASE(name) do_##name:
+#define VM_NEXT() VM_FETCH(); goto *dispatchTable[(int) instr->op]
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_NEXT() goto next
+#endif
+// Records the finished instruction, stops at the end of the program, then fetches the next instruction
+#define VM_TRACE() \
+    if (Trace::ENABLED) { \
+        const Value& top = memory[stackTop > 0 ? stackTop - 1 : 0]; \
+        tracer.record((int32_t) (instr - code), instr->op, stackTop > 0 ? top.i : 0, stackTop > 0 ? top.isFloat : 0, stackTop); \
+    }
+// Runs compiled code at programCounter after a call, return or backward branch
+#define VM_JIT() if (UseJit && programCounter >= 0 && programCounter < codeSize) enterJit()
+#define VM_JIT_BACKWARD() if (UseJit && programCounter <= (int) (instr - code) && programCounter >= 0) enterJit()
+#define VM_FETCH() \
+    VM_TRACE(); \
+    if (programCounter < 0 || programCounter >= codeSize) return; \
+    instr = &code[programCounter++]; \
+    instructionsExecuted++
+
+    if (programCounter < 0 || programCounter >= codeSize) {
+        return;
+    }
+    instr = &code[programCounter++];
+    instructionsExecuted++;
+
+#if VSM_COMPUTED_GOTO
+    goto *dispatchTable[(int) instr->op];
+    {
+#else
+    for (;;) {
+        switch (instr->op) {
+#endif
+            VM_CASE(NOP) VM_NEXT();
+            VM_CASE(CALL) CALL(); VM_JIT(); VM_NEXT();
+            VM_CASE(CALL_I) CALL(instr->iArg); VM_JIT(); VM_NEXT();
+            VM_CASE(RET) RET(); VM_JIT(); VM_NEXT();
+            VM_CASE(RETV) RETV(); VM_JIT(); VM_NEXT();
+            VM_CASE(CALL_N) CALL(instr->iArg, instr->aux); VM_JIT(); VM_NEXT();
+            VM_CASE(RET_N) RET(instr->iArg); VM_JIT(); VM_NEXT();
+            VM_CASE(RETV_N) RETV(instr->iArg); VM_JIT(); VM_NEXT();
+            VM_CASE(TAILCALL) TAILCALL(instr->iArg, tailCallParams(instr->aux), tailCallFrameParams(instr->aux)); VM_JIT(); VM_NEXT();
+            VM_CASE(PUSH) PUSH(); VM_NEXT();
+            VM_CASE(PUSH_I) PUSH(instr->iArg); VM_NEXT();
+            VM_CASE(PUSH_F) PUSH(instr->fArg); VM_NEXT();
+            VM_CASE(POP) POP(); VM_NEXT();
+            VM_CASE(DUP) DUP(); VM_NEXT();
+            VM_CASE(LOAD) LOAD(); VM_NEXT();
+            VM_CASE(SAVE) SAVE(); VM_NEXT();
+            VM_CASE(STORE) STORE(); VM_NEXT();
+            VM_CASE(ADD) ADD(); VM_NEXT();
+            VM_CASE(SUB) SUB(); VM_NEXT();
+            VM_CASE(MUL) MUL(); VM_NEXT();
+            VM_CASE(DIV) DIV(); VM_NEXT();
+            VM_CASE(REM) REM(); VM_NEXT();
+            VM_CASE(EQ) EQ(); VM_NEXT();
+            VM_CASE(NE) NE(); VM_NEXT();
+            VM_CASE(LE) LE(); VM_NEXT();
+            VM_CASE(GE) GE(); VM_NEXT();
+            VM_CASE(LT) LT(); VM_NEXT();
+            VM_CASE(GT) GT(); VM_NEXT();
+            VM_CASE(BRT) BRT(); VM_NEXT();
+            VM_CASE(BRT_I) BRT(instr->iArg); VM_JIT_BACKWARD(); VM_NEXT(); // BRT, BRZ, JUMP param is index, not variable
+            VM_CASE(BRZ) BRZ(); VM_NEXT();
+            VM_CASE(BRZ_I) BRZ(instr->iArg); VM_JIT_BACKWARD(); VM_NEXT();
+            VM_CASE(JUMP) JUMP(); VM_NEXT();
+            VM_CASE(JUMP_I) JUMP(instr->iArg); VM_JIT_BACKWARD(); VM_NEXT();
+            VM_CASE(PRINT) PRINT(); VM_NEXT();
+            VM_CASE(PRINT_S) PRINT(program.string(instr->iArg), program.stringLength(instr->iArg)); VM_NEXT();
+            VM_CASE(READ) READ(); VM_NEXT();
+            VM_CASE(READF) READF(); VM_NEXT();
+            VM_CASE(END) END(); VM_TRACE(); return;
+            VM_CASE(INT) INT(); VM_NEXT();
+            VM_CASE(FLOAT) FLOAT(); VM_NEXT();
+            VM_CASE(LOADL) LOADL(instr->iArg, instr->aux); VM_NEXT();
+            VM_CASE(STOREL) STOREL(instr->iArg, instr->aux); VM_NEXT();
+            VM_CASE(ADDLL) ADDLL(addllFirst(instr->iArg), addllSecond(instr->iArg), instr->aux); VM_NEXT();
+            VM_CASE(IADD) IADD(); VM_NEXT();
+            VM_CASE(ISUB) ISUB(); VM_NEXT();
+            VM_CASE(IMUL) IMUL(); VM_NEXT();
+            VM_CASE(IDIV) IDIV(); VM_NEXT();
+            VM_CASE(FADD) FADD(); VM_NEXT();
+            VM_CASE(FSUB) FSUB(); VM_NEXT();
+            VM_CASE(FMUL) FMUL(); VM_NEXT();
+            VM_CASE(FDIV) FDIV(); VM_NEXT();
+            VM_CASE(IEQ) IEQ(); VM_NEXT();
+            VM_CASE(INE) INE(); VM_NEXT();
+            VM_CASE(ILE) ILE(); VM_NEXT();
+            VM_CASE(IGE) IGE(); VM_NEXT();
+            VM_CASE(ILT) ILT(); VM_NEXT();
+            VM_CASE(IGT) IGT(); VM_NEXT();
+            VM_CASE(FEQ) FEQ(); VM_NEXT();
+            VM_CASE(FNE) FNE(); VM_NEXT();
+            VM_CASE(FLE) FLE(); VM_NEXT();
+            VM_CASE(FGE) FGE(); VM_NEXT();
+            VM_CASE(FLT) FLT(); VM_NEXT();
+            VM_CASE(FGT) FGT(); VM_NEXT();
+            VM_CASE(VADDS) VADDS(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VSUBS) VSUBS(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VMULS) VMULS(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VDIVS) VDIVS(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VREMS) VREMS(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VADDV) VADDV(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VSUBV) VSUBV(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VMULV) VMULV(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VDIVV) VDIVV(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VREMV) VREMV(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VMAP) VMAP(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VSUM) VSUM(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VMIN) VMIN(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VMAX) VMAX(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VDOT) VDOT(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(HALLOC) HALLOC(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(HFREE) HFREE(instr->iArg); VM_NEXT();
+            VM_CASE(HLOAD) HLOAD(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(HSTORE) HSTORE(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VREAD) VREAD(program.constants + instr->iArg); VM_NEXT();
+            VM_CASE(VPRINT) VPRINT(program.constants + instr->iArg); VM_NEXT();
+#if VSM_COMPUTED_GOTO
+    }
+#else
+        }
+    next:
+        VM_FETCH();
+    }
+#endif
+
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_FETCH
+#undef VM_TRACE
+#undef VM_JIT
+#undef VM_JIT_BACKWARD
+}
+
+/* Runs compiled code from programCounter, compiling its function first if it has just got hot */
+/* Returns straight away if there is no compiled code there; otherwise returns where compiled code stopped */
+void ExecutionContext::enterJit() {
+    const void* entry = jit->entry(programCounter);
+    while (true) {
+        if (entry == nullptr) {
+            // Counting here as well catches calls from compiled code into functions that are not compiled yet
+            if (++hotness[programCounter] != jitThreshold) {
+                return;
+            }
+            jit->compileFunctionAt(programCounter);
+            entry = jit->entry(programCounter);
+            if (entry == nullptr) {
+                return;
             }
+        }
+        JitContext context;
+        context.memory = memory;
+        context.memorySize = memorySize;
+        context.stackTop = stackTop;
+        context.stackPointer = stackPointer;
+        context.programCounter = programCounter;
+        std::memcpy(&context.gpr, &gpr, sizeof(gpr));
+        jit->enter(context, entry);
+        stackTop = context.stackTop;
+        stackPointer = context.stackPointer;
+        programCounter = context.programCounter;
+        std::memcpy(&gpr, &context.gpr, sizeof(gpr));
+
+        // A compiled instruction exits when a check fails, and the interpreter runs it instead
+        if (programCounter < 0 || programCounter >= (int) program.codeCount || jit->entry(programCounter) != nullptr) {
+            return;
+        }
+        entry = nullptr;
+    }
+}
+/* FUNCTIONS */
+
+/* Calls function. Places return address on stack, updates stack pointer */
+/* Top of stack: Function address */
+/* Second on stack: number of parameters*/
+inline void ExecutionContext::CALL() {
+    int address = memory[--stackTop].i; // Address should always be int
+    this->CALL(address);
+}
+
+/* CALL OVERLOAD: Sets program counter to specified address. Handles stack and frame accordingly */
+/* Note: Label parameters are resolved to an address when the program is loaded */
+/* Top of stack: number of parameters */
+inline void ExecutionContext::CALL(int address) {
+    reserve(stackTop + 1); // Room for the saved stack pointer and return address
+
+    // Get number of parameters from stack
+    Value numParamsVal = memory[stackTop - 1];
+    int numParams = numParamsVal.i; // numParams should always be int
+
+    // Moving numParams to behind the params
+    for (int i = 1; i <= numParams; i++) {
+        memory[stackTop - i] = memory[stackTop - i - 1];
+    }
+    memory[stackTop - numParams - 1] = numParamsVal;
+
+    // Save the current stackPointer and programCounter at the top of stack
+    memory[stackTop] = makeInt(stackPointer);
+    memory[stackTop + 1] = makeInt(programCounter);
+    stackTop += 2;
+
+    // Update stack pointer to this new frame
+    stackPointer = stackTop - 2 - numParams;
+
+    // Jump to the function address
+    programCounter = address;
+}
+
+/* Return from function without a value
+* Pre Stack: current frame
+* Post Stack: previous frame
+* Side Effect: Stack pointer gets new frame reference.
+* Description: returns from subroutine. Clears current frame. Stack pointer is reset to calling frame.
+*/
+inline void ExecutionContext::RET() {
+    // Get numParams (if not main)
+    int numParams = 0;
+    if (stackPointer != 0) {
+        numParams = memory[stackPointer - 1].i; // numParams should always be int
+    }
 
-            // Logging current state
-            logFile << "Current stack: " << std::endl;
-            for (int i = 0; i < stackTop; i++) {
-                if (typeStack[i] == false) { // Integer value
-                    logFile << intStack[i] << " ";
-                } else { // Float value
-                    logFile << floatStack[i] << " ";
+    // Get previous stack pointer and return address from current frame
+    int prevStackPointer = memory[stackPointer + numParams].i;
+    int returnAddress = memory[stackPointer + numParams + 1].i;
+
+    // Reset stack top to current stack pointer
+    stackTop = stackPointer - int(stackPointer != 0); // If not in main, subtract 1 for numParams
+
+    // Restore stack pointer to previous frame
+    stackPointer = prevStackPointer;
+
+    // Jump to return address
+    programCounter = returnAddress;
+}
+
+/* Return from function with a value
+* Pre Stack: current frame (with return value on top)
+* Post Stack: previous frame and return value
+* Side Effect: Stack pointer gets new frame reference.
+* Description: Returns from subroutine with a value. Clears current frame. Stack pointer is reset to calling frame.
+* Return value is pushed to the memory stack.
+*/
+inline void ExecutionContext::RETV() {
+    // Save the return value from top of stack
+    Value returnValue = memory[stackTop - 1];
+    this->RET();
+    memory[stackTop++] = returnValue;
+}
+
+/* CALL OVERLOAD: Calls the function at address, whose numParams parameters are on top of stack */
+/* Frame: the parameters, then the saved stack pointer and return address, then the callee's locals */
+/* Nothing is moved, so a call costs the same whatever the number of parameters */
+inline void ExecutionContext::CALL(int address, int numParams) {
+    reserve(stackTop + 1); // Room for the saved stack pointer and return address
+    memory[stackTop] = makeInt(stackPointer);
+    memory[stackTop + 1] = makeInt(programCounter);
+    stackPointer = stackTop - numParams;
+    stackTop += 2;
+    programCounter = address;
+}
+
+/* RET OVERLOAD: Returns from a function called with CALL(label, numParams) */
+/* The caller's stack top is the first parameter, the frame header is right after the last */
+inline void ExecutionContext::RET(int numParams) {
+    int headerSlot = stackPointer + numParams;
+    stackTop = stackPointer;
+    stackPointer = memory[headerSlot].i;
+    programCounter = memory[headerSlot + 1].i;
+}
+
+/* RETV OVERLOAD: Returns the value on top of stack from a function called with CALL(label, numParams) */
+inline void ExecutionContext::RETV(int numParams) {
+    Value returnValue = memory[stackTop - 1];
+    this->RET(numParams);
+    memory[stackTop++] = returnValue;
+}
+
+/* Calls the function at address in place of the current one, whose frame holds frameParams parameters */
+/* The numParams arguments on top of stack become the new parameters and the frame header moves up */
+/* or down behind them, so the callee returns straight to the current function's caller */
+/* Recursion through tail calls runs in constant stack space */
+inline void ExecutionContext::TAILCALL(int address, int numParams, int frameParams) {
+    int header = stackPointer + frameParams;
+    Value savedStackPointer = memory[header];
+    Value returnAddress = memory[header + 1];
+    int arguments = stackTop - numParams;
+    for (int i = 0; i < numParams; i++) {
+        memory[stackPointer + i] = memory[arguments + i]; // Arguments are always above the frame, so this never overwrites one
+    }
+    memory[stackPointer + numParams] = savedStackPointer;
+    memory[stackPointer + numParams + 1] = returnAddress;
+    stackTop = stackPointer + numParams + 2;
+    programCounter = address;
+}
+
+/* Puts value from general purpose register onto stack*/
+inline void ExecutionContext::PUSH() {
+    reserve(stackTop);
+    memory[stackTop++] = gpr;
+}
+
+/* PUSH OVERLOAD: Puts specified integer value onto stack */
+inline void ExecutionContext::PUSH(int value) {
+    reserve(stackTop);
+    memory[stackTop++] = makeInt(value);
+}
+
+/* PUSH OVERLOAD: Puts specified float value onto stack */
+inline void ExecutionContext::PUSH(float value) {
+    reserve(stackTop);
+    memory[stackTop++] = makeFloat(value);
+}
+
+/* Removes top value from stack, places it on general purpose register*/
+inline Value ExecutionContext::POP() {
+    gpr = memory[--stackTop];
+    return gpr;
+}
+
+/* Duplicates value on top of stack*/
+inline void ExecutionContext::DUP() {
+    reserve(stackTop);
+    memory[stackTop] = memory[stackTop - 1];
+    stackTop += 1;
+}
+
+/* Loads value from specified location in memory into top cell of stack*/
+/* Note: the address on top of stack is replaced by the value */
+inline void ExecutionContext::LOAD() {
+    int slot = stackPointer + memory[stackTop - 1].i; // The address is relative to the current frame (stackPointer)
+    reserve(slot);
+    memory[stackTop - 1] = memory[slot];
+}
+
+/* Saves element on stack to specified location without removing element*/
+/* Note: second value on stack is element; first value on stack is address*/
+inline void ExecutionContext::SAVE() {
+    int slot = stackPointer + memory[--stackTop].i; // Address should always be int
+    reserve(slot);
+    memory[slot] = memory[stackTop - 1];
+}
+
+/* Saves element on stack to specified location while removing element*/
+/* Note: second value on stack is element; first value on stack is address*/
+inline void ExecutionContext::STORE() {
+    int slot = stackPointer + memory[stackTop - 1].i; // Address should always be int
+    reserve(slot);
+    memory[slot] = memory[stackTop - 2];
+    stackTop -= 2;
+    if (slot >= stackTop) {
+        stackTop = slot + 1; // Update stack top if necessary
+    }
+}
+
+/* Pushes the value at the specified frame address: PUSH(address); LOAD(); in one instruction */
+/* Note: skip is the number of instructions a superinstruction formed by the loader covers */
+inline void ExecutionContext::LOADL(int address, int skip) {
+    int slot = stackPointer + address;
+    reserve(slot);
+    reserve(stackTop);
+    memory[stackTop++] = memory[slot];
+    programCounter += skip;
+}
+
+/* Pops a value into the specified frame address: PUSH(address); STORE(); in one instruction */
+inline void ExecutionContext::STOREL(int address, int skip) {
+    int slot = stackPointer + address;
+    reserve(slot);
+    memory[slot] = memory[--stackTop];
+    if (slot >= stackTop) {
+        stackTop = slot + 1; // Update stack top if necessary
+    }
+    programCounter += skip;
+}
+
+/* Pushes the sum of the values at two frame addresses: LOADL(first); LOADL(second); ADD(); in one instruction */
+inline void ExecutionContext::ADDLL(int first, int second, int skip) {
+    reserve(stackPointer + first);
+    reserve(stackPointer + second);
+    reserve(stackTop);
+    Value a = memory[stackPointer + first];
+    Value b = memory[stackPointer + second];
+    Value& result = memory[stackTop++];
+    if (a.isFloat | b.isFloat) {
+        result = makeFloat(toFloat(a) + toFloat(b));
+    } else {
+        result = makeInt(a.i + b.i);
+    }
+    programCounter += skip;
+}
+
+/* Pops two values from stack and pushes their sum onto stack*/
+/* Note: like all binary operations, the result overwrites the second value on stack */
+inline void ExecutionContext::ADD() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    if (a.isFloat | b.isFloat) { // Int operands are converted to float
+        a.f = toFloat(a) + toFloat(b);
+        a.isFloat = 1;
+    } else { // Both ints
+        a.i = a.i + b.i;
+    }
+}
+
+/* Pops two values from stack and pushes their difference onto stack*/
+/* Note: top of stack is subtracted from second value on stack*/
+inline void ExecutionContext::SUB() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    if (a.isFloat | b.isFloat) {
+        a.f = toFloat(a) - toFloat(b);
+        a.isFloat = 1;
+    } else { // Both ints
+        a.i = a.i - b.i;
+    }
+}
+
+/* Pops two values from stack and pushes their product onto stack*/
+inline void ExecutionContext::MUL() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    if (a.isFloat | b.isFloat) {
+        a.f = toFloat(a) * toFloat(b);
+        a.isFloat = 1;
+    } else { // Both ints
+        a.i = a.i * b.i;
+    }
+}
+
+/* Pops two values from stack and pushes their quotient onto stack*/
+/* Note: second value on stack is divided by first value on stack*/
+inline void ExecutionContext::DIV() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    if (a.isFloat | b.isFloat) {
+        a.f = toFloat(a) / toFloat(b);
+        a.isFloat = 1;
+    } else { // Both ints
+        // Only case of integer division
+        a.i = a.i / b.i;
+    }
+}
+
+/* Pops two values from stack and pushes the remainder onto stack*/
+/* Note: calculates second value on stack modulus first value on stack*/
+// Never generated by compiler
+inline void ExecutionContext::REM() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+
+    // REM is only defined for integers, so we'll convert to int if needed
+    // This should never be called on floats
+    a.i = toInt(a) % toInt(b);
+    a.isFloat = 0; // Result is always an int
+}
+
+/* Typed arithmetic and comparisons: no type checks, the compiler has converted both operands */
+/* They have the same results as the generic versions on operands of the right type */
+
+/* Pops two ints and pushes their sum; the compiler only emits IADD when both operands are ints */
+inline void ExecutionContext::IADD() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i + memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes their sum; the compiler only emits FADD when both operands are floats */
+inline void ExecutionContext::FADD() {
+    memory[stackTop - 2].f = memory[stackTop - 2].f + memory[stackTop - 1].f;
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes their difference; the compiler only emits ISUB when both operands are ints */
+inline void ExecutionContext::ISUB() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i - memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes their difference; the compiler only emits FSUB when both operands are floats */
+inline void ExecutionContext::FSUB() {
+    memory[stackTop - 2].f = memory[stackTop - 2].f - memory[stackTop - 1].f;
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes their product; the compiler only emits IMUL when both operands are ints */
+inline void ExecutionContext::IMUL() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i * memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes their product; the compiler only emits FMUL when both operands are floats */
+inline void ExecutionContext::FMUL() {
+    memory[stackTop - 2].f = memory[stackTop - 2].f * memory[stackTop - 1].f;
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes their quotient; the compiler only emits IDIV when both operands are ints */
+inline void ExecutionContext::IDIV() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i / memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes their quotient; the compiler only emits FDIV when both operands are floats */
+inline void ExecutionContext::FDIV() {
+    memory[stackTop - 2].f = memory[stackTop - 2].f / memory[stackTop - 1].f;
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes 1 if values are equal, 0 otherwise */
+inline void ExecutionContext::IEQ() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i == memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes 1 if values are equal, 0 otherwise */
+inline void ExecutionContext::FEQ() {
+    Value& a = memory[stackTop - 2];
+    a.i = a.f == memory[stackTop - 1].f;
+    a.isFloat = 0; // Result is always an int
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes 1 if values are not equal, 0 otherwise */
+inline void ExecutionContext::INE() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i != memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes 1 if values are not equal, 0 otherwise */
+inline void ExecutionContext::FNE() {
+    Value& a = memory[stackTop - 2];
+    a.i = a.f != memory[stackTop - 1].f;
+    a.isFloat = 0; // Result is always an int
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes 1 if second-top is <= first-top, 0 otherwise */
+inline void ExecutionContext::ILE() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i <= memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes 1 if second-top is <= first-top, 0 otherwise */
+inline void ExecutionContext::FLE() {
+    Value& a = memory[stackTop - 2];
+    a.i = a.f <= memory[stackTop - 1].f;
+    a.isFloat = 0; // Result is always an int
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes 1 if second-top is >= first-top, 0 otherwise */
+inline void ExecutionContext::IGE() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i >= memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes 1 if second-top is >= first-top, 0 otherwise */
+inline void ExecutionContext::FGE() {
+    Value& a = memory[stackTop - 2];
+    a.i = a.f >= memory[stackTop - 1].f;
+    a.isFloat = 0; // Result is always an int
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes 1 if second-top is < first-top, 0 otherwise */
+inline void ExecutionContext::ILT() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i < memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes 1 if second-top is < first-top, 0 otherwise */
+inline void ExecutionContext::FLT() {
+    Value& a = memory[stackTop - 2];
+    a.i = a.f < memory[stackTop - 1].f;
+    a.isFloat = 0; // Result is always an int
+    stackTop -= 1;
+}
+
+/* Pops two ints and pushes 1 if second-top is > first-top, 0 otherwise */
+inline void ExecutionContext::IGT() {
+    memory[stackTop - 2].i = memory[stackTop - 2].i > memory[stackTop - 1].i;
+    stackTop -= 1;
+}
+
+/* Pops two floats and pushes 1 if second-top is > first-top, 0 otherwise */
+inline void ExecutionContext::FGT() {
+    Value& a = memory[stackTop - 2];
+    a.i = a.f > memory[stackTop - 1].f;
+    a.isFloat = 0; // Result is always an int
+    stackTop -= 1;
+}
+
+/* Pops two values from stack and pushes 1 if values are equal, 0 otherwise*/
+// Should only be callde for the same type
+inline void ExecutionContext::EQ() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    a.i = (a.isFloat | b.isFloat) ? toFloat(a) == toFloat(b) : a.i == b.i;
+    a.isFloat = 0; // Result is always an int
+}
+
+/* Pops two values from stack and pushes 0 if values are equal, 1 otherwise*/
+inline void ExecutionContext::NE() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    a.i = (a.isFloat | b.isFloat) ? toFloat(a) != toFloat(b) : a.i != b.i;
+    a.isFloat = 0;
+}
+
+/* Pops two values from stack and pushes 1 if second-top is <= first-top, 0 otherwise*/
+inline void ExecutionContext::LE() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    a.i = (a.isFloat | b.isFloat) ? toFloat(a) <= toFloat(b) : a.i <= b.i;
+    a.isFloat = 0;
+}
+
+/* Pops two values from stack and pushes 1 if second-top is >= first-top, 0 otherwise*/
+inline void ExecutionContext::GE() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    a.i = (a.isFloat | b.isFloat) ? toFloat(a) >= toFloat(b) : a.i >= b.i;
+    a.isFloat = 0;
+}
+
+/* Pops two values from stack and pushes 1 if second-top is < first-top, 0 otherwise*/
+inline void ExecutionContext::LT() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    a.i = (a.isFloat | b.isFloat) ? toFloat(a) < toFloat(b) : a.i < b.i;
+    a.isFloat = 0;
+}
+
+/* Pops two values from stack and pushes 1 if second-top is > first-top, 0 otherwise*/
+inline void ExecutionContext::GT() {
+    Value& a = memory[stackTop - 2];
+    const Value& b = memory[stackTop - 1];
+    stackTop -= 1;
+    a.i = (a.isFloat | b.isFloat) ? toFloat(a) > toFloat(b) : a.i > b.i;
+    a.isFloat = 0;
+}
+
+/* Elementwise operations of the vector instructions */
+/* Each gives the same int and float results as the generic instruction of the same name */
+struct VectorAdd {
+    static const bool INT_ONLY = false;
+    static int32_t ints(int32_t a, int32_t b) { return a + b; }
+    static float floats(float a, float b) { return a + b; }
+};
+
+struct VectorSub {
+    static const bool INT_ONLY = false;
+    static int32_t ints(int32_t a, int32_t b) { return a - b; }
+    static float floats(float a, float b) { return a - b; }
+};
+
+struct VectorMul {
+    static const bool INT_ONLY = false;
+    static int32_t ints(int32_t a, int32_t b) { return a * b; }
+    static float floats(float a, float b) { return a * b; }
+};
+
+struct VectorDiv {
+    static const bool INT_ONLY = false;
+    static int32_t ints(int32_t a, int32_t b) { return a / b; }
+    static float floats(float a, float b) { return a / b; }
+};
+
+struct VectorRem {
+    static const bool INT_ONLY = true; // Like REM, floats are truncated to ints first
+    static int32_t ints(int32_t a, int32_t b) { return a % b; }
+    static float floats(float a, float b) { return (float) ((int32_t) a % (int32_t) b); }
+};
+
+/* Returns a op b as the generic instruction computes it */
+template <typename Operation>
+static inline Value vectorArithmetic(const Value& a, const Value& b) {
+    if (Operation::INT_ONLY) {
+        return makeInt(Operation::ints(toInt(a), toInt(b)));
+    } else if (a.isFloat | b.isFloat) {
+        return makeFloat(Operation::floats(toFloat(a), toFloat(b)));
+    }
+    return makeInt(Operation::ints(a.i, b.i));
+}
+
+/* Returns one element of a vector instruction: a op b converted to the result type the way INT and FLOAT convert */
+template <typename Operation>
+static inline Value vectorElement(const Value& a, const Value& b, bool floatResult) {
+    Value result = vectorArithmetic<Operation>(a, b);
+    return floatResult ? makeFloat(toFloat(result)) : makeInt(toInt(result));
+}
+
+/* Returns the tag all count values share, 0 for ints and 1 for floats, or -1 if they are mixed */
+static inline int commonTag(const Value* values, int count) {
+    int32_t any = 0;
+    int32_t all = 1;
+    for (int i = 0; i < count; i++) {
+        any |= values[i].isFloat;
+        all &= values[i].isFloat;
+    }
+    return all ? 1 : any ? -1 : 0;
+}
+
+void ExecutionContext::reserveArray(int offset, int length) {
+    if (isHeapArrayOperand(offset)) {
+        int slot = stackPointer + heapArraySlot(offset);
+        reserve(slot);
+        int handle = memory[slot].i;
+        if (handle < 0 || handle > heapTop - length) {
+            heapAccessError(handle < 0 ? handle : handle + length - 1);
+        }
+        return;
+    }
+    reserve(stackPointer + offset);
+    reserve(stackPointer + offset + length - 1);
+}
+
+/* Bytes in a cache line; threads never write to the same line of an array */
+const size_t CACHE_LINE_BYTES = 64;
+
+/* Splits the length elements of the array at dst into parts contiguous ranges, bounds[p] to bounds[p + 1] */
+/* Every inner bound falls on a cache line boundary of dst, so two threads never write to the same line */
+static void alignedBounds(const Value* dst, int length, int parts, int* bounds) {
+    const int line = (int) (CACHE_LINE_BYTES / sizeof(Value));
+    int lead = (int) ((line - ((uintptr_t) dst / sizeof(Value)) % line) % line); // Elements before the first boundary
+    bounds[0] = 0;
+    for (int p = 1; p < parts; p++) {
+        long long bound = lead + (long long) (length - lead) * p / parts;
+        bounds[p] = (int) (bound - (bound - lead) % line);
+    }
+    bounds[parts] = length;
+}
+
+template <typename Part>
+void ExecutionContext::forEachPart(const Value* dst, int length, const Part& part) {
+    int parts = partsFor(length);
+    if (parts == 1) {
+        part(0, length);
+        return;
+    }
+    std::vector<int> bounds(parts + 1);
+    alignedBounds(dst, length, parts, bounds.data());
+    pool->run(parts, [&](int p) {
+        part(bounds[p], bounds[p + 1]);
+    });
+}
+
+/* Stores src[i] op scalar in dst[i] for count elements */
+/* When every operand has the type of the result, the loop runs on plain ints or floats with no tag checks */
+/* Elements are done in order, so the destination may be the source */
+template <typename Operation>
+static void scalarPart(Value* dst, const Value* src, Value scalar, int count, bool floatResult) {
+    int tag = commonTag(src, count);
+    if (!floatResult && tag == 0 && !scalar.isFloat) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = makeInt(Operation::ints(src[i].i, scalar.i));
+        }
+    } else if (floatResult && !Operation::INT_ONLY && tag == 1 && scalar.isFloat) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = makeFloat(Operation::floats(src[i].f, scalar.f));
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            dst[i] = vectorElement<Operation>(src[i], scalar, floatResult);
+        }
+    }
+}
+
+/* Stores a[i] op b[i] in dst[i] for count elements, the same way as scalarPart */
+template <typename Operation>
+static void arrayPart(Value* dst, const Value* a, const Value* b, int count, bool floatResult) {
+    int tagA = commonTag(a, count);
+    int tagB = commonTag(b, count);
+    if (!floatResult && tagA == 0 && tagB == 0) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = makeInt(Operation::ints(a[i].i, b[i].i));
+        }
+    } else if (floatResult && !Operation::INT_ONLY && tagA == 1 && tagB == 1) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = makeFloat(Operation::floats(a[i].f, b[i].f));
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            dst[i] = vectorElement<Operation>(a[i], b[i], floatResult);
+        }
+    }
+}
+
+/* Applies Operation to each element of the source array and the scalar on top of stack, which is popped */
+template <typename Operation>
+inline void ExecutionContext::vectorScalar(const int32_t* record) {
+    Value scalar = memory[--stackTop];
+    int length = record[VECTOR_LENGTH];
+    if (length == 0) {
+        return;
+    }
+    reserveArray(record[VECTOR_DST], length);
+    reserveArray(record[VECTOR_SRC], length);
+    Value* dst = arrayAt(record[VECTOR_DST]);
+    const Value* src = arrayAt(record[VECTOR_SRC]);
+    bool floatResult = (record[VECTOR_FLAGS] & VECTOR_FLOAT_RESULT) != 0;
+    forEachPart(dst, length, [=](int start, int end) {
+        scalarPart<Operation>(dst + start, src + start, scalar, end - start, floatResult);
+    });
+    if (!isHeapArrayOperand(record[VECTOR_DST]) && stackPointer + record[VECTOR_DST] + length > stackTop) {
+        stackTop = stackPointer + record[VECTOR_DST] + length; // Like STOREL, storing past the stack top raises it
+    }
+}
+
+/* Applies Operation to the elements of two source arrays pairwise */
+template <typename Operation>
+inline void ExecutionContext::vectorArray(const int32_t* record) {
+    int length = record[VECTOR_LENGTH];
+    if (length == 0) {
+        return;
+    }
+    reserveArray(record[VECTOR_DST], length);
+    reserveArray(record[VECTOR_SRC], length);
+    reserveArray(record[VECTOR_SRC2], length);
+    Value* dst = arrayAt(record[VECTOR_DST]);
+    const Value* a = arrayAt(record[VECTOR_SRC]);
+    const Value* b = arrayAt(record[VECTOR_SRC2]);
+    bool floatResult = (record[VECTOR_FLAGS] & VECTOR_FLOAT_RESULT) != 0;
+    forEachPart(dst, length, [=](int start, int end) {
+        arrayPart<Operation>(dst + start, a + start, b + start, end - start, floatResult);
+    });
+    if (!isHeapArrayOperand(record[VECTOR_DST]) && stackPointer + record[VECTOR_DST] + length > stackTop) {
+        stackTop = stackPointer + record[VECTOR_DST] + length;
+    }
+}
+
+/* Array-scalar arithmetic: pops a scalar and stores src[i] op scalar in dst[i] for every element */
+/* Operands: see the vector record in bytecode.h */
+inline void ExecutionContext::VADDS(const int32_t* record) {
+    vectorScalar<VectorAdd>(record);
+}
+
+inline void ExecutionContext::VSUBS(const int32_t* record) {
+    vectorScalar<VectorSub>(record);
+}
+
+inline void ExecutionContext::VMULS(const int32_t* record) {
+    vectorScalar<VectorMul>(record);
+}
+
+inline void ExecutionContext::VDIVS(const int32_t* record) {
+    vectorScalar<VectorDiv>(record);
+}
+
+inline void ExecutionContext::VREMS(const int32_t* record) {
+    vectorScalar<VectorRem>(record);
+}
+
+/* Array-array arithmetic: stores src[i] op src2[i] in dst[i] for every element */
+inline void ExecutionContext::VADDV(const int32_t* record) {
+    vectorArray<VectorAdd>(record);
+}
+
+inline void ExecutionContext::VSUBV(const int32_t* record) {
+    vectorArray<VectorSub>(record);
+}
+
+inline void ExecutionContext::VMULV(const int32_t* record) {
+    vectorArray<VectorMul>(record);
+}
+
+inline void ExecutionContext::VDIVV(const int32_t* record) {
+    vectorArray<VectorDiv>(record);
+}
+
+inline void ExecutionContext::VREMV(const int32_t* record) {
+    vectorArray<VectorRem>(record);
+}
+
+/* Elements VMAP works out at a time: every value of a block of the largest expression fits in L1 */
+const int VMAP_BLOCK = 64;
+
+/* A value of a VMAP expression over one block */
+struct MapOperand {
+    const Value* values; // One per element of the block, in the frame or in a block of intermediate values
+    int tag; // As commonTag() returns: 0 if every value is an int, 1 if every value is a float, -1 if mixed
+    bool broadcast; // values[0] stands for every element, as a scalar does
+};
+
+/* Stores a op b in result for count elements of ints */
+template <typename Operation>
+static inline void mapInts(Value* result, const MapOperand& a, const MapOperand& b, int count) {
+    if (a.broadcast) {
+        int32_t x = a.values[0].i;
+        for (int i = 0; i < count; i++) {
+            result[i] = makeInt(Operation::ints(x, b.values[i].i));
+        }
+    } else if (b.broadcast) {
+        int32_t y = b.values[0].i;
+        for (int i = 0; i < count; i++) {
+            result[i] = makeInt(Operation::ints(a.values[i].i, y));
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            result[i] = makeInt(Operation::ints(a.values[i].i, b.values[i].i));
+        }
+    }
+}
+
+/* Stores a op b in result for count elements of floats */
+template <typename Operation>
+static inline void mapFloats(Value* result, const MapOperand& a, const MapOperand& b, int count) {
+    if (a.broadcast) {
+        float x = a.values[0].f;
+        for (int i = 0; i < count; i++) {
+            result[i] = makeFloat(Operation::floats(x, b.values[i].f));
+        }
+    } else if (b.broadcast) {
+        float y = b.values[0].f;
+        for (int i = 0; i < count; i++) {
+            result[i] = makeFloat(Operation::floats(a.values[i].f, y));
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            result[i] = makeFloat(Operation::floats(a.values[i].f, b.values[i].f));
+        }
+    }
+}
+
+/* Returns a op b for count elements, stored in result unless both are scalars; result may be where a is */
+/* Operands whose values all have the same type run through a plain int or float loop */
+template <typename Operation>
+static inline MapOperand mapBlock(Value* result, const MapOperand& a, const MapOperand& b, int count) {
+    MapOperand out = { result, -1, false };
+    if (a.broadcast && b.broadcast) {
+        result[0] = vectorArithmetic<Operation>(a.values[0], b.values[0]);
+        out.tag = result[0].isFloat;
+        out.broadcast = true;
+    } else if (a.tag == 0 && b.tag == 0) {
+        mapInts<Operation>(result, a, b, count);
+        out.tag = 0;
+    } else if (!Operation::INT_ONLY && a.tag == 1 && b.tag == 1) {
+        mapFloats<Operation>(result, a, b, count);
+        out.tag = 1;
+    } else {
+        int strideA = a.broadcast ? 0 : 1;
+        int strideB = b.broadcast ? 0 : 1;
+        for (int i = 0; i < count; i++) {
+            result[i] = vectorArithmetic<Operation>(a.values[i * strideA], b.values[i * strideB]);
+        }
+        out.tag = Operation::INT_ONLY ? 0 : (a.tag == 1 || b.tag == 1) ? 1 : -1;
+    }
+    return out;
+}
+
+/* Applies VMAP operation (0 ADD to 4 REM) to a block */
+static inline MapOperand mapOperation(int32_t operation, Value* result, const MapOperand& a, const MapOperand& b, int count) {
+    switch (operation) {
+        case 0: return mapBlock<VectorAdd>(result, a, b, count);
+        case 1: return mapBlock<VectorSub>(result, a, b, count);
+        case 2: return mapBlock<VectorMul>(result, a, b, count);
+        case 3: return mapBlock<VectorDiv>(result, a, b, count);
+        default: return mapBlock<VectorRem>(result, a, b, count);
+    }
+}
+
+/* Works out elements start to end of a VMAP expression and stores them in dst, a block of VMAP_BLOCK */
+/* elements at a time: array operands are read where they lie in the frame or heap, scalars where they were popped, */
+/* and intermediate values go to one small block per expression depth, so nothing the size of an array is */
+/* allocated and each step is a tight loop over contiguous slots */
+static void mapPart(const int32_t* record, const Value* frame, const Value* heap, const Value* scalars, Value* dst, int start, int end) {
+    int steps = record[VMAP_STEP_COUNT];
+    const int32_t* step = record + VMAP_HEADER_SIZE;
+    bool floatResult = (record[VMAP_FLAGS] & VECTOR_FLOAT_RESULT) != 0;
+    Value blocks[VMAP_MAX_DEPTH][VMAP_BLOCK];
+    MapOperand operands[VMAP_MAX_DEPTH];
+    for (; start < end; start += VMAP_BLOCK) {
+        int count = std::min(VMAP_BLOCK, end - start);
+        int depth = 0;
+        for (int s = 0; s < steps; s++) {
+            int32_t value = step[2 * s + 1];
+            switch (step[2 * s]) {
+                case VMAP_ARRAY: {
+                    const Value* array = isHeapArrayOperand(value) ? heap + frame[heapArraySlot(value)].i : frame + value;
+                    const Value* values = array + start;
+                    operands[depth++] = { values, commonTag(values, count), false };
+                    break;
                 }
-            }
-            logFile << std::endl;
-            logFile << "Executing instruction: " << programCounter << "|" << instructions[programCounter];
-            
-            // Executing instruction
-            int execPC = programCounter;
-            programCounter++;
-            
-            parseInstruction(instructions[execPC]);
-            
-            logFile << "Stack Top: " << stackTop << "|";
-            if (stackTop > 0) {
-                if (typeStack[stackTop - 1] == false) { // Integer value
-                    logFile << intStack[stackTop - 1] << "(int)" << std::endl;
-                } else { // Float value
-                    logFile << floatStack[stackTop - 1] << "(float)" << std::endl;
+                case VMAP_SCALAR: {
+                    const Value* scalar = scalars + value;
+                    operands[depth++] = { scalar, scalar->isFloat, true };
+                    break;
                 }
-            } else {
-                logFile << "Stack empty" << std::endl;
+                default:
+                    depth--;
+                    operands[depth - 1] = mapOperation(value, blocks[depth - 1], operands[depth - 1], operands[depth], count);
+                    break;
             }
         }
-    }
 
-    /* Parses instruction, executes appropriate */
-    void parseInstruction(std::string instruction) {
-        // Ignoring everything after a semicolon
-        size_t semicolonPos = instruction.find(';');
-        if (semicolonPos != std::string::npos) {
-            instruction = instruction.substr(0, semicolonPos);
+        const MapOperand& result = operands[0];
+        if (result.broadcast) {
+            Value converted = floatResult ? makeFloat(toFloat(result.values[0])) : makeInt(toInt(result.values[0]));
+            std::fill(dst + start, dst + start + count, converted);
+        } else if (result.tag == (floatResult ? 1 : 0)) {
+            std::copy(result.values, result.values + count, dst + start);
+        } else {
+            for (int i = 0; i < count; i++) {
+                dst[start + i] = floatResult ? makeFloat(toFloat(result.values[i])) : makeInt(toInt(result.values[i]));
+            }
+        }
+    }
+}
+
+/* Works out a whole-array expression and stores it in the destination array, popping its scalars */
+/* Operands: see the VMAP record in bytecode.h */
+inline void ExecutionContext::VMAP(const int32_t* record) {
+    stackTop -= record[VMAP_SCALAR_COUNT];
+    int scalarBase = stackTop; // Scalar k stays in memory[scalarBase + k]: popping leaves it there and frames lie below it
+    int length = record[VMAP_LENGTH];
+    if (length == 0) {
+        return;
+    }
+    int steps = record[VMAP_STEP_COUNT];
+    const int32_t* step = record + VMAP_HEADER_SIZE;
+    reserveArray(record[VMAP_DST], length);
+    for (int s = 0; s < steps; s++) {
+        if (step[2 * s] == VMAP_ARRAY) {
+            reserveArray(step[2 * s + 1], length);
         }
+    }
 
-        // Removing whitespace outside of quotes
-        bool inQuotes = false;
-        for (size_t i = 0; i < instruction.size(); ++i) {
-            if (instruction[i] == '"') {
-                inQuotes = !inQuotes;
-            } else if (!inQuotes && std::isspace(instruction[i])) {
-                instruction.erase(i--, 1);
+    const Value* frame = memory + stackPointer;
+    const Value* heapBase = heap;
+    const Value* scalars = memory + scalarBase;
+    Value* dst = arrayAt(record[VMAP_DST]);
+    forEachPart(dst, length, [=](int start, int end) {
+        mapPart(record, frame, heapBase, scalars, dst, start, end);
+    });
+    if (!isHeapArrayOperand(record[VMAP_DST]) && stackPointer + record[VMAP_DST] + length > stackTop) {
+        stackTop = stackPointer + record[VMAP_DST] + length;
+    }
+}
+
+/* Adds up partial sums in the order bytecode.h gives for reductions */
+static inline float combineLanes(const float* lanes) {
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+/* Returns the sum of count ints */
+static inline int32_t sumInts(const Value* values, int count) {
+    int32_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += values[i].i;
+    }
+    return sum;
+}
+
+/* Returns the dot product of count ints of a and b */
+static inline int32_t dotInts(const Value* a, const Value* b, int count) {
+    int32_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += a[i].i * b[i].i;
+    }
+    return sum;
+}
+
+/* Returns the float sum of one block of at most REDUCE_BLOCK values; plain when every value is a float */
+/* The partial sums keep REDUCE_LANES additions in flight instead of one long chain, so the loop runs at the */
+/* speed of the loads, and unrolling by REDUCE_LANES lets the compiler use vector adds */
+static float sumBlock(const Value* values, int count, bool plain) {
+    float lanes[REDUCE_LANES] = {};
+    int i = 0;
+    if (plain) {
+        for (; i + REDUCE_LANES <= count; i += REDUCE_LANES) {
+            for (int l = 0; l < REDUCE_LANES; l++) {
+                lanes[l] += values[i + l].f;
+            }
+        }
+    }
+    for (int l = 0; i < count; i++, l = (l + 1) % REDUCE_LANES) {
+        lanes[l] += toFloat(values[i]);
+    }
+    return combineLanes(lanes);
+}
+
+/* Returns the float dot product of one block of a and b, added up the same way as sumBlock */
+static float dotBlock(const Value* a, const Value* b, int count, bool plain) {
+    float lanes[REDUCE_LANES] = {};
+    int i = 0;
+    if (plain) {
+        for (; i + REDUCE_LANES <= count; i += REDUCE_LANES) {
+            for (int l = 0; l < REDUCE_LANES; l++) {
+                lanes[l] += a[i + l].f * b[i + l].f;
             }
         }
+    }
+    for (int l = 0; i < count; i++, l = (l + 1) % REDUCE_LANES) {
+        lanes[l] += toFloat(a[i]) * toFloat(b[i]);
+    }
+    return combineLanes(lanes);
+}
+
+/* Returns the smallest (Max false) or largest (Max true) of count values of one tag */
+template <bool Max>
+static Value extremeValue(const Value* values, int count, int tag) {
+    if (tag == 0) {
+        int32_t best = values[0].i;
+        for (int i = 1; i < count; i++) {
+            best = Max ? std::max(best, values[i].i) : std::min(best, values[i].i);
+        }
+        return makeInt(best);
+    }
+    float best = toFloat(values[0]);
+    if (tag == 1) {
+        for (int i = 1; i < count; i++) {
+            best = Max ? std::max(best, values[i].f) : std::min(best, values[i].f);
+        }
+    } else {
+        for (int i = 1; i < count; i++) {
+            best = Max ? std::max(best, toFloat(values[i])) : std::min(best, toFloat(values[i]));
+        }
+    }
+    return makeFloat(best);
+}
+
+/* Returns reduction op (VSUM to VDOT) of count values of a, and b for VDOT, whose common tag is tag */
+/* An int result for tag 0; floats are summed block by block in the order bytecode.h gives */
+static Value reduceValues(Op op, const Value* a, const Value* b, int count, int tag) {
+    switch (op) {
+        case Op::VMIN:
+            return extremeValue<false>(a, count, tag);
+        case Op::VMAX:
+            return extremeValue<true>(a, count, tag);
+        default:
+            break;
+    }
+    if (tag == 0) {
+        return makeInt(op == Op::VDOT ? dotInts(a, b, count) : sumInts(a, count));
+    }
+    float sum = 0;
+    for (int start = 0; start < count; start += REDUCE_BLOCK) {
+        int block = std::min(REDUCE_BLOCK, count - start);
+        sum += op == Op::VDOT ? dotBlock(a + start, b + start, block, tag == 1) : sumBlock(a + start, block, tag == 1);
+    }
+    return makeFloat(sum);
+}
+
+/* Returns the tag two sets of values share, -1 if they differ; see commonTag() */
+static inline int combineTags(int a, int b) {
+    return a == b ? a : -1;
+}
+
+void ExecutionContext::reduce(Op op, const int32_t* record) {
+    int length = record[REDUCE_LENGTH];
+    Value result = makeInt(0);
+    if (length > 0) {
+        reserveArray(record[REDUCE_SRC], length);
+        if (op == Op::VDOT) {
+            reserveArray(record[REDUCE_SRC2], length);
+        }
+        const Value* a = arrayAt(record[REDUCE_SRC]);
+        const Value* b = op == Op::VDOT ? arrayAt(record[REDUCE_SRC2]) : nullptr;
+        int parts = partsFor(length);
+        if (parts == 1) {
+            int tag = commonTag(a, length);
+            if (b != nullptr) {
+                tag = combineTags(tag, commonTag(b, length));
+            }
+            result = reduceValues(op, a, b, length, tag);
+        } else {
+            // Every part covers whole blocks, so the float sum of each block is the same for any number of parts
+            int blocks = (length + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+            parts = std::min(parts, blocks);
+            std::vector<int> bounds(parts + 1);
+            for (int p = 0; p <= parts; p++) {
+                bounds[p] = (int) std::min((long long) blocks * p / parts * REDUCE_BLOCK, (long long) length);
+            }
 
-        // Finding parantheses, potential parameter
-        size_t openParen = instruction.find('(');
-        size_t closeParen = instruction.find(')');
-        if (openParen != std::string::npos && closeParen != std::string::npos) {
-            std::string functionName = instruction.substr(0, openParen);
-            std::string params = instruction.substr(openParen + 1, closeParen - openParen - 1);
-
-            if (!params.empty()) {
-                if (params[0] == '"' && params[params.length() - 1] == '"') { // Case: String parameter
-                    // Parsing string parameter
-                    std::string param = params.substr(1, params.length() - 2);
-                    execINSTRUCTION(functionName, param, -1, -1.0f);
-                } else { // Case: Numeric parameter
-                    // Check if it's a float (contains a decimal point)
-                    if (params.find('.') != std::string::npos) {
-                        float param = std::stof(params);
-                        execINSTRUCTION(functionName, "", -1, param);
-                    } else { // Integer
-                        int param = std::stoi(params);
-                        execINSTRUCTION(functionName, "", param, -1.0f);
-                    }
+            // The tag of the whole array decides between int and float arithmetic, so it is found first
+            std::vector<int> tags(parts);
+            pool->run(parts, [&](int p) {
+                int count = bounds[p + 1] - bounds[p];
+                tags[p] = commonTag(a + bounds[p], count);
+                if (b != nullptr) {
+                    tags[p] = combineTags(tags[p], commonTag(b + bounds[p], count));
                 }
-            } else { // Case: No Parameters
-                execINSTRUCTION(functionName);
+            });
+            int tag = tags[0];
+            for (int p = 1; p < parts; p++) {
+                tag = combineTags(tag, tags[p]);
+            }
+
+            bool floatSum = tag != 0 && (op == Op::VSUM || op == Op::VDOT);
+            std::vector<Value> partials(parts);
+            std::vector<float> blockSums(floatSum ? blocks : 0);
+            pool->run(parts, [&](int p) {
+                if (!floatSum) {
+                    partials[p] = reduceValues(op, a + bounds[p], b != nullptr ? b + bounds[p] : nullptr, bounds[p + 1] - bounds[p], tag);
+                    return;
+                }
+                for (int start = bounds[p]; start < bounds[p + 1]; start += REDUCE_BLOCK) {
+                    int block = std::min(REDUCE_BLOCK, length - start);
+                    blockSums[start / REDUCE_BLOCK] = op == Op::VDOT ? dotBlock(a + start, b + start, block, tag == 1) : sumBlock(a + start, block, tag == 1);
+                }
+            });
+            if (floatSum) {
+                float sum = 0;
+                for (float blockSum : blockSums) {
+                    sum += blockSum;
+                }
+                result = makeFloat(sum);
+            } else {
+                // Int sums and extremes of the parts combine like the elements themselves
+                result = reduceValues(op == Op::VDOT ? Op::VSUM : op, partials.data(), nullptr, parts, tag == 0 ? 0 : 1);
             }
         }
-        else {
-            // This line is a label
-            return;
+    }
+    reserve(stackTop);
+    memory[stackTop++] = result;
+}
+
+/* Reductions: push one value worked out from a whole array; operands: see the reduction record in bytecode.h */
+inline void ExecutionContext::VSUM(const int32_t* record) {
+    reduce(Op::VSUM, record);
+}
+
+inline void ExecutionContext::VMIN(const int32_t* record) {
+    reduce(Op::VMIN, record);
+}
+
+inline void ExecutionContext::VMAX(const int32_t* record) {
+    reduce(Op::VMAX, record);
+}
+
+inline void ExecutionContext::VDOT(const int32_t* record) {
+    reduce(Op::VDOT, record);
+}
+
+void ExecutionContext::heapAccessError(int index) const {
+    throw std::runtime_error("Heap access out of range: index " + std::to_string(index) + ", " +
+                             std::to_string(heapTop) + " heap slots allocated (instruction " + std::to_string(programCounter - 1) + ")");
+}
+
+/* Throws std::runtime_error for an index past either end of a heap array */
+void ExecutionContext::heapIndexError(int index, int length) const {
+    throw std::runtime_error("Heap array index out of range: index " + std::to_string(index) + ", array of " +
+                             std::to_string(length) + " elements (instruction " + std::to_string(programCounter - 1) + ")");
+}
+
+/* Returns the heap index of element index of the heap array in a heap record, checking it against the array's length */
+inline int ExecutionContext::heapElement(const int32_t* record, int index) const {
+    if ((unsigned) index >= (unsigned) record[HEAP_LENGTH]) {
+        heapIndexError(index, record[HEAP_LENGTH]);
+    }
+    int heapIndex = memory[stackPointer + record[HEAP_SLOT]].i + index;
+    if ((unsigned) heapIndex >= (unsigned) heapTop) {
+        heapAccessError(heapIndex);
+    }
+    return heapIndex;
+}
+
+/* Allocates a heap array on top of the heap and stores its handle, the heap index of its first element, */
+/* in a frame slot. The elements are not cleared. Operands: see the heap record in bytecode.h */
+/* Like STOREL, storing past the stack top raises it */
+inline void ExecutionContext::HALLOC(const int32_t* record) {
+    int length = record[HEAP_LENGTH];
+    if (length > maxMemorySize - heapTop) {
+        throw std::runtime_error("Heap overflow: " + std::to_string(heapTop) + " slots plus an array of " + std::to_string(length) +
+                                 " exceed the memory limit of " + std::to_string(maxMemorySize) + " slots (instruction " +
+                                 std::to_string(programCounter - 1) + ")");
+    }
+    if (heapTop + length > (int) heapStorage.size()) {
+        long long newSize = std::max<long long>(heapStorage.size(), 1);
+        while (newSize < heapTop + length) {
+            newSize *= 2;
         }
+        heapStorage.resize((size_t) std::min<long long>(newSize, maxMemorySize), makeInt(0));
+        heap = heapStorage.data();
+    }
+    int slot = stackPointer + record[HEAP_SLOT];
+    reserve(slot);
+    memory[slot] = makeInt(heapTop);
+    heapTop += length;
+    if (slot >= stackTop) {
+        stackTop = slot + 1;
+    }
+}
+
+/* Frees the heap array whose handle is in frame slot, along with every heap array allocated after it */
+inline void ExecutionContext::HFREE(int slot) {
+    reserve(stackPointer + slot);
+    int handle = memory[stackPointer + slot].i;
+    if (handle < 0 || handle > heapTop) {
+        heapAccessError(handle);
+    }
+    heapTop = handle;
+}
+
+/* Loads an element of a heap array into top cell of stack. Operands: see the heap record in bytecode.h */
+/* Note: the element index on top of stack is replaced by the value */
+inline void ExecutionContext::HLOAD(const int32_t* record) {
+    memory[stackTop - 1] = heap[heapElement(record, memory[stackTop - 1].i)];
+}
+
+/* Saves element on stack to an element of a heap array while removing element */
+/* Note: second value on stack is element; first value on stack is the element index */
+inline void ExecutionContext::HSTORE(const int32_t* record) {
+    heap[heapElement(record, memory[stackTop - 1].i)] = memory[stackTop - 2];
+    stackTop -= 2;
+}
+
+/* Updates program counter to specified location if value is not 0*/
+/* Note: top element on stack is value; second element is location. Removes both elements*/
+inline void ExecutionContext::BRT() {
+    const Value& condition = memory[stackTop - 1];
+    const Value& destination = memory[stackTop - 2];
+    stackTop -= 2;
+    if (isTrue(condition)) {
+        programCounter = toInt(destination); // Should always be int
     }
+}
 
-    /* FUNCTIONS */
-
-    /* Calls function. Places return address on stack, updates stack pointer */
-    /* Top of stack: Function address */
-    /* Second on stack: number of parameters*/
-    void CALL() {
-        std::tuple<int, float, bool> addressVal = this->POP(); // Get function address from stack
-        int address = std::get<0>(addressVal); // Address should always be int
-        
-        std::tuple<int, float, bool> numParamsVal = this->PEEK(); // Get number of parameters from stack
-        int numParams = std::get<0>(numParamsVal); // Num params should always be int
-
-        // Moving numParams to behind the params
-        for (int i = 1; i <= numParams; i++) {
-            intStack[stackTop - i] = intStack[stackTop - i - 1];
-            floatStack[stackTop - i] = floatStack[stackTop - i - 1];
-            typeStack[stackTop - i] = typeStack[stackTop - i - 1];
-        }
-        
-        intStack[stackTop - numParams - 1] = std::get<0>(numParamsVal);
-        floatStack[stackTop - numParams - 1] = std::get<1>(numParamsVal);
-        typeStack[stackTop - numParams - 1] = std::get<2>(numParamsVal);
-
-        // Get current values of stackPointer, programCounter
-        int currStackPointer = stackPointer;
-        int currProgramCounter = programCounter;
-        
-        // Save the current stackPointer and programCounter at the top of stack
-        intStack[stackTop] = currStackPointer;
-        floatStack[stackTop] = 0.0f;
-        typeStack[stackTop] = false;
-        
-        intStack[stackTop + 1] = currProgramCounter;
-        floatStack[stackTop + 1] = 0.0f;
-        typeStack[stackTop + 1] = false;
-        
-        stackTop += 2;
-        
-        // Update stack pointer to this new frame
-        stackPointer = stackTop - 2 - numParams;
-        
-        // Jump to the function address
-        programCounter = address;
-    }
-
-    /* CALL OVERLOAD: Sets program counter to specified label. Handles stack and frame accordingly */
-    /* Note: Accepts a string parameter for the label name */
-    void CALL(std::string label) {
-        // Find the address of the label
-        int address = this->LABEL(label);
-        if (address == -1) {
-            std::cerr << "Error: Label '" << label << "' not found" << std::endl;
-            exit(1);  // Exit with error code
-        }
-        
-        // Get number of parameters from stack
-        std::tuple<int, float, bool> numParamsVal = this->PEEK(); 
-        int numParams = std::get<0>(numParamsVal); // numParams should always be int
-
-        // Moving numParams to behind the params
-        for (int i = 1; i <= numParams; i++) {
-            intStack[stackTop - i] = intStack[stackTop - i - 1];
-            floatStack[stackTop - i] = floatStack[stackTop - i - 1];
-            typeStack[stackTop - i] = typeStack[stackTop - i - 1];
-        }
-        
-        intStack[stackTop - numParams - 1] = std::get<0>(numParamsVal);
-        floatStack[stackTop - numParams - 1] = std::get<1>(numParamsVal);
-        typeStack[stackTop - numParams - 1] = std::get<2>(numParamsVal);
-        
-        // Get current values of stackPointer, programCounter
-        int currStackPointer = stackPointer;
-        int currProgramCounter = programCounter;
-        
-        // Save the current stackPointer and programCounter at the top of stack
-        intStack[stackTop] = currStackPointer;
-        floatStack[stackTop] = 0.0f;
-        typeStack[stackTop] = false;
-        
-        intStack[stackTop + 1] = currProgramCounter;
-        floatStack[stackTop + 1] = 0.0f;
-        typeStack[stackTop + 1] = false;
-        
-        stackTop += 2;
-        
-        // Update stack pointer to this new frame
-        stackPointer = stackTop - 2 - numParams;
-        
-        // Jump to the function address
-        programCounter = address;
-    }
-
-    /* Return from function without a value
-    * Pre Stack: current frame
-    * Post Stack: previous frame
-    * Side Effect: Stack pointer gets new frame reference.
-    * Description: returns from subroutine. Clears current frame. Stack pointer is reset to calling frame.
-    */
-    void RET() {
-        // Get numParams (if not main)
-        int numParams = 0;
-        if (stackPointer != 0) {
-            std::tuple<int, float, bool> numParamsVal;
-            numParamsVal = std::make_tuple(intStack[stackPointer - 1], floatStack[stackPointer - 1], typeStack[stackPointer - 1]);
-            numParams = std::get<0>(numParamsVal); // numParams should always be int
-        }
-
-        // Get previous stack pointer from current frame
-        int prevStackPointer = intStack[stackPointer + numParams];
-        
-        // Get return address from current frame (saved next to stack pointer)
-        int returnAddress = intStack[stackPointer + numParams + 1];
-        
-        // Reset stack top to current stack pointer
-        stackTop = stackPointer - int(stackPointer != 0); // If not in main, subtract 1 for numParams
-        
-        // Restore stack pointer to previous frame
-        stackPointer = prevStackPointer;
-        
-        // Jump to return address
-        programCounter = returnAddress;
-    }
-
-    /* Return from function with a value
-    * Pre Stack: current frame (with return value on top)
-    * Post Stack: previous frame and return value
-    * Side Effect: Stack pointer gets new frame reference. General purpose register is set to return value.
-    * Description: Returns from subroutine with a value. Clears current frame. Stack pointer is reset to calling frame.
-    * Return value is pushed to the memory stack. General purpose register is set to return value.
-    */
-    void RETV() {
-        // Save the return value from top of stack
-        std::tuple<int, float, bool> returnValue = this->POP();
-        
-        // Get numParams (if not main)
-        int numParams = 0;
-        if (stackPointer != 0) {
-            std::tuple<int, float, bool> numParamsVal;
-            numParamsVal = std::make_tuple(intStack[stackPointer - 1], floatStack[stackPointer - 1], typeStack[stackPointer - 1]);
-            numParams = std::get<0>(numParamsVal); // Address should always be int
-        }
-
-        // Get previous stack pointer from current frame
-        int prevStackPointer = intStack[stackPointer + numParams];
-        
-        // Get return address from current frame
-        int returnAddress = intStack[stackPointer + numParams + 1];
-        
-        // Reset stack top to current stack pointer
-        stackTop = stackPointer - int(stackPointer != 0); // If not in main, subtract 1 for numParams
-        
-        // Restore stack pointer to previous frame
-        stackPointer = prevStackPointer;
-        
-        // Jump to return address
-        programCounter = returnAddress;
-        
-        // Set GPR to return value and push it to stack
-        this->iGpr = std::get<0>(returnValue);
-        this->fGpr = std::get<1>(returnValue);
-        this->tGpr = std::get<2>(returnValue);
-        this->PUSH();
-    }
-
-    /* Puts value from general purpose register onto stack*/
-    void PUSH() {
-        intStack[stackTop] = this->iGpr;
-        floatStack[stackTop] = this->fGpr;
-        typeStack[stackTop] = this->tGpr;
-        stackTop += 1;
-    }
-
-    /* PUSH OVERLOAD: Puts specified integer value onto stack */
-    void PUSH(int value) {
-        intStack[stackTop] = value;
-        floatStack[stackTop] = 0.0f; // Zero out float value
-        typeStack[stackTop] = false; // Set type to int
-        stackTop += 1;
-    }
-    
-    /* PUSH OVERLOAD: Puts specified float value onto stack */
-    void PUSH(float value) {
-        intStack[stackTop] = 0; // Zero out int value
-        floatStack[stackTop] = (float) value;
-        typeStack[stackTop] = true; // Set type to float
-        stackTop += 1;
-    }
-
-    /* Removes top value from stack, places it on general purpose register*/
-    std::tuple<int, float, bool> POP() {
-        std::tuple<int, float, bool> retVal = std::make_tuple(intStack[stackTop - 1], floatStack[stackTop - 1], typeStack[stackTop - 1]);
-        stackTop -= 1;
-        this->iGpr = std::get<0>(retVal);
-        this->fGpr = std::get<1>(retVal);
-        this->tGpr = std::get<2>(retVal); // Set general purpose register to popped value
-        return retVal; 
-    }
-
-    /* Duplicates value on top of stack*/
-    void DUP() {
-        std::tuple<int, float, bool> val = this->PEEK();
-        this->iGpr = std::get<0>(val);
-        this->fGpr = std::get<1>(val);
-        this->tGpr = std::get<2>(val);
-        this->PUSH();
-    }
-
-    /* Loads value from specified location in memory into top cell of stack*/
-    void LOAD() {
-        std::tuple<int, float, bool> vals = this->POP();
-        int address = std::get<0>(vals); // Address should always be int
-        
-        // The address is relative to the current frame (stackPointer)
-        // Updating GPRs
-        this->iGpr = intStack[stackPointer + address]; 
-        this->fGpr = floatStack[stackPointer + address]; 
-        this->tGpr = typeStack[stackPointer + address]; 
-
-        this->PUSH(); // Push the loaded value back to stack
-    }
-
-    /* Saves element on stack to specified location without removing element*/
-    /* Note: second value on stack is element; first value on stack is address*/
-    void SAVE() { 
-        std::tuple<int, float, bool> addressVal = this->POP();
-        int address = std::get<0>(addressVal); // Address should always be int
-        
-        std::tuple<int, float, bool> value = this->PEEK();
-        
-        intStack[stackPointer + address] = std::get<0>(value);
-        floatStack[stackPointer + address] = std::get<1>(value);
-        typeStack[stackPointer + address] = std::get<2>(value);
-    }
-
-    /* Saves element on stack to specified location while removing element*/
-    /* Note: second value on stack is element; first value on stack is address*/
-    void STORE() {
-        std::tuple<int, float, bool> addressVal = this->POP();
-        int address = std::get<0>(addressVal); // Address should always be int
-        
-        std::tuple<int, float, bool> value = this->POP();
-        
-        intStack[stackPointer + address] = std::get<0>(value);
-        floatStack[stackPointer + address] = std::get<1>(value);
-        typeStack[stackPointer + address] = std::get<2>(value);
-        if (stackPointer + address >= stackTop) {
-            stackTop = stackPointer + address + 1; // Update stack top if necessary
-        }
-    }
-
-    /* Pops two values from stack and pushes their sum onto stack*/
-    void ADD() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            this->fGpr = std::get<1>(a) + std::get<1>(b);
-            this->tGpr = true;
-        } else if (typeA) { // A is float, B is int
-            this->fGpr = std::get<1>(a) + static_cast<float>(std::get<0>(b));
-            this->tGpr = true;
-        } else if (typeB) { // A is int, B is float
-            this->fGpr = static_cast<float>(std::get<0>(a)) + std::get<1>(b);
-            this->tGpr = true;
-        } else { // Both ints
-            this->iGpr = std::get<0>(a) + std::get<0>(b);
-            this->tGpr = false;
-        }
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes their difference onto stack*/
-    /* Note: top of stack is subtracted from second value on stack*/
-    void SUB() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            this->fGpr = std::get<1>(a) - std::get<1>(b);
-            this->tGpr = true;
-        } else if (typeA) { // A is float, B is int
-            this->fGpr = std::get<1>(a) - static_cast<float>(std::get<0>(b));
-            this->tGpr = true;
-        } else if (typeB) { // A is int, B is float
-            this->fGpr = static_cast<float>(std::get<0>(a)) - std::get<1>(b);
-            this->tGpr = true;
-        } else { // Both ints
-            this->iGpr = std::get<0>(a) - std::get<0>(b);
-            this->tGpr = false;
-        }
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes their product onto stack*/
-    void MUL() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            this->fGpr = std::get<1>(a) * std::get<1>(b);
-            this->tGpr = true;
-        } else if (typeA) { // A is float, B is int
-            this->fGpr = std::get<1>(a) * static_cast<float>(std::get<0>(b));
-            this->tGpr = true;
-        } else if (typeB) { // A is int, B is float
-            this->fGpr = static_cast<float>(std::get<0>(a)) * std::get<1>(b);
-            this->tGpr = true;
-        } else { // Both ints
-            this->iGpr = std::get<0>(a) * std::get<0>(b);
-            this->tGpr = false;
-        }
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes their quotient onto stack*/
-    /* Note: second value on stack is divided by first value on stack*/
-    void DIV() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            this->fGpr = std::get<1>(a) / std::get<1>(b);
-            this->tGpr = true;
-        } else if (typeA) { // A is float, B is int
-            this->fGpr = std::get<1>(a) / static_cast<float>(std::get<0>(b));
-            this->tGpr = true;
-        } else if (typeB) { // A is int, B is float
-            this->fGpr = static_cast<float>(std::get<0>(a)) / std::get<1>(b);
-            this->tGpr = true;
-        } else { // Both ints
-            // Only case of integer division
-            this->iGpr = std::get<0>(a) / std::get<0>(b);
-            this->tGpr = false;
-        }
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes the remainder onto stack*/
-    /* Note: calculates second value on stack modulus first value on stack*/
-    // Never generated by compiler
-    void REM() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        // REM is only defined for integers, so we'll convert to int if needed
-        // This should never be called on floats
-        int aVal = std::get<2>(a) ? static_cast<int>(std::get<1>(a)) : std::get<0>(a);
-        int bVal = std::get<2>(b) ? static_cast<int>(std::get<1>(b)) : std::get<0>(b);
-        
-        this->iGpr = aVal % bVal;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes 1 if values are equal, 0 otherwise*/
-    // Should only be callde for the same type
-    void EQ() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool equal = false;
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            equal = std::get<1>(a) == std::get<1>(b);
-        } else if (typeA) { // A is float, B is int
-            equal = std::get<1>(a) == static_cast<float>(std::get<0>(b));
-        } else if (typeB) { // A is int, B is float
-            equal = static_cast<float>(std::get<0>(a)) == std::get<1>(b);
-        } else { // Both ints
-            equal = std::get<0>(a) == std::get<0>(b);
-        }
-        
-        this->iGpr = equal ? 1 : 0;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes 0 if values are equal, 1 otherwise*/
-    void NE() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool equal = false;
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            equal = std::get<1>(a) == std::get<1>(b);
-        } else if (typeA) { // A is float, B is int
-            equal = std::get<1>(a) == static_cast<float>(std::get<0>(b));
-        } else if (typeB) { // A is int, B is float
-            equal = static_cast<float>(std::get<0>(a)) == std::get<1>(b);
-        } else { // Both ints
-            equal = std::get<0>(a) == std::get<0>(b);
-        }
-        
-        this->iGpr = equal ? 0 : 1;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes 1 if second-top is <= first-top, 0 otherwise*/
-    void LE() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool result = false;
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            result = std::get<1>(a) <= std::get<1>(b);
-        } else if (typeA) { // A is float, B is int
-            result = std::get<1>(a) <= static_cast<float>(std::get<0>(b));
-        } else if (typeB) { // A is int, B is float
-            result = static_cast<float>(std::get<0>(a)) <= std::get<1>(b);
-        } else { // Both ints
-            result = std::get<0>(a) <= std::get<0>(b);
-        }
-        
-        this->iGpr = result ? 1 : 0;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes 1 if second-top is >= first-top, 0 otherwise*/
-    void GE() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool result = false;
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            result = std::get<1>(a) >= std::get<1>(b);
-        } else if (typeA) { // A is float, B is int
-            result = std::get<1>(a) >= static_cast<float>(std::get<0>(b));
-        } else if (typeB) { // A is int, B is float
-            result = static_cast<float>(std::get<0>(a)) >= std::get<1>(b);
-        } else { // Both ints
-            result = std::get<0>(a) >= std::get<0>(b);
-        }
-        
-        this->iGpr = result ? 1 : 0;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes 1 if second-top is < first-top, 0 otherwise*/
-    void LT() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool result = false;
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            result = std::get<1>(a) < std::get<1>(b);
-        } else if (typeA) { // A is float, B is int
-            result = std::get<1>(a) < static_cast<float>(std::get<0>(b));
-        } else if (typeB) { // A is int, B is float
-            result = static_cast<float>(std::get<0>(a)) < std::get<1>(b);
-        } else { // Both ints
-            result = std::get<0>(a) < std::get<0>(b);
-        }
-        
-        this->iGpr = result ? 1 : 0;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Pops two values from stack and pushes 1 if second-top is > first-top, 0 otherwise*/
-    void GT() {
-        std::tuple<int, float, bool> b = this->POP();
-        std::tuple<int, float, bool> a = this->POP();
-        
-        bool result = false;
-        bool typeA = std::get<2>(a);
-        bool typeB = std::get<2>(b);
-        
-        if (typeA && typeB) { // Both floats
-            result = std::get<1>(a) > std::get<1>(b);
-        } else if (typeA) { // A is float, B is int
-            result = std::get<1>(a) > static_cast<float>(std::get<0>(b));
-        } else if (typeB) { // A is int, B is float
-            result = static_cast<float>(std::get<0>(a)) > std::get<1>(b);
-        } else { // Both ints
-            result = std::get<0>(a) > std::get<0>(b);
-        }
-        
-        this->iGpr = result ? 1 : 0;
-        this->tGpr = false; // Result is always an int
-        
-        this->PUSH();
-    }
-
-    /* Updates program counter to specified location if value is not 0*/
-    /* Note: top element on stack is value; second element is location. Removes both elements*/
-    void BRT() {
-        std::tuple<int, float, bool> condition = this->POP();
-        std::tuple<int, float, bool> destination = this->POP();
-        
-        // Get the boolean value for condition
-        bool cond;
-        if (std::get<2>(condition)) { // Float
-            cond = std::get<1>(condition) != 0.0f;
-        } else { // Int
-            cond = std::get<0>(condition) != 0;
-        }
-        
-        // Get the address
-        int address;
-        if (std::get<2>(destination)) { // Float
-            address = static_cast<int>(std::get<1>(destination));
-        } else { // Int
-            address = std::get<0>(destination); // Should always be int
-        }
-        
-        if (cond) {
-            programCounter = address;
-        }
-    }
-
-    /* Updates program counter to specified location if value is not 0*/
-    /* Note: top element on stack is value; removes value*/
-    void BRT(std::string label) {
-        std::tuple<int, float, bool> condition = this->POP();
-        
-        // Get the boolean value for condition
-        bool cond;
-        if (std::get<2>(condition)) { // Float
-            cond = std::get<1>(condition) != 0.0f;
-        } else { // Int
-            cond = std::get<0>(condition) != 0; // Should always be int
-        }
-        
-        if (cond) {
-            programCounter = this->LABEL(label);
-        }
-    }
-
-    /* Updates program counter to specified location if value is not 0*/
-    /* Note: top element on stack is value; removes value*/
-    void BRT(int loc) {
-        std::tuple<int, float, bool> condition = this->POP();
-        
-        // Get the boolean value for condition
-        bool cond;
-        if (std::get<2>(condition)) { // Float
-            cond = std::get<1>(condition) != 0.0f;
-        } else { // Int
-            cond = std::get<0>(condition) != 0; // Should always be int
-        }
-        
-        if (cond) {
-            programCounter = loc;
-        }
-    }
-
-    /* Updates program counter to specified location if value is 0*/
-    /* Note: top element on stack is value; second element is location. Removes both elements*/
-    void BRZ() {
-        std::tuple<int, float, bool> condition = this->POP();
-        std::tuple<int, float, bool> destination = this->POP();
-        
-        // Get the boolean value for condition
-        bool cond;
-        if (std::get<2>(condition)) { // Float
-            cond = std::get<1>(condition) == 0.0f;
-        } else { // Int
-            cond = std::get<0>(condition) == 0; // Should always be int
-        }
-        
-        // Get the address
-        int address;
-        if (std::get<2>(destination)) { // Float
-            address = static_cast<int>(std::get<1>(destination));
-        } else { // Int
-            address = std::get<0>(destination); // Address should always be int
-        }
-        
-        if (cond) {
-            programCounter = address;
-        }
-    }
-
-    /* Updates program counter to specified location if value is 0*/
-    /* Note: top element on stack is value; removes value*/
-    void BRZ(std::string label) {
-        std::tuple<int, float, bool> condition = this->POP();
-        
-        // Get the boolean value for condition
-        bool cond;
-        if (std::get<2>(condition)) { // Float
-            cond = std::get<1>(condition) == 0.0f;
-        } else { // Int
-            cond = std::get<0>(condition) == 0; // Should always be int
-        }
-        
-        if (cond) {
-            programCounter = this->LABEL(label);
-        }
-    }
-
-    /* Updates program counter to specified location if value is 0*/
-    /* Note: top element on stack is value; removes value*/
-    void BRZ(int loc) {
-        std::tuple<int, float, bool> condition = this->POP();
-        
-        // Get the boolean value for condition
-        bool cond;
-        if (std::get<2>(condition)) { // Float
-            cond = std::get<1>(condition) == 0.0f;
-        } else { // Int
-            cond = std::get<0>(condition) == 0; // Should always be int
-        }
-        
-        if (cond) {
-            programCounter = loc;
-        }
-    }
-
-    /* Sets program counter to top value from stack, removes top value from stack*/
-    void JUMP() {
-        std::tuple<int, float, bool> destination = this->POP();
-        
-        // Get the address
-        int address;
-        if (std::get<2>(destination)) { // Float
-            address = static_cast<int>(std::get<1>(destination));
-        } else { // Int
-            address = std::get<0>(destination); // Address should always be int
-        }
-        
-        programCounter = address;
-    }
-
-    /* Sets program counter to specified location. Stack remains unchanged*/
-    void JUMP(std::string label) {
-        programCounter = this->LABEL(label);
-    }
-
-    /* Sets program counter to specified location. Stack remains unchanged*/
-    void JUMP(int loc) {
+/* Updates program counter to specified location if value is not 0*/
+/* Note: top element on stack is value; removes value*/
+inline void ExecutionContext::BRT(int loc) {
+    if (isTrue(memory[--stackTop])) {
         programCounter = loc;
     }
+}
+
+/* Updates program counter to specified location if value is 0*/
+/* Note: top element on stack is value; second element is location. Removes both elements*/
+inline void ExecutionContext::BRZ() {
+    const Value& condition = memory[stackTop - 1];
+    const Value& destination = memory[stackTop - 2];
+    stackTop -= 2;
+    if (!isTrue(condition)) {
+        programCounter = toInt(destination); // Address should always be int
+    }
+}
 
-    /* Prints top value from stack*/
-    void PRINT() {
-        if (typeStack[stackTop-1]) {
-            std::cout << floatStack[stackTop-1] << std::endl;
-        } else {
-            std::cout << intStack[stackTop-1] << std::endl;
+/* Updates program counter to specified location if value is 0*/
+/* Note: top element on stack is value; removes value*/
+inline void ExecutionContext::BRZ(int loc) {
+    if (!isTrue(memory[--stackTop])) {
+        programCounter = loc;
+    }
+}
+
+/* Sets program counter to top value from stack, removes top value from stack*/
+inline void ExecutionContext::JUMP() {
+    programCounter = toInt(memory[--stackTop]); // Address should always be int
+}
+
+/* Sets program counter to specified location. Stack remains unchanged*/
+inline void ExecutionContext::JUMP(int loc) {
+    programCounter = loc;
+}
+
+/* Prints top value from stack*/
+/* Floats use %g, the format std::cout uses by default */
+inline void ExecutionContext::PRINT() {
+    const Value& top = memory[stackTop - 1];
+    char text[32];
+    int length;
+    if (top.isFloat) {
+        length = snprintf(text, sizeof(text), "%g", top.f);
+    } else {
+        length = formatInt(top.i, text);
+    }
+    writeOutput(text, (size_t) length);
+    endOutputLine();
+}
+
+/* PRINT OVERLOAD: Prints message passed as parameter*/
+inline void ExecutionContext::PRINT(std::string message) {
+    writeOutput(message.data(), message.size());
+    endOutputLine();
+}
+
+/* PRINT OVERLOAD: Prints message from the string pool without copying it*/
+inline void ExecutionContext::PRINT(const char* message, uint32_t length) {
+    writeOutput(message, length);
+    endOutputLine();
+}
+
+/* Reads integer input value, adds to top of stack*/
+inline void ExecutionContext::READ() {
+    if (input.isInteractive()) {
+        flushOutput(); // Showing the prompt before waiting for input
+    }
+    int temp = input.readInt();
+    this->PUSH(temp);
+}
+
+/* Reads float input value, adds to top of stack*/
+inline void ExecutionContext::READF() {
+    if (input.isInteractive()) {
+        flushOutput(); // Showing the prompt before waiting for input
+    }
+    float temp = input.readFloat();
+    this->PUSH(temp);
+}
+
+/* Reads a whole array: one number per element, as READ or READF would, in a single pass over the input buffer */
+/* Operands: see the array I/O record in bytecode.h */
+inline void ExecutionContext::VREAD(const int32_t* record) {
+    if (input.isInteractive()) {
+        flushOutput(); // Showing the prompt before waiting for input
+    }
+    int length = record[ARRAY_IO_LENGTH];
+    if (length == 0) {
+        return;
+    }
+    reserveArray(record[ARRAY_IO_ARRAY], length);
+    Value* dst = arrayAt(record[ARRAY_IO_ARRAY]);
+    if ((record[ARRAY_IO_FLAGS] & VECTOR_FLOAT_RESULT) != 0) {
+        for (int i = 0; i < length; i++) {
+            dst[i] = makeFloat(input.readFloat());
+        }
+    } else {
+        for (int i = 0; i < length; i++) {
+            dst[i] = makeInt(input.readInt());
         }
     }
-
-    /* PRINT OVERLOAD: Prints message passed as parameter*/
-    void PRINT(std::string message) {
-        std::cout << message << std::endl;
+    if (!isHeapArrayOperand(record[ARRAY_IO_ARRAY]) && stackPointer + record[ARRAY_IO_ARRAY] + length > stackTop) {
+        stackTop = stackPointer + record[ARRAY_IO_ARRAY] + length;
     }
-
-    /* Reads integer input value, adds to top of stack*/
-    void READ() {
-        int temp;
-        std::cin >> temp;
-        this->iGpr = temp;
-        this->tGpr = false;
-        this->PUSH();
+}
+
+/* Prints every element of a whole array on a line of its own, as PRINT would */
+/* Lines are formatted into a block and appended to the output buffer a block at a time; */
+/* unbuffered output is written once, after the last element */
+inline void ExecutionContext::VPRINT(const int32_t* record) {
+    int length = record[ARRAY_IO_LENGTH];
+    if (length == 0) {
+        return;
     }
-
-    /* Reads float input value, adds to top of stack*/
-    void READF() {
-        float temp;
-        std::cin >> temp;
-        this->fGpr = temp;
-        this->tGpr = true;
-        this->PUSH();
+    reserveArray(record[ARRAY_IO_ARRAY], length);
+    const Value* src = arrayAt(record[ARRAY_IO_ARRAY]);
+    char block[4096];
+    size_t used = 0;
+    for (int i = 0; i < length; i++) {
+        if (used > sizeof(block) - 32) {
+            writeOutput(block, used);
+            used = 0;
+        }
+        if (src[i].isFloat) {
+            used += (size_t) snprintf(block + used, 32, "%g", src[i].f);
+        } else {
+            used += (size_t) formatInt(src[i].i, block + used);
+        }
+        block[used++] = '\n';
     }
-
-    /* Converts the top value on the stack to an INT*/
-    void INT() {
-        if (typeStack[stackTop-1] == 0) return; // Already an int, no need to convert
-
-        // Need to convert to int
-        std::tuple<int, float, bool> val = this->POP();
-        this->iGpr = (int) std::get<1>(val);
-        this->fGpr = 0.0f; // Zero out float value
-        this->tGpr = false;
-        this->PUSH();
+    writeOutput(block, used);
+    if (!outputBuffered) {
+        flushOutput();
     }
+}
 
-    /* Converts the top value on the stack to a FLOAT*/
-    void FLOAT() {
-        if (typeStack[stackTop-1] == 1) return; // Already a float, no need to convert
-        
-        // Need to convert to float
-        std::tuple<int, float, bool> val = this->POP();
-        this->fGpr = (float) std::get<0>(val);
-        this->iGpr = 0; // Zero out int value
-        this->tGpr = true;
-        this->PUSH();
+/* Converts the top value on the stack to an INT*/
+inline void ExecutionContext::INT() {
+    Value& top = memory[stackTop - 1];
+    if (top.isFloat) {
+        top = makeInt((int) top.f);
     }
+}
 
-    /* Ends execution of program*/
-    void END() {
-        exit(0);
+/* Converts the top value on the stack to a FLOAT*/
+inline void ExecutionContext::FLOAT() {
+    Value& top = memory[stackTop - 1];
+    if (!top.isFloat) {
+        top = makeFloat((float) top.i);
     }
-};
\ No newline at end of file
+}
+
+/* Ends execution of program*/
+/* Note: stops run(); the caller decides what happens next */
+inline void ExecutionContext::END() {
+    ended = true;
+    programCounter = -1;
+    flushOutput();
+}
\ No newline at end of file
@@ -0,0 +1,374 @@
+#ifndef STACK_MACHINE_H
+#define STACK_MACHINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+#include "trace.h"
+#include "jit.h"
+#include "inputReader.h"
+#include "threadPool.h"
+
+/* One memory slot: an int or a float and the tag saying which */
+/* Keeping value and tag together means an instruction touches one 8-byte slot per operand */
+struct Value {
+    union {
+        int32_t i;
+        float f;
+    };
+    int32_t isFloat; // 0 for int, 1 for float
+};
+static_assert(sizeof(Value) == 8 && offsetof(Value, isFloat) == 4, "The JIT relies on this slot layout");
+
+/* Default number of memory slots allocated before the program starts */
+const int DEFAULT_MEMORY_SLOTS = 1024;
+
+/* Default upper bound on memory slots (128 MiB of values); memory grows up to it */
+const int DEFAULT_MAX_MEMORY_SLOTS = 16 * 1024 * 1024;
+
+/* Elements an array instruction needs before it is split across the threads given to setThreads() */
+/* Waking the threads costs about as much as working out this many elements on one */
+const int PARALLEL_MIN_ELEMENTS = 64 * 1024;
+
+/* Bytes of PRINT output collected before they are written to stdout */
+const size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+/* How ExecutionContext::run() stopped */
+enum class RunStatus {
+    ENDED, // An END instruction was executed
+    FINISHED, // The program ran past its last instruction or returned from main
+    RUNTIME_ERROR // A memory access failed; the message is printed and kept in getError()
+};
+
+/* A stack machine program: decoded .vsm text or a mapped .vsmb file */
+/* Never changes once loaded, and nothing in it is written while it runs, so any number of */
+/* ExecutionContexts on any number of threads can share one copy. The last context or owner */
+/* to let go of it frees it */
+class Program {
+public:
+    Program();
+    ~Program();
+
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    /* Loads filename: .vsmb files are mapped and executed in place; anything else is decoded as .vsm text */
+    /* Prints an error and returns nullptr if the file cannot be read, is a damaged .vsmb file or has an invalid line */
+    static std::shared_ptr<const Program> load(const std::string& filename);
+
+    /* Returns the decoded program */
+    const BytecodeView& view() const {
+        return program;
+    }
+
+    /* Returns the text of instruction pc followed by a newline, as it appears in the program */
+    std::string instructionText(int pc) const;
+
+private:
+    std::vector<std::string> instructions; // Lines of a .vsm program, kept for trace decoding
+    Bytecode decodedText; // Storage for a program decoded from .vsm text
+    BytecodeView program; // Points into decodedText or a mapped .vsmb file
+    void* mappedImage; // Mapped .vsmb file, nullptr for text programs
+    size_t mappedSize;
+
+    /* Loads filename into this program; returns false after printing an error */
+    bool read(const std::string& filename);
+
+    /* Reads .vsm text and decodes it into decodedText. Returns false if the file cannot be read or */
+    /* has an invalid instruction or undefined label */
+    bool loadText(const std::string& filename);
+
+    /* Maps a .vsmb file and points program into it. Sets isBinary to false if the file is not a .vsmb file */
+    /* Returns false if the file is a damaged .vsmb file */
+    bool loadBinary(const std::string& filename, bool& isBinary);
+
+    /* Points program into the mapped image after checking every section lies inside it */
+    bool attachImage();
+};
+
+/* Machine state for running a Program: memory, registers, output buffer and input */
+/* run() returns instead of exiting, and reset() readies the context for another run of the same */
+/* program without allocating, so a host can run a program many times in one process */
+/* A context is used by one thread at a time; contexts sharing a Program can run on different threads */
+class ExecutionContext {
+public:
+    /* Memory starts with initialSlots slots and doubles as needed, up to maxSlots */
+    /* The context holds a reference to program, so the program stays loaded while the context lives */
+    explicit ExecutionContext(std::shared_ptr<const Program> program, int initialSlots = DEFAULT_MEMORY_SLOTS, int maxSlots = DEFAULT_MAX_MEMORY_SLOTS);
+
+    /* Writes any buffered output */
+    ~ExecutionContext();
+
+    ExecutionContext(const ExecutionContext&) = delete;
+    ExecutionContext& operator=(const ExecutionContext&) = delete;
+
+    /* Turns on tracing: run() records the last capacity instructions and writes them to filename */
+    /* Decode the file with the trace decoder to get the old debug log text */
+    void enableTrace(const std::string& filename, size_t capacity = DEFAULT_TRACE_RECORDS);
+
+    /* Turns on the JIT: a function is compiled to native code once an instruction in it has been */
+    /* called or branched back to threshold times. Prints a warning and stays off where native code cannot run */
+    /* Compiled code records no trace, so the JIT is not used while tracing */
+    void enableJit(int threshold = DEFAULT_JIT_THRESHOLD);
+
+    /* Splits array instructions on arrays of PARALLEL_MIN_ELEMENTS or more across threads threads, */
+    /* each working on a contiguous part of the array. 1, the default, runs everything on the calling thread */
+    /* Results are the same for any number of threads; bytecode.h gives the order float sums are added in */
+    void setThreads(int threads);
+
+    /* Sets whether PRINT output is buffered; unbuffered output is written line by line, for debugging */
+    void setOutputBuffered(bool buffered) {
+        outputBuffered = buffered;
+    }
+
+    /* Makes READ and READF take their input from filename instead of stdin */
+    /* Returns false if the file could not be opened */
+    bool setInputFile(const std::string& filename) {
+        return input.open(filename);
+    }
+
+    /* Makes READ and READF find no input: every read returns 0 */
+    void setEmptyInput() {
+        input.openEmpty();
+    }
+
+    /* Makes PRINT write to out instead of stdout; out must stay alive while the context writes to it */
+    void setOutput(std::ostream& out) {
+        flushOutput();
+        output = &out;
+    }
+
+    /* Writes buffered PRINT output to stdout, or the stream given to setOutput() */
+    /* Runs on END, when the buffer is full, before READ and READF from a terminal or pipe so prompts show, */
+    /* and when run() returns */
+    void flushOutput();
+
+    /* Runs the program from where the context stands, the start after construction or reset() */
+    RunStatus run();
+
+    /* Readies the context to run the program again from the start */
+    /* Registers, memory and the heap are cleared but memory keeps its size, so nothing is allocated; */
+    /* input, trace and JIT settings and compiled code are kept */
+    void reset();
+
+    /* Returns true if the last run() stopped at an END instruction */
+    bool hasEnded() const {
+        return ended;
+    }
+
+    /* Returns the message of the error that stopped the last run(), empty if there was none */
+    const std::string& getError() const {
+        return error;
+    }
+
+    /* Returns number of instructions executed so far; instructions run as native code are not counted */
+    long long getInstructionsExecuted() const {
+        return instructionsExecuted;
+    }
+
+    /* Returns number of functions the JIT compiled, 0 when it is off */
+    int getFunctionsCompiled() const {
+        return jit != nullptr ? jit->getFunctionsCompiled() : 0;
+    }
+
+private:
+    // Attributes
+    Value gpr; // General purpose register; written by POP, read by PUSH
+
+    std::vector<Value> memoryStorage; // Frames and operand stack, one tagged value per slot
+    Value* memory; // memoryStorage.data(), refreshed whenever memory grows
+    int memorySize; // Number of slots in memory
+    int maxMemorySize; // Memory never grows past this many slots
+    int stackTop; // Top available slot in memory; last value added at memory[stackTop - 1]
+    int stackPointer; // Current frame; memory slot 0 is in memory[stackPointer + 0]
+
+    std::vector<Value> heapStorage; // Heap arrays, apart from the frames; see HALLOC in bytecode.h
+    Value* heap; // heapStorage.data(), refreshed whenever the heap grows
+    int heapTop; // Heap slots in use; HALLOC allocates from here and HFREE moves it back
+
+    int programCounter; // Current instruction being executed
+    bool ended; // Whether END was executed
+    long long instructionsExecuted; // Number of instructions dispatched by run()
+    std::string error; // Message of the run-time error that stopped run()
+
+    std::shared_ptr<const Program> image; // Program run() executes, shared with other contexts
+    BytecodeView program; // image->view(), copied so the interpreter reads it without an indirection
+
+    RingTrace* trace; // Trace run() records into, nullptr when tracing is off
+    std::string traceFilename;
+
+    ThreadPool* pool; // Threads for long array instructions, nullptr when they run on the calling thread
+
+    Jit* jit; // Compiles hot functions, nullptr when the JIT is off
+    uint32_t jitThreshold; // Calls or backward branches to an instruction before its function is compiled
+    std::vector<uint32_t> hotness; // Per instruction: calls and backward branches to it
+
+    std::vector<char> outputBuffer; // PRINT output not yet written out
+    size_t outputUsed; // Bytes of outputBuffer in use
+    bool outputBuffered; // False when every PRINT is written to stdout at once
+    std::ostream* output; // Where PRINT output goes, std::cout unless setOutput() was called
+
+    InputReader input; // Numbers for READ and READF
+
+    // Helper functions
+
+    /* Appends text to the output buffer, writing the buffer out first if it is full */
+    void writeOutput(const char* text, size_t length);
+
+    /* Ends a line of output; with unbuffered output the line is written out at once */
+    void endOutputLine();
+
+    /* Grows memory so that slot is valid, doubling its size each time */
+    /* Throws std::runtime_error if slot is negative or past maxMemorySize; run() reports it */
+    void grow(int slot);
+
+    /* Makes sure slot is in memory; a single unsigned compare in the common case */
+    /* Must be called before taking references into memory, since growing moves it */
+    void reserve(int slot) {
+        if ((unsigned) slot >= (unsigned) memorySize) {
+            grow(slot);
+        }
+    }
+
+    /* Writes the trace file if tracing is on */
+    void writeTrace();
+
+    /* Interpreter loop, traced through the Trace policy */
+    template <typename Trace, bool UseJit = false>
+    void execute(Trace& tracer);
+
+    /* Runs compiled code from programCounter, compiling its function first if it has just got hot */
+    void enterJit();
+
+    /* Makes sure the length slots of the array operand offset are in memory; for a heap array, */
+    /* checks that they are allocated. Throws std::runtime_error if they are not */
+    void reserveArray(int offset, int length);
+
+    /* Returns the first element of the array operand offset, after reserveArray() */
+    Value* arrayAt(int offset) const {
+        return isHeapArrayOperand(offset) ? heap + memory[stackPointer + heapArraySlot(offset)].i : memory + stackPointer + offset;
+    }
+
+    /* Throws std::runtime_error for a heap index that is not allocated */
+    [[noreturn]] void heapAccessError(int index) const;
+
+    /* Throws std::runtime_error for an element index outside a heap array of length elements */
+    [[noreturn]] void heapIndexError(int index, int length) const;
+
+    /* Returns the heap index of an element of the heap array in a heap record, after checking the index */
+    int heapElement(const int32_t* record, int index) const;
+
+    /* Returns how many parts an array instruction on length elements is split into: one per thread */
+    /* for arrays of PARALLEL_MIN_ELEMENTS or more, otherwise 1 */
+    int partsFor(int length) const {
+        return pool != nullptr && length >= PARALLEL_MIN_ELEMENTS ? pool->getThreads() : 1;
+    }
+
+    /* Calls part(start, end) on contiguous ranges covering the length elements of the array at dst, */
+    /* in one call or one per thread; see partsFor() */
+    template <typename Part>
+    void forEachPart(const Value* dst, int length, const Part& part);
+
+    /* Pushes the result of reduction op (VSUM to VDOT) on the arrays of record */
+    void reduce(Op op, const int32_t* record);
+
+    /* Vector instruction kernels: Operation gives the int and float arithmetic, record the operands */
+    template <typename Operation>
+    void vectorScalar(const int32_t* record);
+    template <typename Operation>
+    void vectorArray(const int32_t* record);
+
+    // Instructions, one handler per stack machine instruction and overload; see stackMachine.cpp
+
+    void CALL();
+    void CALL(int address);
+    void RET();
+    void RETV();
+    void CALL(int address, int numParams);
+    void RET(int numParams);
+    void RETV(int numParams);
+    void TAILCALL(int address, int numParams, int frameParams);
+    void PUSH();
+    void PUSH(int value);
+    void PUSH(float value);
+    Value POP();
+    void DUP();
+    void LOAD();
+    void SAVE();
+    void STORE();
+    void LOADL(int address, int skip);
+    void STOREL(int address, int skip);
+    void ADDLL(int first, int second, int skip);
+    void ADD();
+    void SUB();
+    void MUL();
+    void DIV();
+    void REM();
+    void IADD();
+    void FADD();
+    void ISUB();
+    void FSUB();
+    void IMUL();
+    void FMUL();
+    void IDIV();
+    void FDIV();
+    void IEQ();
+    void FEQ();
+    void INE();
+    void FNE();
+    void ILE();
+    void FLE();
+    void IGE();
+    void FGE();
+    void ILT();
+    void FLT();
+    void IGT();
+    void FGT();
+    void EQ();
+    void NE();
+    void LE();
+    void GE();
+    void LT();
+    void GT();
+    void VADDS(const int32_t* record);
+    void VSUBS(const int32_t* record);
+    void VMULS(const int32_t* record);
+    void VDIVS(const int32_t* record);
+    void VREMS(const int32_t* record);
+    void VADDV(const int32_t* record);
+    void VSUBV(const int32_t* record);
+    void VMULV(const int32_t* record);
+    void VDIVV(const int32_t* record);
+    void VREMV(const int32_t* record);
+    void VMAP(const int32_t* record);
+    void VSUM(const int32_t* record);
+    void VMIN(const int32_t* record);
+    void VMAX(const int32_t* record);
+    void VDOT(const int32_t* record);
+    void HALLOC(const int32_t* record);
+    void HFREE(int slot);
+    void HLOAD(const int32_t* record);
+    void HSTORE(const int32_t* record);
+    void VREAD(const int32_t* record);
+    void VPRINT(const int32_t* record);
+    void BRT();
+    void BRT(int loc);
+    void BRZ();
+    void BRZ(int loc);
+    void JUMP();
+    void JUMP(int loc);
+    void PRINT();
+    void PRINT(std::string message);
+    void PRINT(const char* message, uint32_t length);
+    void READ();
+    void READF();
+    void INT();
+    void FLOAT();
+    void END();
+};
+
+#endif // STACK_MACHINE_H
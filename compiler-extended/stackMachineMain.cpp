@@ -1,17 +1,209 @@
 #include <iostream>
+#include <iomanip>
+#include <fstream>
 #include <string>
-#include "stackMachine.cpp"
+#include <chrono>
+#include <cstdlib>
+#include "stackMachine.h"
+#include "batchRunner.h"
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+/* Runs every entry of a batch manifest and prints one report line per run */
+/* With outputDir set, the output of the run on manifest line N is written to outputDir/runN.out */
+/* Returns 0 if every run completed and matched its expected output */
+static int runBatch(const std::string& manifest, const BatchOptions& options, const std::string& outputDir) {
+    std::vector<BatchRun> runs;
+    if (!readManifest(manifest, runs)) {
         return 1;
     }
+    BatchRunner runner(options);
+    auto start = std::chrono::steady_clock::now();
+    runner.run(runs);
+    auto end = std::chrono::steady_clock::now();
+
+    int passed = 0;
+    int failed = 0;
+    int errors = 0;
+    for (const BatchRun& run : runs) {
+        const char* result;
+        if (!run.completed || run.status == RunStatus::RUNTIME_ERROR) {
+            result = "ERROR";
+            errors++;
+        } else if (run.expectedFile.empty()) {
+            result = "DONE";
+        } else if (run.passed) {
+            result = "PASS";
+            passed++;
+        } else {
+            result = "FAIL";
+            failed++;
+        }
+        std::cout << result << " " << run.programFile << " " << (run.inputFile.empty() ? "-" : run.inputFile)
+                  << " " << std::fixed << std::setprecision(3) << run.seconds * 1000 << " ms " << run.instructions << " instructions";
+        if (!run.error.empty()) {
+            std::cout << " (" << run.error << ")";
+        }
+        std::cout << std::endl;
+
+        if (!outputDir.empty() && run.completed) {
+            std::string outputFile = outputDir + "/run" + std::to_string(run.line) + ".out";
+            std::ofstream out(outputFile, std::ios::binary);
+            if (!(out << run.output)) {
+                std::cerr << "Error: Could not write " << outputFile << std::endl;
+                errors++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << runs.size() << " runs: " << passed << " passed, " << failed << " failed, " << errors << " errors in "
+              << seconds << " s on " << runner.getThreads() << " threads" << std::endl;
+    return failed == 0 && errors == 0 ? 0 : 1;
+}
 
-    std::string filename = argv[1];
+int main(int argc, char* argv[]) {
+    // Reading options; the last argument is the program
+    bool printStats = false;
+    int memorySlots = DEFAULT_MEMORY_SLOTS;
+    int maxMemorySlots = DEFAULT_MAX_MEMORY_SLOTS;
+    std::string traceFile;
+    long traceRecords = (long) DEFAULT_TRACE_RECORDS;
+    bool useJit = false;
+    bool unbuffered = false;
+    std::string inputFile;
+    int jitThreshold = DEFAULT_JIT_THRESHOLD;
+    std::string batchFile;
+    std::string batchOutputDir;
+    int jobs = 0;
+    int threads = 1;
+    std::string filename;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stats") {
+            printStats = true;
+        } else if ((arg == "--memory" || arg == "--max-memory") && i + 1 < argc) {
+            // Sizes are in slots; each slot holds one int or float
+            int slots = atoi(argv[++i]);
+            if (slots <= 0) {
+                filename.clear();
+                break;
+            }
+            if (arg == "--memory") {
+                memorySlots = slots;
+            } else {
+                maxMemorySlots = slots;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (arg == "--trace-size" && i + 1 < argc) {
+            // Number of instructions kept; older ones are overwritten
+            traceRecords = atol(argv[++i]);
+            if (traceRecords <= 0) {
+                filename.clear();
+                break;
+            }
+        } else if (arg == "--unbuffered") {
+            // Writing each PRINT at once, so output is not lost if the program crashes
+            unbuffered = true;
+        } else if (arg == "--input" && i + 1 < argc) {
+            // READ and READF take their input from this file instead of stdin
+            inputFile = argv[++i];
+        } else if (arg == "--jit") {
+            useJit = true;
+        } else if (arg == "--jit-threshold" && i + 1 < argc) {
+            // Calls or backward branches before a function is compiled; implies --jit
+            useJit = true;
+            jitThreshold = atoi(argv[++i]);
+            if (jitThreshold <= 0) {
+                filename.clear();
+                break;
+            }
+        } else if (arg == "--batch" && i + 1 < argc) {
+            // Runs the (program, input, expected output) lines of a manifest instead of one program
+            batchFile = argv[++i];
+        } else if (arg == "--batch-output" && i + 1 < argc) {
+            batchOutputDir = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            // Worker threads for --batch; one per hardware thread by default
+            jobs = atoi(argv[++i]);
+            if (jobs <= 0) {
+                batchFile.clear();
+                filename.clear();
+                break;
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            // Threads each array instruction on a long array is split across
+            threads = atoi(argv[++i]);
+            if (threads <= 0) {
+                batchFile.clear();
+                filename.clear();
+                break;
+            }
+        } else if (filename.empty() && arg.rfind("--", 0) != 0) {
+            filename = arg;
+        } else {
+            filename.clear();
+            break;
+        }
+    }
+    if (!batchFile.empty() && filename.empty() && traceFile.empty() && inputFile.empty()) {
+        BatchOptions options;
+        options.threads = jobs;
+        options.initialSlots = memorySlots;
+        options.maxSlots = maxMemorySlots;
+        options.useJit = useJit;
+        options.jitThreshold = jitThreshold;
+        options.arrayThreads = threads;
+        return runBatch(batchFile, options, batchOutputDir);
+    }
+    if (filename.empty() || !batchFile.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--stats] [--memory SLOTS] [--max-memory SLOTS] [--trace FILE] [--trace-size N] [--jit] [--jit-threshold N] [--threads N] [--unbuffered] [--input FILE] <filename>" << std::endl;
+        std::cerr << "       " << argv[0] << " [--memory SLOTS] [--max-memory SLOTS] [--jit] [--jit-threshold N] [--threads N] [--jobs N] [--batch-output DIR] --batch <manifest>" << std::endl;
+        return 1;
+    }
     
-    Operation stackMachine(filename);
-    stackMachine.run();
+    std::shared_ptr<const Program> program = Program::load(filename);
+    if (program == nullptr) {
+        return 1;
+    }
+    ExecutionContext stackMachine(program, memorySlots, maxMemorySlots);
+    if (!traceFile.empty()) {
+        stackMachine.enableTrace(traceFile, (size_t) traceRecords);
+    }
+    if (useJit) {
+        stackMachine.enableJit(jitThreshold);
+    }
+    stackMachine.setThreads(threads);
+    if (unbuffered) {
+        stackMachine.setOutputBuffered(false);
+    }
+    if (!inputFile.empty() && !stackMachine.setInputFile(inputFile)) {
+        std::cerr << "Error: Could not read " << inputFile << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    RunStatus status = stackMachine.run();
+    auto end = std::chrono::steady_clock::now();
+
+    // Reporting instruction count and throughput on stderr so program output is unchanged
+    if (printStats) {
+        double seconds = std::chrono::duration<double>(end - start).count();
+        long long count = stackMachine.getInstructionsExecuted();
+        std::cerr << "Executed " << count << " instructions in " << seconds << " s";
+        if (seconds > 0) {
+            std::cerr << " (" << (long long) (count / seconds) << " instructions/s)";
+        }
+        std::cerr << std::endl;
+        if (useJit) {
+            std::cerr << "Compiled " << stackMachine.getFunctionsCompiled() << " functions; native instructions are not counted" << std::endl;
+        }
+    }
+
+    // END stops the program without the completion message
+    if (status == RunStatus::RUNTIME_ERROR) {
+        return 1;
+    }
+    if (status == RunStatus::ENDED) {
+        return 0;
+    }
     std::cout << "Program execution completed successfully." << std::endl;
     
     return 0;
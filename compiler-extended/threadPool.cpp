@@ -0,0 +1,56 @@
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(int threads) : job(nullptr), jobParts(0), pending(0), generation(0), stopping(false) {
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(int parts, const std::function<void(int)>& part) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = &part;
+        jobParts = parts;
+        pending = parts - 1;
+        generation++;
+    }
+    wake.notify_all();
+    part(0);
+
+    // Waiting for every worker part, so no worker still holds this job when the next one starts
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return pending == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::work(int index) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        if (index < jobParts) {
+            const std::function<void(int)>& part = *job;
+            guard.unlock();
+            part(index);
+            guard.lock();
+            if (--pending == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of threads that work on the parts of one job at a time */
+/* The thread calling run() does part 0 itself, so a pool of n threads starts n - 1 workers */
+/* Workers sleep between jobs; a pool is used by one ExecutionContext, from one thread at a time */
+class ThreadPool {
+public:
+    /* Starts threads - 1 worker threads */
+    explicit ThreadPool(int threads);
+
+    /* Stops and joins the workers */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* Returns the number of threads, the calling thread included */
+    int getThreads() const {
+        return (int) workers.size() + 1;
+    }
+
+    /* Calls part(p) for every p from 0 to parts - 1, each on its own thread; parts is at most getThreads() */
+    /* Returns once every call has returned */
+    void run(int parts, const std::function<void(int)>& part);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex lock; // Guards everything below
+    std::condition_variable wake; // Signalled when a job starts or the pool stops
+    std::condition_variable done; // Signalled when the last worker part of a job returns
+    const std::function<void(int)>* job; // Job being run, valid while pending > 0
+    int jobParts;
+    int pending; // Worker parts of the job still running
+    uint64_t generation; // Number of jobs started; a worker takes part in each one once
+    bool stopping;
+
+    /* Worker thread: waits for jobs and does part index of each one that has that many parts */
+    void work(int index);
+};
+
+#endif // THREAD_POOL_H
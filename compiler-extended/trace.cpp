@@ -0,0 +1,45 @@
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+
+RingTrace::RingTrace(size_t capacity) : records(capacity < 1 ? 1 : capacity), next(0), total(0) {}
+
+bool RingTrace::writeFile(const std::string& filename) const {
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    TraceHeader header;
+    std::memcpy(header.magic, VSMT_MAGIC, sizeof(header.magic));
+    header.version = VSMT_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    header.recordCount = (uint32_t) (total < records.size() ? total : records.size());
+    header.totalRecords = total;
+
+    // Oldest record is at next once the buffer has wrapped, at 0 before
+    size_t start = total > records.size() ? next : 0;
+    size_t tail = records.size() - start < header.recordCount ? records.size() - start : header.recordCount;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(records.data() + start, sizeof(TraceRecord), tail, file) == tail;
+    ok = ok && fwrite(records.data(), sizeof(TraceRecord), header.recordCount - tail, file) == header.recordCount - tail;
+    return fclose(file) == 0 && ok;
+}
+
+bool RingTrace::readFile(const std::string& filename, TraceHeader& header, std::vector<TraceRecord>& out) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && std::memcmp(header.magic, VSMT_MAGIC, sizeof(header.magic)) == 0
+        && header.version == VSMT_VERSION
+        && header.recordSize == sizeof(TraceRecord)
+        && header.totalRecords >= header.recordCount;
+    if (ok) {
+        out.resize(header.recordCount);
+        ok = fread(out.data(), sizeof(TraceRecord), out.size(), file) == out.size();
+    }
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+
+/* One executed instruction in a binary trace: the machine state right after it ran */
+struct TraceRecord {
+    int32_t pc; // Index of the instruction
+    uint16_t op; // Op of the instruction
+    uint16_t isFloat; // Tag of the top of stack
+    int32_t top; // Top of stack as int or float bits, 0 if the stack is empty
+    int32_t depth; // stackTop after the instruction
+};
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord is part of the trace file format");
+
+/* Trace file layout: header, then recordCount records, oldest first */
+const char VSMT_MAGIC[4] = {'V', 'S', 'M', 'T'};
+const uint32_t VSMT_VERSION = 1;
+
+struct TraceHeader {
+    char magic[4]; // VSMT_MAGIC
+    uint32_t version; // VSMT_VERSION
+    uint32_t recordSize; // sizeof(TraceRecord)
+    uint32_t recordCount; // Number of records in the file
+    uint64_t totalRecords; // Number of instructions traced; more than recordCount if the ring buffer wrapped
+};
+static_assert(sizeof(TraceHeader) == 24, "TraceHeader is part of the trace file format");
+
+/* Default number of records kept by a RingTrace (16 MiB) */
+const size_t DEFAULT_TRACE_RECORDS = 1024 * 1024;
+
+/* Trace policy for ExecutionContext::execute that records nothing */
+/* record() is empty, so the untraced interpreter loop has no tracing code in it */
+struct NoTrace {
+    static const bool ENABLED = false;
+
+    void record(int32_t, Op, int32_t, uint16_t, int32_t) {}
+};
+
+/* Trace policy for ExecutionContext::execute that keeps the last records in a ring buffer */
+class RingTrace {
+public:
+    static const bool ENABLED = true;
+
+    RingTrace(size_t capacity = DEFAULT_TRACE_RECORDS);
+
+    /* Records one executed instruction, overwriting the oldest record when full */
+    void record(int32_t pc, Op op, int32_t top, uint16_t isFloat, int32_t depth) {
+        TraceRecord& r = records[next];
+        r.pc = pc;
+        r.op = (uint16_t) op;
+        r.isFloat = isFloat;
+        r.top = top;
+        r.depth = depth;
+        if (++next == records.size()) {
+            next = 0;
+        }
+        total++;
+    }
+
+    /* Writes the buffered records oldest first, returns false if the file could not be written */
+    bool writeFile(const std::string& filename) const;
+
+    /* Reads a trace file written by writeFile, returns false if it is not a valid trace */
+    static bool readFile(const std::string& filename, TraceHeader& header, std::vector<TraceRecord>& out);
+
+private:
+    std::vector<TraceRecord> records;
+    size_t next; // Slot the next record goes to
+    uint64_t total; // Records ever written
+};
+
+#endif // TRACE_H
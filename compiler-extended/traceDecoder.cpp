@@ -0,0 +1,371 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "stackMachine.h"
+
+/* Memory slot as far as the decoder knows it */
+struct ShadowSlot {
+    Value value;
+    bool known; // False for slots written before the oldest record of a wrapped trace
+};
+
+/* Replays a binary trace against its program and prints the stack machine's debug log text */
+/* Records only hold the top of stack, so writes below the top (STORE, SAVE, CALL, TAILCALL, vector instructions, */
+/* HALLOC, VREAD) are redone here. Heap arrays are not kept, so vector instructions read their elements as unknown */
+class TraceDecoder {
+private:
+    std::vector<ShadowSlot> memory;
+    int depth;
+    int stackPointer;
+    bool stackPointerKnown;
+    bool complete; // Whether the trace starts at the first instruction
+    int heapTop; // Heap slots in use, for the handles HALLOC stores
+    bool heapTopKnown;
+
+    /* Returns slot, growing memory the way the stack machine does */
+    ShadowSlot& slot(int index) {
+        if (index >= (int) memory.size()) {
+            ShadowSlot zero;
+            zero.value.i = 0;
+            zero.value.isFloat = 0;
+            zero.known = complete; // New memory is zeroed, but a wrapped trace may have missed writes to it
+            memory.resize(index + 1, zero);
+        }
+        return memory[index];
+    }
+
+    /* Returns true and sets result if slot index holds a known int */
+    bool knownInt(int index, int& result) {
+        if (index < 0 || index >= (int) memory.size() || !memory[index].known) {
+            return false;
+        }
+        result = memory[index].value.i;
+        return true;
+    }
+
+    /* Returns element i of an array operand; elements of heap arrays are unknown */
+    ShadowSlot arrayElement(int32_t operand, int i) {
+        return isHeapArrayOperand(operand) ? ShadowSlot() : slot(stackPointer + operand + i);
+    }
+
+    /* Computes a op b into result as the stack machine's vector instructions do; operation is 0 ADD to 4 REM */
+    /* Returns false where the stack machine would have divided by zero */
+    static bool vectorArithmetic(int operation, const Value& a, const Value& b, Value& result) {
+        bool isFloat = (a.isFloat | b.isFloat) && operation != 4;
+        float x = a.isFloat ? a.f : (float) a.i;
+        float y = b.isFloat ? b.f : (float) b.i;
+        int32_t i = a.isFloat ? (int32_t) a.f : a.i;
+        int32_t j = b.isFloat ? (int32_t) b.f : b.i;
+        if (!isFloat && operation >= 3 && j == 0) {
+            return false;
+        }
+        float f = 0;
+        int32_t n = 0;
+        switch (operation) {
+            case 0: f = x + y; n = (int32_t) ((uint32_t) i + (uint32_t) j); break;
+            case 1: f = x - y; n = (int32_t) ((uint32_t) i - (uint32_t) j); break;
+            case 2: f = x * y; n = (int32_t) ((uint32_t) i * (uint32_t) j); break;
+            case 3: f = x / y; n = i / j; break;
+            default: n = i % j; break;
+        }
+        if (isFloat) {
+            result.f = f;
+        } else {
+            result.i = n;
+        }
+        result.isFloat = isFloat;
+        return true;
+    }
+
+    /* Converts a vector instruction result to the type it is stored as */
+    static Value vectorResult(const Value& value, bool floatResult) {
+        Value result;
+        if (floatResult) {
+            result.f = value.isFloat ? value.f : (float) value.i;
+        } else {
+            result.i = value.isFloat ? (int32_t) value.f : value.i;
+        }
+        result.isFloat = floatResult;
+        return result;
+    }
+
+    /* Computes one element of vector instruction op into result as the stack machine does */
+    static bool vectorElement(Op op, const Value& a, const Value& b, bool floatResult, Value& result) {
+        int operation = (int) op - (int) (isVectorScalarOp(op) ? Op::VADDS : Op::VADDV);
+        if (!vectorArithmetic(operation, a, b, result)) {
+            return false;
+        }
+        result = vectorResult(result, floatResult);
+        return true;
+    }
+
+    /* Redoes the element writes of a VMAP; elements with an unknown operand become unknown */
+    void replayVectorMap(const int32_t* record) {
+        if (!stackPointerKnown || isHeapArrayOperand(record[VMAP_DST])) {
+            return;
+        }
+        int scalarBase = depth - record[VMAP_SCALAR_COUNT];
+        const int32_t* step = record + VMAP_HEADER_SIZE;
+        bool floatResult = (record[VMAP_FLAGS] & VECTOR_FLOAT_RESULT) != 0;
+        for (int i = 0; i < record[VMAP_LENGTH]; i++) {
+            ShadowSlot values[VMAP_MAX_DEPTH];
+            int count = 0;
+            for (int s = 0; s < record[VMAP_STEP_COUNT]; s++) {
+                int32_t value = step[2 * s + 1];
+                if (step[2 * s] == VMAP_ARRAY) {
+                    values[count++] = arrayElement(value, i);
+                } else if (step[2 * s] == VMAP_SCALAR) {
+                    values[count++] = scalarBase >= 0 ? slot(scalarBase + value) : ShadowSlot();
+                } else {
+                    count--;
+                    ShadowSlot& a = values[count - 1];
+                    a.known = a.known && values[count].known && vectorArithmetic(value, a.value, values[count].value, a.value);
+                }
+            }
+            ShadowSlot result = values[0];
+            if (result.known) {
+                result.value = vectorResult(result.value, floatResult);
+            }
+            slot(stackPointer + record[VMAP_DST] + i) = result;
+        }
+    }
+
+    /* Redoes the element writes of a vector instruction; elements with an unknown operand become unknown */
+    void replayVector(Op op, const int32_t* record) {
+        if (!stackPointerKnown || isHeapArrayOperand(record[VECTOR_DST])) {
+            return;
+        }
+        bool scalarForm = isVectorScalarOp(op);
+        ShadowSlot scalar;
+        scalar.known = false;
+        if (scalarForm && depth >= 1) {
+            scalar = slot(depth - 1);
+        }
+        bool floatResult = (record[VECTOR_FLAGS] & VECTOR_FLOAT_RESULT) != 0;
+        for (int i = 0; i < record[VECTOR_LENGTH]; i++) {
+            ShadowSlot a = arrayElement(record[VECTOR_SRC], i);
+            ShadowSlot b = scalarForm ? scalar : arrayElement(record[VECTOR_SRC2], i);
+            ShadowSlot result;
+            result.known = a.known && b.known && vectorElement(op, a.value, b.value, floatResult, result.value);
+            slot(stackPointer + record[VECTOR_DST] + i) = result;
+        }
+    }
+
+    /* Applies the writes below the top of stack made by an instruction */
+    void replay(const TraceRecord& record, const BytecodeView& program) {
+        Op op = (Op) record.op;
+        int address = 0;
+        switch (op) {
+            case Op::STORE:
+            case Op::SAVE:
+                // Value is second on stack, frame address on top
+                if (stackPointerKnown && depth >= 2 && knownInt(depth - 1, address)) {
+                    ShadowSlot value = slot(depth - 2);
+                    slot(stackPointer + address) = value;
+                }
+                break;
+            case Op::STOREL:
+                // Value is on top, frame address is in the instruction
+                if (stackPointerKnown && depth >= 1) {
+                    ShadowSlot value = slot(depth - 1);
+                    slot(stackPointer + program.code[record.pc].iArg) = value;
+                }
+                break;
+            case Op::CALL:
+            case Op::CALL_I: {
+                int top = op == Op::CALL ? depth - 1 : depth; // CALL pops the address first
+                int numParams = 0;
+                if (!knownInt(top - 1, numParams)) {
+                    stackPointerKnown = false;
+                    break;
+                }
+                // Same frame layout as ExecutionContext::CALL
+                slot(top + 1);
+                ShadowSlot numParamsSlot = slot(top - 1);
+                for (int i = 1; i <= numParams; i++) {
+                    slot(top - i) = slot(top - i - 1);
+                }
+                slot(top - numParams - 1) = numParamsSlot;
+                slot(top).value.i = stackPointer;
+                slot(top).value.isFloat = 0;
+                slot(top).known = stackPointerKnown;
+                stackPointer = top - numParams;
+                stackPointerKnown = true;
+                break;
+            }
+            case Op::CALL_N: {
+                // Same frame layout as ExecutionContext::CALL(address, numParams): nothing below the header moves
+                int top = depth;
+                slot(top + 1);
+                slot(top).value.i = stackPointer;
+                slot(top).value.isFloat = 0;
+                slot(top).known = stackPointerKnown;
+                stackPointer = top - program.code[record.pc].aux;
+                stackPointerKnown = true;
+                break;
+            }
+            case Op::TAILCALL: {
+                // Same moves as ExecutionContext::TAILCALL; the stack pointer stays
+                if (!stackPointerKnown) {
+                    break;
+                }
+                int numParams = tailCallParams(program.code[record.pc].aux);
+                int header = stackPointer + tailCallFrameParams(program.code[record.pc].aux);
+                ShadowSlot savedStackPointer = slot(header);
+                ShadowSlot returnAddress = slot(header + 1);
+                for (int i = 0; i < numParams; i++) {
+                    slot(stackPointer + i) = slot(depth - numParams + i);
+                }
+                slot(stackPointer + numParams) = savedStackPointer;
+                slot(stackPointer + numParams + 1) = returnAddress;
+                break;
+            }
+            case Op::RET_N:
+            case Op::RETV_N: {
+                int previous = 0;
+                if (!stackPointerKnown || !knownInt(stackPointer + program.code[record.pc].iArg, previous)) {
+                    stackPointerKnown = false;
+                    break;
+                }
+                stackPointer = previous;
+                break;
+            }
+            case Op::RET:
+            case Op::RETV: {
+                int numParams = 0;
+                int previous = 0;
+                if (!stackPointerKnown || (stackPointer != 0 && !knownInt(stackPointer - 1, numParams))
+                    || !knownInt(stackPointer + numParams, previous)) {
+                    stackPointerKnown = false;
+                    break;
+                }
+                stackPointer = previous;
+                break;
+            }
+            case Op::VADDS: case Op::VSUBS: case Op::VMULS: case Op::VDIVS: case Op::VREMS:
+            case Op::VADDV: case Op::VSUBV: case Op::VMULV: case Op::VDIVV: case Op::VREMV:
+                replayVector(op, program.constants + program.code[record.pc].iArg);
+                break;
+            case Op::VMAP:
+                replayVectorMap(program.constants + program.code[record.pc].iArg);
+                break;
+            case Op::HALLOC: {
+                const int32_t* heapRecord = program.constants + program.code[record.pc].iArg;
+                if (stackPointerKnown) {
+                    ShadowSlot& handle = slot(stackPointer + heapRecord[HEAP_SLOT]);
+                    handle.value.i = heapTop;
+                    handle.value.isFloat = 0;
+                    handle.known = heapTopKnown;
+                }
+                heapTop += heapRecord[HEAP_LENGTH];
+                break;
+            }
+            case Op::VREAD: {
+                // Values read are not in the trace
+                const int32_t* ioRecord = program.constants + program.code[record.pc].iArg;
+                if (stackPointerKnown && !isHeapArrayOperand(ioRecord[ARRAY_IO_ARRAY])) {
+                    for (int i = 0; i < ioRecord[ARRAY_IO_LENGTH]; i++) {
+                        slot(stackPointer + ioRecord[ARRAY_IO_ARRAY] + i).known = false;
+                    }
+                }
+                break;
+            }
+            case Op::HFREE:
+                heapTopKnown = stackPointerKnown && knownInt(stackPointer + program.code[record.pc].iArg, heapTop);
+                break;
+            default:
+                break;
+        }
+
+        // Everything else only changes the top of stack, which the record holds
+        depth = record.depth;
+        if (depth > 0) {
+            ShadowSlot& top = slot(depth - 1);
+            top.value.i = record.top;
+            top.value.isFloat = record.isFloat;
+            top.known = true;
+        }
+    }
+
+    /* Prints a slot the way the debug log did; unknown slots print as ? */
+    static void printSlot(std::ostream& out, const ShadowSlot& s) {
+        if (!s.known) {
+            out << "?";
+        } else if (!s.value.isFloat) {
+            out << s.value.i;
+        } else {
+            out << s.value.f;
+        }
+    }
+
+public:
+    /* A trace that wrapped starts part way through the program, with unknown memory */
+    TraceDecoder(bool complete) : depth(0), stackPointer(0), stackPointerKnown(complete), complete(complete),
+                                  heapTop(0), heapTopKnown(complete) {
+        if (!complete) {
+            depth = -1;
+        }
+    }
+
+    /* Prints the log lines of one executed instruction */
+    void decode(const TraceRecord& record, const Program& program, std::ostream& out) {
+        out << "Current stack: " << std::endl;
+        if (depth < 0) {
+            out << "?";
+        }
+        for (int i = 0; i < depth; i++) {
+            printSlot(out, slot(i));
+            out << " ";
+        }
+        out << std::endl;
+        out << "Executing instruction: " << record.pc << "|" << program.instructionText(record.pc);
+
+        replay(record, program.view());
+        if ((Op) record.op == Op::END) {
+            return; // The stack machine stopped without logging a result
+        }
+        out << "Stack Top: " << record.depth << "|";
+        if (record.depth > 0) {
+            printSlot(out, memory[record.depth - 1]);
+            out << (record.isFloat ? "(float)" : "(int)") << std::endl;
+        } else {
+            out << "Stack empty" << std::endl;
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <trace file> <program file>" << std::endl;
+        return 1;
+    }
+    std::string traceFile = argv[1];
+    std::string filename = argv[2];
+
+    TraceHeader header;
+    std::vector<TraceRecord> records;
+    if (!RingTrace::readFile(traceFile, header, records)) {
+        std::cerr << "Error: " << traceFile << " is not a valid version " << VSMT_VERSION << " trace file" << std::endl;
+        return 1;
+    }
+    std::shared_ptr<const Program> program = Program::load(filename);
+    if (program == nullptr) {
+        return 1;
+    }
+    int codeCount = (int) program->view().codeCount;
+
+    bool complete = header.totalRecords == header.recordCount;
+    if (!complete) {
+        std::cerr << "Note: the trace kept the last " << header.recordCount << " of " << header.totalRecords
+                  << " instructions; values from before it are shown as ?" << std::endl;
+    }
+    TraceDecoder decoder(complete);
+    for (const TraceRecord& record : records) {
+        if (record.pc < 0 || record.pc >= codeCount) {
+            std::cerr << "Error: trace does not match " << filename << " (instruction " << record.pc << ")" << std::endl;
+            return 1;
+        }
+        decoder.decode(record, *program, std::cout);
+    }
+    return 0;
+}